@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "libbacklight.h"
+#include "libbacklight_bank.h"
+
+#define xstr(a) str(a)
+#define str(a) #a
+
+#define DEFAULT_UPDATES 20000000ULL
+#define TICK_MS 100
+
+static void print_usage(void)
+{
+	printf("backlightbench, controller update throughput, Data Respons Solutions AB\n");
+	printf("Version:   %s\n", xstr(SRC_VERSION));
+	printf("\n");
+
+	printf("Usage:   backlightbench [OPTION]\n");
+	printf("\n");
+
+	printf("Options:\n");
+	printf("  --updates N    Controller updates per measurement\n");
+	printf("    Default: %llu\n", DEFAULT_UPDATES);
+	printf("\n");
+
+	printf("Prints controllers updated per second for separate libbacklight_ctrl instances\n");
+	printf("and for each libbacklight_bank implementation supported by the CPU,\n");
+	printf("with a new reading for every controller and a trigger for some of them each tick.\n");
+	printf("\n");
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void tick_ts(struct timespec* ts, uint64_t tick)
+{
+	const uint64_t ms = tick * TICK_MS;
+	ts->tv_sec = ms / 1000;
+	ts->tv_nsec = (ms % 1000) * 1000000L;
+}
+
+/* Inputs repeat every ticks, generated up front so only controllers are timed */
+struct input {
+	uint32_t count;
+	uint32_t ticks;
+	uint8_t *triggered;
+	uint32_t *lux;
+};
+
+static int input_init(struct input* in, uint32_t count)
+{
+	in->count = count;
+	in->ticks = 16;
+	in->triggered = malloc((size_t) count * in->ticks);
+	in->lux = malloc((size_t) count * in->ticks * sizeof(uint32_t));
+	if (!in->triggered || !in->lux)
+		return -1;
+	for (size_t i = 0; i < (size_t) count * in->ticks; ++i) {
+		in->triggered[i] = rand() % 64 == 0;
+		in->lux[i] = rand() % 2000;
+	}
+	return 0;
+}
+
+static void input_free(struct input* in)
+{
+	free(in->triggered);
+	free(in->lux);
+}
+
+static double run_ctrls(const struct libbacklight_conf* conf, const struct input* in, uint64_t ticks)
+{
+	struct timespec ts = {0, 0};
+	struct libbacklight_ctrl **ctrls = calloc(in->count, sizeof(struct libbacklight_ctrl*));
+	if (!ctrls)
+		return 0.0;
+	for (uint32_t i = 0; i < in->count; ++i)
+		ctrls[i] = create_libbacklight(&ts, conf);
+
+	const double start = now_s();
+	for (uint64_t t = 1; t <= ticks; ++t) {
+		tick_ts(&ts, t);
+		const size_t offset = (size_t) (t % in->ticks) * in->count;
+		for (uint32_t i = 0; i < in->count; ++i)
+			libbacklight_operate(ctrls[i], &ts, in->triggered[offset + i], in->lux[offset + i]);
+	}
+	const double elapsed = now_s() - start;
+
+	for (uint32_t i = 0; i < in->count; ++i)
+		destroy_libbacklight(&ctrls[i]);
+	free(ctrls);
+	return elapsed;
+}
+
+/* Returns 0 if implementation isn't supported */
+static double run_bank(const struct libbacklight_conf* conf, const struct input* in, uint64_t ticks,
+						enum libbacklight_bank_impl impl)
+{
+	struct timespec ts = {0, 0};
+	struct libbacklight_bank *bank = libbacklight_bank_create(&ts, conf, in->count);
+	if (!bank || libbacklight_bank_set_impl(bank, impl) != 0) {
+		libbacklight_bank_destroy(&bank);
+		return 0.0;
+	}
+
+	const double start = now_s();
+	for (uint64_t t = 1; t <= ticks; ++t) {
+		tick_ts(&ts, t);
+		const size_t offset = (size_t) (t % in->ticks) * in->count;
+		libbacklight_bank_operate(bank, &ts, &in->triggered[offset], &in->lux[offset]);
+	}
+	const double elapsed = now_s() - start;
+
+	libbacklight_bank_destroy(&bank);
+	return elapsed;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t updates = DEFAULT_UPDATES;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp("--updates", argv[i]) && i + 1 < argc) {
+			updates = strtoull(argv[++i], NULL, 10);
+		}
+		else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 1000;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 2;
+
+	const uint32_t counts[] = {1, 8, 64, 256, 1024, 4096, 16384};
+	const enum libbacklight_bank_impl impls[] = {LIBBACKLIGHT_BANK_SCALAR, LIBBACKLIGHT_BANK_GENERIC,
+												LIBBACKLIGHT_BANK_SSE4, LIBBACKLIGHT_BANK_AVX2};
+
+	printf("%12s %10s", "controllers", "ctrl");
+	for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k)
+		printf(" %10s", libbacklight_bank_impl_name(impls[k]));
+	printf("    [million controller updates/s]\n");
+
+	srand(1);
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		struct input in;
+		if (input_init(&in, counts[c]) != 0) {
+			fprintf(stderr, "Out of memory\n");
+			input_free(&in);
+			return 1;
+		}
+		const uint64_t ticks = updates / counts[c] ? updates / counts[c] : 1;
+		const double total = (double) ticks * counts[c];
+
+		const double ctrl_s = run_ctrls(&conf, &in, ticks);
+		printf("%12" PRIu32 " %10.1f", counts[c], ctrl_s > 0.0 ? total / ctrl_s / 1e6 : 0.0);
+		for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k) {
+			const double s = run_bank(&conf, &in, ticks, impls[k]);
+			if (s > 0.0)
+				printf(" %10.1f", total / s / 1e6);
+			else
+				printf(" %10s", "-");
+		}
+		printf("\n");
+		fflush(stdout);
+		input_free(&in);
+	}
+	return 0;
+}
@@ -1,18 +1,39 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <math.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/signalfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sched.h>
 #include <time.h>
 #include <iio.h>
 #include "log.h"
 #include "libbacklight.h"
+#include "status.h"
+#include "source.h"
+#include "statefile.h"
+#include "sim.h"
+#include "trace.h"
+#include "uring.h"
+#include "metrics.h"
+#include "decimate.h"
+#include "debounce.h"
+#include "config.h"
+#include "energy.h"
+#include "history.h"
+#include "control.h"
+#include "input.h"
+#include "edge.h"
+#include "iioscan.h"
 
 #define xstr(a) str(a)
 #define str(a) #a
@@ -20,6 +41,135 @@
 #define DEFAULT_ON_TIME_SEC 30
 #define DEFAULT_MIN_LUX 10
 #define DEFAULT_MAX_LUX 600
+#define SAMPLE_PERIOD_MS 100
+#define RT_DEADLINE_SLACK_MS 10
+#define POWER_SAVE_PERIOD_MS 1000
+#define SENSOR_BURST_SAMPLES 4
+#define SENSOR_BURST_MS 100
+#define SENSOR_STALE_MS 5000
+#define METRICS_INTERVAL_SEC 15
+#define ENERGY_STORE_MS 60000
+#define IIO_SYSFS_DIR "/sys/bus/iio/devices"
+#define INTERRUPT_STORM_HOLD_MS 5000
+#define INTERRUPT_STORM_SAMPLE_MS 100
+#define POWER_SAVE_TIMER_SLACK_NS 50000000UL
+#define RT_PREFAULT_STACK_SIZE (64 * 1024)
+
+struct sensor;
+struct proximity;
+struct backlight;
+
+/* Clock, device access and waiting for sources.
+ * device_io uses iio and sysfs, sim_io runs against scripted inputs under a virtual clock.
+ * Functions return 0 on success or negative errno. */
+struct io_ops {
+	int (*now)(struct timespec* ts);				// CLOCK_MONOTONIC
+	int (*wall)(struct timespec* ts);				// Coarse wall clock
+	int (*wait)(struct source_registry* reg, int timeout_ms, struct source_sample* sample);
+	int (*sensor_open)(struct sensor* sensor, unsigned int i, const struct iio_context* ctx, const char* device);
+	/* Raw attribute if raw is set or not sampling buffered */
+	int (*sensor_read)(struct sensor* sensor, unsigned int i, int raw, uint32_t* lux);
+	int (*sensor_start)(struct sensor* sensor);		// Buffered sampling
+	int (*sensor_suspend)(struct sensor* sensor);
+	int (*sensor_resume)(struct sensor* sensor);
+	/* nearlevel is read from device if negative */
+	int (*proximity_open)(struct proximity* proximity, const struct iio_context* ctx, const char* device,
+							long long* nearlevel);
+	int (*proximity_read)(struct proximity* proximity, long long* val);
+	int (*backlight_open)(struct backlight* backlight, const char* device);
+	int (*backlight_get)(struct backlight* backlight, uint32_t* value);
+	int (*backlight_max)(struct backlight* backlight, uint32_t* value);
+	int (*backlight_set)(struct backlight* backlight, uint32_t value);
+	/* Brightness to leave on exit */
+	int (*backlight_restore)(struct backlight* backlight, uint32_t value);
+};
+
+static const struct io_ops *io = NULL;
+
+/* Optional io_uring backend.
+ * Periodic sysfs reads due in one wakeup are submitted together before sampling,
+ * brightness writes are queued during the wakeup and submitted together at its end by batch_flush().
+ * Files are kept open and registered. */
+enum batch_file {
+	BATCH_SENSOR,						// One per sensor
+	BATCH_PROXIMITY = BATCH_SENSOR + LIBBACKLIGHT_MAX_SENSORS,
+	BATCH_INTERRUPT,
+	BATCH_BRIGHTNESS,
+	BATCH_FILES,
+};
+
+#define BATCH_BUF_SIZE 32
+#define BATCH_SENSOR_MASK (((1U << LIBBACKLIGHT_MAX_SENSORS) - 1) << BATCH_SENSOR)
+
+_Static_assert(BATCH_FILES <= 32, "batch_prefetch() mask is 32 bits");
+
+struct batch {
+	struct uring ring;
+	int fds[BATCH_FILES];				// -1 if unused
+	int owned[BATCH_FILES];				// fd opened by batch, interrupt fd is borrowed
+	char buf[BATCH_FILES][BATCH_BUF_SIZE];
+	int res[BATCH_FILES];				// Result of last read
+	int fresh[BATCH_FILES];				// Read completed but not yet taken
+	uint32_t value[BATCH_FILES];		// Value to write
+	int queued[BATCH_FILES];			// Write queued, only last value of a wakeup is written
+};
+
+static struct batch *batch = NULL;
+
+/* Take text read by batch_prefetch().
+ * Returns -EAGAIN if nothing prefetched, caller should read the usual way. */
+static int batch_take(struct batch* batch, enum batch_file file, const char** text)
+{
+	if (!batch || !batch->fresh[file])
+		return -EAGAIN;
+	batch->fresh[file] = 0;
+	if (batch->res[file] < 0)
+		return batch->res[file];
+	if (batch->res[file] == 0)
+		return -EIO;
+	*text = batch->buf[file];
+	return 0;
+}
+
+static int batch_take_longlong(struct batch* batch, enum batch_file file, long long* val)
+{
+	const char *text = NULL;
+	const int r = batch_take(batch, file, &text);
+	if (r)
+		return r;
+	char *end = NULL;
+	errno = 0;
+	*val = strtoll(text, &end, 10);
+	if (errno || end == text)
+		return -EIO;
+	return 0;
+}
+
+/* Parse whole text as integer within min and max.
+ * Returns 0 on success or -EINVAL. */
+static int parse_int(const char* text, long min, long max, int* value)
+{
+	char *end = NULL;
+	errno = 0;
+	const long v = strtol(text, &end, 10);
+	if (errno || end == text || *end || v < min || v > max)
+		return -EINVAL;
+	*value = v;
+	return 0;
+}
+
+/* Parse whole text as finite number of at least min.
+ * Returns 0 on success or -EINVAL. */
+static int parse_double(const char* text, double min, double* value)
+{
+	char *end = NULL;
+	errno = 0;
+	const double v = strtod(text, &end);
+	if (errno || end == text || *end || !isfinite(v) || v < min)
+		return -EINVAL;
+	*value = v;
+	return 0;
+}
 
 static void print_usage(void)
 {
@@ -47,16 +197,60 @@ static void print_usage(void)
 	printf("    Turn off backlight after --time inactivity\n");
 	printf("    Expects gpio edge property already is configured\n");
 	printf("    See kernel documentation Documentation/gpio/sysfs.txt\n");
+	printf("  --int-coalesce Coalesce interrupt edges within given ms into one trigger\n");
+	printf("    Default: 0, disabled\n");
+	printf("  --int-storm    Interrupt edges per second considered a storm\n");
+	printf("    Interrupt is masked for %d ms and level sampled every %d ms instead\n",
+			INTERRUPT_STORM_HOLD_MS, INTERRUPT_STORM_SAMPLE_MS);
+	printf("    Default: disabled\n");
+	printf("  --input        Input event device\n");
+	printf("    For example: /dev/input/event0\n");
+	printf("    Any input event, such as touch or key press, is a trigger\n");
+	printf("    Turn off backlight after --time inactivity\n");
 	printf("  -t, --time     Time in seconds to wait for interrupt before disabling backlight\n");
 	printf("    Default: %d\n", DEFAULT_ON_TIME_SEC);
 	printf("  -s, --sensor   Sensor input\n");
 	printf("    iio device and channel in format dev:chan\n");
 	printf("    For example: vcnl4000:illuminance\n");
 	printf("    Control backlight based on sensor input\n");
+	printf("    Repeat for up to %d sensors, readings are fused per --fusion\n", LIBBACKLIGHT_MAX_SENSORS);
 	printf("  --lmin         Lux value where backlight it set to 1\n");
 	printf("    Default: %d\n", DEFAULT_MIN_LUX);
 	printf("  --lmax         Lux value where backlight it set to max\n");
 	printf("    Default: %d\n", DEFAULT_MAX_LUX);
+	printf("  --window       Number of sensor readings averaged, max %d\n", LIBBACKLIGHT_STATE_MAX_SAMPLES);
+	printf("    Default: %d\n", LIBBACKLIGHT_DEFAULT_WINDOW);
+	printf("  --auto-range   Adapt --lmin and --lmax to percentiles of observed lux, format LOW:HIGH\n");
+	printf("    For example: 5:95\n");
+	printf("    --lmin and --lmax are used until %d readings observed, then range is updated as often\n",
+			LIBBACKLIGHT_DEFAULT_AUTO_RANGE_INTERVAL);
+	printf("  --step-ratio   Follow a jump in lux at once when reading differs from average by more than this ratio\n");
+	printf("    Sensor window is refilled with the new reading, smaller changes are averaged\n");
+	printf("    For example: 4, at least 2\n");
+	printf("    Default: 0, disabled\n");
+	printf("  --step-samples Consecutive readings beyond --step-ratio required, ignoring brief flashes\n");
+	printf("    Default: 1\n");
+	printf("  --rate         Sample sensors at given rate in Hz through iio buffer instead of reading raw\n");
+	printf("    Samples are averaged over each %d ms, rejecting 100 Hz and 120 Hz light flicker\n", SAMPLE_PERIOD_MS);
+	printf("    Requires a buffer capable sensor with trigger configured, for example: 1000\n");
+	printf("    Sensors on the same iio device share one buffer\n");
+	printf("    If sampling falls behind only the latest average is used, older ones are counted as dropped\n");
+	printf("    Default: 0, disabled\n");
+	printf("  --stale        Milliseconds last sensor readings are used while reads fail\n");
+	printf("    Failed reads are retried with backoff and buffered sampling is restarted\n");
+	printf("    After this, brightness falls back to initial step until the sensor reads again, 0 never falls back\n");
+	printf("    Default: %d\n", SENSOR_STALE_MS);
+	printf("  --fusion       How readings of multiple sensors are combined: mean, max or median\n");
+	printf("    Default: mean\n");
+	printf("  --weights      Weights of sensors for mean fusion in order given, format W1,W2,...\n");
+	printf("    Default: 1 for each sensor\n");
+	printf("  --fault-ratio  With 3 or more sensors, ignore sensors off from median by more than this ratio\n");
+	printf("    For example: 4, ignoring a covered or saturated sensor, at least 2\n");
+	printf("    Default: disabled\n");
+	printf("  --dark-freq    Sensor sampling frequency in Hz while backlight is off\n");
+	printf("    Sensor isn't read while backlight is off, allowing runtime suspend\n");
+	printf("    Optionally also lower iio sampling_frequency, restored on wake up\n");
+	printf("    Default: 0, sampling_frequency is not changed\n");
 	printf("  -p, --prox     Proximity input\n");
 	printf("    iio device and channel in format dev:chan\n");
 	printf("    For example: vcnl4000:proximity\n");
@@ -64,6 +258,56 @@ static void print_usage(void)
 	printf("    If input above iio attribute nearlevel then backlight is kept enabled\n");
 	printf("  -n, --near     Proximity near level override\n");
 	printf("    Default to 0 if no \"nearlevel\" iio attribute for proximity input channel\n");
+	printf("  -f, --far      Proximity far level\n");
+	printf("    Input must fall below this level to leave near state\n");
+	printf("    Default: same as near level\n");
+	printf("  --debounce     Proximity debounce in format N:M\n");
+	printf("    Change state when N of last M samples agree, M max 32\n");
+	printf("    Default: 1:1\n");
+	printf("  --rt-priority  Run with SCHED_FIFO at given priority (1-99)\n");
+	printf("    Reports wakeups later than %d ms past their deadline on exit\n", RT_DEADLINE_SLACK_MS);
+	printf("    With --power-save, wakeups delayed within the timer slack aren't counted\n");
+	printf("  --cpu          Pin daemon to given cpu\n");
+	printf("  --mlock        Prefault and lock all memory after initialization\n");
+	printf("  --power-save   Sample every %d ms aligned to wall clock with %lu ms timer slack\n",
+			POWER_SAVE_PERIOD_MS, POWER_SAVE_TIMER_SLACK_NS / 1000000UL);
+	printf("    Wakeups between periods only sample if triggered\n");
+	printf("    Reports wakeups per second on exit\n");
+	printf("  --status       Publish status in POSIX shared memory segment\n");
+	printf("    For example: /backlightctl\n");
+	printf("    See status.h for layout\n");
+	printf("  --config       File with settings overriding command line, one \"key value\" per line\n");
+	printf("    Keys: lmin, lmax, time, window, auto-range, step-ratio, step-samples, fusion, weights, fault-ratio\n");
+	printf("    Reloaded on SIGHUP without restart, keeping brightness, sensor readings and trigger time\n");
+	printf("  --control      Unix domain control socket, SOCK_SEQPACKET with one request per message\n");
+	printf("    For example: /run/backlightctl.sock\n");
+	printf("    Requests: query, override STEP, inhibit SECONDS, resume\n");
+	printf("    Override holds brightness, inhibit keeps backlight on, resume returns to automatic control\n");
+	printf("    Sensor readings and triggers are processed meanwhile, see control.h for replies\n");
+	printf("  --metrics      Write metrics in Prometheus text format to file\n");
+	printf("    For example: /var/lib/node_exporter/textfile/backlightctl.prom\n");
+	printf("    Written to temporary file and renamed, readers never see partial file\n");
+	printf("  --metrics-interval Seconds between metrics writes\n");
+	printf("    Default: %d\n", METRICS_INTERVAL_SEC);
+	printf("  --watts        Backlight power model in format BASE:STEP, watts while lit plus watts per step\n");
+	printf("    For example: 0.4:0.02\n");
+	printf("    Energy used and saved against max brightness is estimated, persisted with --state and --history\n");
+	printf("    Default: time at each step is accounted without energy estimate\n");
+	printf("  --uring        Batch sysfs reads each wakeup and brightness writes with io_uring\n");
+	printf("    Falls back to regular reads and writes if io_uring is unavailable\n");
+	printf("  --simulate     Run against script under virtual clock, see sim.h for format\n");
+	printf("    Devices given by options aren't opened and PATH isn't required\n");
+	printf("    Brightness writes are printed as \"time_ms brightness\", brightness restored on exit is not written\n");
+	printf("  --sim-output   Write simulated brightness writes to file instead of stdout\n");
+	printf("  --state        Keep controller state in memory mapped file\n");
+	printf("    For example: /run/backlightctl.state\n");
+	printf("    Restored on start so brightness is correct from first iteration\n");
+	printf("  --history      Keep per minute lux and brightness history in memory mapped file\n");
+	printf("    For example: /var/lib/backlightctl/history\n");
+	printf("    Ring of pages, oldest overwritten when full, print with backlighthistory\n");
+	printf("    Also keeps energy counters across reboots, stored every %d s\n", ENERGY_STORE_MS / 1000);
+	printf("  --history-pages Pages of %d bytes in ring when history file is created\n", HISTORY_PAGE_SIZE);
+	printf("    Default: %d, about five weeks, max: %d\n", HISTORY_DEFAULT_PAGES, HISTORY_MAX_PAGES);
 	printf("\n");
 
 	printf("Return values:\n");
@@ -121,30 +365,249 @@ exit:
 	return r;
 }
 
+/* One or more light sensors, read together and fused by libbacklight */
 struct sensor {
-	struct iio_channel *channel;
+	struct iio_channel *channels[LIBBACKLIGHT_MAX_SENSORS];
+	unsigned int count;
+	double dark_frequency;		// Sampling frequency while suspended, 0 to leave unchanged
+	double frequency[LIBBACKLIGHT_MAX_SENSORS];	// Sampling frequency to restore, 0 if not changed
+	double rate;				// Buffered sampling frequency in Hz, 0 to read raw attribute
+	unsigned int owner[LIBBACKLIGHT_MAX_SENSORS];	// First sensor on same iio device, its buffer is shared
+	struct iio_buffer *buffers[LIBBACKLIGHT_MAX_SENSORS];	// Set for owners while sampling buffered
+	int buffered;				// Channels enabled for buffered sampling
+	struct decimate decimators[LIBBACKLIGHT_MAX_SENSORS];
+	double filtered[LIBBACKLIGHT_MAX_SENSORS];	// Latest decimated raw value
+	int filtered_set[LIBBACKLIGHT_MAX_SENSORS];
+	unsigned long long dropped[LIBBACKLIGHT_MAX_SENSORS];	// Decimated values replaced before being read
+	int32_t *samples;			// Scratch for one channel of a buffer
+	size_t samples_len;
+	double conversion[LIBBACKLIGHT_MAX_SENSORS];	// Seconds until raw attribute has a new reading, 0 if unknown
+	int suspended;
+	unsigned long long suspends;
+	unsigned long long reads;
+	unsigned long long failures;
 };
 
+/* Add sensor device, called once per -s/--sensor */
 static int sensor_init(struct sensor* sensor, const struct iio_context* ctx, const char* device)
 {
-	if (!sensor || !ctx || !device)
+	if (!sensor || !device)
 		return -EINVAL;
-	pr_info("sensor [device:channel]: %s\n", device);
-	return init_iio_ch(&sensor->channel, ctx, device);
+	if (sensor->count >= LIBBACKLIGHT_MAX_SENSORS)
+		return -E2BIG;
+	pr_info("sensor %u [device:channel]: %s\n", sensor->count, device);
+	const int r = io->sensor_open(sensor, sensor->count, ctx, device);
+	if (r)
+		return r;
+	sensor->count++;
+	return 0;
+}
+
+/* Time for a new raw reading, integration_time if the driver has it, else one sampling period */
+static double sensor_conversion(const struct iio_channel* channel)
+{
+	const struct iio_device *dev = iio_channel_get_device(channel);
+	double v = 0.0;
+	if (iio_channel_find_attr(channel, "integration_time")
+		&& iio_channel_attr_read_double(channel, "integration_time", &v) == 0 && v > 0.0)
+		return v;
+	if (iio_device_find_attr(dev, "integration_time")
+		&& iio_device_attr_read_double(dev, "integration_time", &v) == 0 && v > 0.0)
+		return v;
+	if (iio_channel_find_attr(channel, "sampling_frequency")
+		&& iio_channel_attr_read_double(channel, "sampling_frequency", &v) == 0 && v > 0.0)
+		return 1.0 / v;
+	if (iio_device_find_attr(dev, "sampling_frequency")
+		&& iio_device_attr_read_double(dev, "sampling_frequency", &v) == 0 && v > 0.0)
+		return 1.0 / v;
+	return 0.0;
 }
 
-static int sensor_get(const struct sensor* sensor, uint32_t* lux)
+static int device_sensor_open(struct sensor* sensor, unsigned int i, const struct iio_context* ctx, const char* device)
 {
-	if (!sensor || !sensor->channel || !lux)
+	if (!ctx)
 		return -EINVAL;
+	const int r = init_iio_ch(&sensor->channels[i], ctx, device);
+	if (r)
+		return r;
+	sensor->conversion[i] = sensor_conversion(sensor->channels[i]);
+	const struct iio_device *dev = iio_channel_get_device(sensor->channels[i]);
+	sensor->owner[i] = i;
+	for (unsigned int j = 0; j < i; ++j) {
+		if (iio_channel_get_device(sensor->channels[j]) == dev) {
+			sensor->owner[i] = sensor->owner[j];
+			break;
+		}
+	}
+	return 0;
+}
 
-	long long val = 0LL;
-	const int r = iio_channel_attr_read_longlong(sensor->channel, "raw", &val);
+/* High rate sampling through iio buffer, decimated to one reading per SAMPLE_PERIOD_MS.
+ * sampling_frequency is set on channel or device if available and channel is enabled for the buffer. */
+static int sensor_channel_start(struct sensor* sensor, unsigned int i)
+{
+	struct iio_channel *channel = sensor->channels[i];
+	const struct iio_device *dev = iio_channel_get_device(channel);
+	const struct iio_data_format *fmt = iio_channel_get_data_format(channel);
+	if (fmt->length == 0 || fmt->length % 8 || fmt->length > 64)
+		return -ENOTSUP;
+	double rate = sensor->rate;
+	int r = 0;
+	if (iio_channel_find_attr(channel, "sampling_frequency")) {
+		if ((r = iio_channel_attr_write_double(channel, "sampling_frequency", rate)) < 0)
+			return r;
+		r = iio_channel_attr_read_double(channel, "sampling_frequency", &rate);
+	}
+	else
+	if (iio_device_find_attr(dev, "sampling_frequency")) {
+		if ((r = iio_device_attr_write_double(dev, "sampling_frequency", rate)) < 0)
+			return r;
+		r = iio_device_attr_read_double(dev, "sampling_frequency", &rate);
+	}
 	if (r)
-		return -r;
+		return r < 0 ? r : -r;
+
+	/* Device may round frequency, block must span whole flicker periods at actual rate */
+	if ((r = decimate_init(&sensor->decimators[i], rate, SAMPLE_PERIOD_MS)))
+		return r;
+	const size_t len = sensor->decimators[i].factor;
+	if (len > sensor->samples_len) {
+		int32_t *samples = realloc(sensor->samples, len * sizeof(int32_t));
+		if (!samples)
+			return -ENOMEM;
+		sensor->samples = samples;
+		sensor->samples_len = len;
+	}
+	iio_channel_enable(channel);
+	sensor->filtered_set[i] = 0;
+	pr_dbg("sensor %u: buffered: %.1f Hz: decimation: %" PRIu32 "\n", i, rate, sensor->decimators[i].factor);
+	return 0;
+}
+
+/* One buffer per iio device, holding one output block of its channels */
+static int sensor_buffer_create(struct sensor* sensor, unsigned int i)
+{
+	const struct iio_device *dev = iio_channel_get_device(sensor->channels[i]);
+	struct iio_buffer *buffer = iio_device_create_buffer(dev, sensor->decimators[i].factor, false);
+	if (!buffer)
+		return -errno;
+	const int r = iio_buffer_set_blocking_mode(buffer, false);
+	if (r) {
+		iio_buffer_destroy(buffer);
+		return r;
+	}
+	sensor->buffers[i] = buffer;
+	return 0;
+}
 
-	const struct iio_data_format *fmt = iio_channel_get_data_format(sensor->channel);
-	val = fmt->with_scale ? (long long) round(val * fmt->scale) : val;
+static void sensor_buffer_stop(struct sensor* sensor)
+{
+	if (!sensor->buffered)
+		return;
+	for (unsigned int i = 0; i < sensor->count; ++i) {
+		if (sensor->buffers[i]) {
+			iio_buffer_destroy(sensor->buffers[i]);
+			sensor->buffers[i] = NULL;
+		}
+		iio_channel_disable(sensor->channels[i]);
+	}
+	sensor->buffered = 0;
+}
+
+/* Converted sample of given storage size in native byte order, clamped to int32_t */
+static int32_t sample_widen(const uint8_t* native, size_t bytes, int is_signed)
+{
+	uint64_t v = 0;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	memcpy((uint8_t*) &v + sizeof(v) - bytes, native, bytes);
+#else
+	memcpy(&v, native, bytes);
+#endif
+	if (!is_signed)
+		return v > INT32_MAX ? INT32_MAX : (int32_t) v;
+	const unsigned int shift = 64 - bytes * 8;
+	const int64_t s = (int64_t) (v << shift) >> shift;
+	return s > INT32_MAX ? INT32_MAX : s < INT32_MIN ? INT32_MIN : (int32_t) s;
+}
+
+/* Demultiplex samples of channel i from buffer into scratch.
+ * Returns number of samples. */
+static size_t sensor_demux(struct sensor* sensor, unsigned int i, struct iio_buffer* buffer)
+{
+	const struct iio_channel *channel = sensor->channels[i];
+	const struct iio_data_format *fmt = iio_channel_get_data_format(channel);
+	const size_t bytes = fmt->length / 8;
+	const ptrdiff_t step = iio_buffer_step(buffer);
+	const uint8_t *end = iio_buffer_end(buffer);
+	size_t count = 0;
+	for (const uint8_t *p = iio_buffer_first(buffer, channel); p < end && count < sensor->samples_len; p += step) {
+		uint8_t native[8];
+		iio_channel_convert(channel, native, p);
+		sensor->samples[count++] = sample_widen(native, bytes, fmt->is_signed);
+	}
+	return count;
+}
+
+/* Drain completed blocks of the buffer sensor i shares with other channels of its device.
+ * Each channel in it is run through its decimator, keeping the latest value.
+ * Values replaced before read are counted as dropped, the newest reflects current light.
+ * Returns -EAGAIN if no block completed since buffer was started. */
+static int sensor_buffer_read(struct sensor* sensor, unsigned int i, long long* val)
+{
+	const unsigned int owner = sensor->owner[i];
+	unsigned int outputs[LIBBACKLIGHT_MAX_SENSORS] = {0};
+	for (;;) {
+		const ssize_t n = iio_buffer_refill(sensor->buffers[owner]);
+		if (n == -EAGAIN)
+			break;
+		if (n < 0)
+			return n;
+		for (unsigned int k = owner; k < sensor->count; ++k) {
+			if (sensor->owner[k] != owner)
+				continue;
+			const size_t count = sensor_demux(sensor, k, sensor->buffers[owner]);
+			double out = 0.0;
+			if (decimate_run(&sensor->decimators[k], sensor->samples, count, &out, 1)) {
+				sensor->filtered[k] = out;
+				sensor->filtered_set[k] = 1;
+				outputs[k]++;
+			}
+		}
+	}
+	for (unsigned int k = owner; k < sensor->count; ++k) {
+		if (outputs[k] > 1)
+			sensor->dropped[k] += outputs[k] - 1;
+	}
+	if (!sensor->filtered_set[i])
+		return -EAGAIN;
+	const struct iio_data_format *fmt = iio_channel_get_data_format(sensor->channels[i]);
+	*val = llround(sensor->filtered[i] * (fmt->with_scale ? fmt->scale : 1.0));
+	return 0;
+}
+
+static int device_sensor_read(struct sensor* sensor, unsigned int i, int raw, uint32_t* lux)
+{
+	if (!sensor->channels[i])
+		return -EINVAL;
+
+	long long val = 0LL;
+	int r = 0;
+	if (!raw && sensor->buffers[sensor->owner[i]]) {
+		r = sensor_buffer_read(sensor, i, &val);
+		TRACE2(backlightctl, sensor_read, r, val);
+		if (r)
+			return r;
+	}
+	else {
+		r = batch_take_longlong(batch, BATCH_SENSOR + i, &val);
+		if (r == -EAGAIN)
+			r = iio_channel_attr_read_longlong(sensor->channels[i], "raw", &val);
+		TRACE2(backlightctl, sensor_read, r, val);
+		if (r)
+			return r < 0 ? r : -r;
+		const struct iio_data_format *fmt = iio_channel_get_data_format(sensor->channels[i]);
+		val = fmt->with_scale ? (long long) round(val * fmt->scale) : val;
+	}
 	if (val > UINT32_MAX || val < 0)
 		return -EIO;
 
@@ -152,45 +615,222 @@ static int sensor_get(const struct sensor* sensor, uint32_t* lux)
 	return 0;
 }
 
+/* Buffered sampling of all sensors, stopped while suspended.
+ * All channels of a device are enabled before its buffer is created. */
+static int device_sensor_start(struct sensor* sensor)
+{
+	if (sensor->rate <= 0.0)
+		return 0;
+	sensor->buffered = 1;
+	int r = 0;
+	for (unsigned int i = 0; i < sensor->count && !r; ++i)
+		r = sensor_channel_start(sensor, i);
+	for (unsigned int i = 0; i < sensor->count && !r; ++i) {
+		if (sensor->owner[i] == i)
+			r = sensor_buffer_create(sensor, i);
+	}
+	if (r)
+		sensor_buffer_stop(sensor);
+	return r;
+}
+
+static void sensor_free(struct sensor* sensor)
+{
+	sensor_buffer_stop(sensor);
+	free(sensor->samples);
+	sensor->samples = NULL;
+	sensor->samples_len = 0;
+}
+
+/* Read all sensors into lux, one per sensor, from raw attribute if raw is set.
+ * A failed sensor reads LIBBACKLIGHT_LUX_INVALID, fails only if none could be read.
+ * Returns -EAGAIN if buffered sensors have no reading yet. */
+static int sensor_get(struct sensor* sensor, int raw, uint32_t* lux)
+{
+	if (!sensor || !sensor->count || !lux)
+		return -EINVAL;
+
+	int r = 0;
+	unsigned int valid = 0;
+	for (unsigned int i = 0; i < sensor->count; ++i) {
+		const int err = io->sensor_read(sensor, i, raw, &lux[i]);
+		if (err) {
+			if (sensor->count > 1 && err != -EAGAIN)
+				pr_dbg("sensor %u: failed reading [%d]: %s\n", i, -err, strerror(-err));
+			lux[i] = LIBBACKLIGHT_LUX_INVALID;
+			if (!r || r == -EAGAIN)
+				r = err;
+		}
+		else
+			valid++;
+	}
+	return valid ? 0 : r;
+}
+
+/* Stop sampling while backlight is off.
+ * Not reading lets the iio device runtime suspend, dark_frequency is applied if set.
+ * Buffered sampling is stopped, sensor is read through raw attribute until resumed. */
+static int sensor_suspend(struct sensor* sensor)
+{
+	sensor->suspended = 1;
+	sensor->suspends++;
+	return io->sensor_suspend(sensor);
+}
+
+static int sensor_resume(struct sensor* sensor)
+{
+	sensor->suspended = 0;
+	return io->sensor_resume(sensor);
+}
+
+static int device_sensor_suspend(struct sensor* sensor)
+{
+	sensor_buffer_stop(sensor);
+	if (sensor->dark_frequency <= 0.0)
+		return 0;
+
+	int r = 0;
+	for (unsigned int i = 0; i < sensor->count; ++i) {
+		struct iio_channel *channel = sensor->channels[i];
+		if (!iio_channel_find_attr(channel, "sampling_frequency")) {
+			r = -ENOTSUP;
+			continue;
+		}
+		double frequency = 0.0;
+		int err = iio_channel_attr_read_double(channel, "sampling_frequency", &frequency);
+		if (err) {
+			r = err < 0 ? err : -err;
+			continue;
+		}
+		err = iio_channel_attr_write_double(channel, "sampling_frequency", sensor->dark_frequency);
+		if (err < 0) {
+			r = err;
+			continue;
+		}
+		sensor->frequency[i] = frequency;
+	}
+	return r;
+}
+
+static int device_sensor_resume(struct sensor* sensor)
+{
+	int r = 0;
+	for (unsigned int i = 0; i < sensor->count; ++i) {
+		if (sensor->frequency[i] <= 0.0)
+			continue;
+		const int err = iio_channel_attr_write_double(sensor->channels[i], "sampling_frequency", sensor->frequency[i]);
+		sensor->frequency[i] = 0.0;
+		if (err < 0)
+			r = err;
+	}
+	const int err = device_sensor_start(sensor);
+	return err ? err : r;
+}
+
+/* Readings averaged per sensor, to seed filter at startup and after suspend.
+ * Raw attribute is read, a buffer may not have completed a block yet.
+ * Readings are a conversion apart, raw attribute repeats its value until the next one.
+ * Slow sensors get fewer readings, keeping the burst within SENSOR_BURST_MS. */
+static int sensor_burst(struct sensor* sensor, uint32_t* lux)
+{
+	double conversion = 0.0;
+	for (unsigned int i = 0; i < sensor->count; ++i)
+		conversion = sensor->conversion[i] > conversion ? sensor->conversion[i] : conversion;
+	int samples = SENSOR_BURST_SAMPLES;
+	if (conversion > 0.0 && 1.0 + SENSOR_BURST_MS / 1e3 / conversion < samples)
+		samples = 1 + (int) (SENSOR_BURST_MS / 1e3 / conversion);
+	const struct timespec interval = {0, (long) (conversion * 1e9)};
+
+	uint64_t sums[LIBBACKLIGHT_MAX_SENSORS] = {0};
+	unsigned int counts[LIBBACKLIGHT_MAX_SENSORS] = {0};
+	for (int n = 0; n < samples; ++n) {
+		if (n > 0 && conversion > 0.0)
+			nanosleep(&interval, NULL);
+		uint32_t val[LIBBACKLIGHT_MAX_SENSORS];
+		const int r = sensor_get(sensor, 1, val);
+		if (r)
+			return r;
+		for (unsigned int i = 0; i < sensor->count; ++i) {
+			if (val[i] == LIBBACKLIGHT_LUX_INVALID)
+				continue;
+			sums[i] += val[i];
+			counts[i]++;
+		}
+	}
+	for (unsigned int i = 0; i < sensor->count; ++i)
+		lux[i] = counts[i] ? sums[i] / counts[i] : LIBBACKLIGHT_LUX_INVALID;
+	return 0;
+}
+
 struct proximity {
 	struct iio_channel *channel;
-	long long nearlevel;
+	struct debounce debounce;
 };
 
 /* nearlevel will override iio provided attribute.
- * nearlevel with negative value means not set and must be provided by iio device. */
-static int proximity_init(struct proximity* proximity, const struct iio_context* ctx, const char* device, long long nearlevel)
+ * nearlevel with negative value means not set and must be provided by iio device.
+ * farlevel with negative value means same as nearlevel, i.e. no hysteresis.
+ * Input must stay below farlevel to leave near state.
+ * State changes when at least debounce_n of the last debounce_m samples agree. */
+static int proximity_init(struct proximity* proximity, const struct iio_context* ctx, const char* device,
+						long long nearlevel, long long farlevel, unsigned int debounce_n, unsigned int debounce_m)
 {
-	if (!proximity || !ctx || !device)
+	if (!proximity || !device)
 		return -EINVAL;
 	pr_info("proximity [device:channel]: %s\n", device);
 
-	int r = init_iio_ch(&proximity->channel, ctx, device);
+	int r = io->proximity_open(proximity, ctx, device, &nearlevel);
+	if (r)
+		return r;
+	r = debounce_init(&proximity->debounce, nearlevel, farlevel < 0 ? nearlevel : farlevel, debounce_n, debounce_m);
 	if (r)
 		return r;
+	pr_info("proximity nearlevel: %lld: farlevel: %lld: debounce: %u of %u\n",
+			proximity->debounce.nearlevel, proximity->debounce.farlevel, debounce_n, debounce_m);
+	return 0;
+}
 
-	proximity->nearlevel = nearlevel;
-	if (proximity->nearlevel < 0) {
+static int device_proximity_open(struct proximity* proximity, const struct iio_context* ctx, const char* device,
+									long long* nearlevel)
+{
+	if (!ctx)
+		return -EINVAL;
+	int r = init_iio_ch(&proximity->channel, ctx, device);
+	if (r)
+		return r;
+	if (*nearlevel < 0) {
 		if (iio_channel_find_attr(proximity->channel, "nearlevel") == NULL)
 			return -ENODEV;
-		r = iio_channel_attr_read_longlong(proximity->channel, "nearlevel", &proximity->nearlevel);
+		r = iio_channel_attr_read_longlong(proximity->channel, "nearlevel", nearlevel);
 		if (r)
 			return -r;
 	}
-	pr_info("proximity nearlevel: %lld\n", proximity->nearlevel);
 	return 0;
 }
 
-static int proximity_get(const struct proximity* proximity, int* trigger)
+static int device_proximity_read(struct proximity* proximity, long long* val)
 {
-	if (!proximity || !proximity->channel || !trigger)
+	if (!proximity->channel)
+		return -EINVAL;
+	int r = batch_take_longlong(batch, BATCH_PROXIMITY, val);
+	if (r == -EAGAIN)
+		r = iio_channel_attr_read_longlong(proximity->channel, "raw", val);
+	return r < 0 ? r : -r;
+}
+
+static int proximity_get(struct proximity* proximity, int* trigger)
+{
+	if (!proximity || !trigger)
 		return -EINVAL;
 
 	long long val = 0LL;
-	int r = iio_channel_attr_read_longlong(proximity->channel, "raw", &val);
-	if (r)
-		return -r;
-	*trigger = val >= proximity->nearlevel ? 1 : 0;
+	const int r = io->proximity_read(proximity, &val);
+	if (r) {
+		TRACE3(backlightctl, proximity_read, r, val, proximity->debounce.near);
+		return r;
+	}
+	*trigger = debounce_update(&proximity->debounce, val);
+	TRACE3(backlightctl, proximity_read, r, val, *trigger);
 	return 0;
 }
 
@@ -198,6 +838,7 @@ struct interrupt {
 	char* value;
 	int fd;
 	int fd_set;
+	struct edge_filter filter;
 };
 
 static void interrupt_free(struct interrupt* interrupt)
@@ -215,13 +856,20 @@ static void interrupt_free(struct interrupt* interrupt)
 	}
 }
 
-static int interrupt_init(struct interrupt* interrupt, const char* device)
+/* Edges arriving within coalesce_ms of an accepted edge don't trigger again.
+ * More than storm_edges edges within a second masks the fd for INTERRUPT_STORM_HOLD_MS,
+ * during which the level is sampled every INTERRUPT_STORM_SAMPLE_MS instead. */
+static int interrupt_init(struct interrupt* interrupt, const char* device, int coalesce_ms, int storm_edges)
 {
 	if (!interrupt || !device)
 		return -EINVAL;
 	pr_info("interrupt: device: %s\n", device);
+	if (coalesce_ms || storm_edges)
+		pr_info("interrupt: coalesce: %d ms: storm: %d edges/s\n", coalesce_ms, storm_edges);
+	int r = edge_filter_init(&interrupt->filter, coalesce_ms, storm_edges, INTERRUPT_STORM_HOLD_MS);
+	if (r)
+		return r;
 
-	int r = 0;
 	char value = 0;
 	interrupt->value = join_path(device, "value");
 	if (!interrupt->value) {
@@ -249,6 +897,28 @@ exit:
 	return r;
 }
 
+/* Open value again, replacing fd */
+static int interrupt_reopen(struct interrupt* interrupt)
+{
+	const int fd = open(interrupt->value, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	char value = 0;
+	if (read(fd, &value, 1) < 0) {
+		const int r = -errno;
+		close(fd);
+		return r;
+	}
+	if (interrupt->fd_set)
+		close(interrupt->fd);
+	interrupt->fd = fd;
+	interrupt->fd_set = 1;
+	/* Batch has old fd registered, new one is read the regular way */
+	if (batch)
+		batch->fds[BATCH_INTERRUPT] = -1;
+	return 0;
+}
+
 static int interrupt_fd(const struct interrupt* interrupt, int* fd)
 {
 	if (!interrupt)
@@ -259,10 +929,10 @@ static int interrupt_fd(const struct interrupt* interrupt, int* fd)
 	return 0;
 }
 
-static int interrupt_events(const struct interrupt* interrupt)
+static uint32_t interrupt_events(const struct interrupt* interrupt)
 {
 	(void) interrupt;
-	return POLLPRI | POLLERR;
+	return EPOLLPRI | EPOLLERR;
 }
 
 static int interrupt_get(const struct interrupt* interrupt, int* trigger)
@@ -272,11 +942,22 @@ static int interrupt_get(const struct interrupt* interrupt, int* trigger)
 	if (!interrupt->fd_set || interrupt->fd < 0)
 		return -EBADF;
 
+	const char *text = NULL;
+	const int batched = batch_take(batch, BATCH_INTERRUPT, &text);
+	if (batched != -EAGAIN) {
+		TRACE2(backlightctl, interrupt_read, batched ? batched : 1, batched ? 0 : text[0]);
+		if (batched)
+			return batched;
+		*trigger = text[0] > 0 ? 1 : 0;
+		return 0;
+	}
+
 	if (lseek(interrupt->fd, 0, SEEK_SET) != 0)
 		return -errno;
 
 	char value = 0;
 	const ssize_t r = read(interrupt->fd, &value, 1);
+	TRACE2(backlightctl, interrupt_read, r < 0 ? -errno : r, value);
 	if (r < 0)
 		return -errno;
 	if (r < 1)
@@ -286,6 +967,20 @@ static int interrupt_get(const struct interrupt* interrupt, int* trigger)
 	return 0;
 }
 
+static int input_init(struct input* input, const char* device)
+{
+	if (!input || !device)
+		return -EINVAL;
+	pr_info("input: device: %s\n", device);
+
+	const int r = input_open(input, device);
+	if (r)
+		return r;
+	if (!input->kernel_time)
+		pr_info("input: no kernel timestamps, using read time\n");
+	return 0;
+}
+
 struct backlight {
 	char *brightness;
 	char *actual_brightness;
@@ -310,7 +1005,7 @@ static void backlight_free(struct backlight* backlight)
 	}
 }
 
-static int backlight_init(struct backlight* backlight, const char* device)
+static int device_backlight_open(struct backlight* backlight, const char* device)
 {
 	if (!device)
 		return -EINVAL;
@@ -408,28 +1103,199 @@ static int write_u32(const char* path, uint32_t value)
 	return 0;
 }
 
-static int backlight_get(struct backlight* backlight, uint32_t* value)
+static int device_backlight_get(struct backlight* backlight, uint32_t* value)
 {
 	if (!backlight || !value || !backlight->actual_brightness)
 		return -EINVAL;
 	return read_u32(backlight->actual_brightness, value);
 }
 
-static int backlight_set(struct backlight* backlight, uint32_t value)
+static char* iio_attr_path(const struct iio_channel* channel, const char* attr)
+{
+	const char *file = iio_channel_attr_get_filename(channel, attr);
+	const struct iio_device *dev = iio_channel_get_device(channel);
+	if (!file || !dev)
+		return NULL;
+	char *dir = join_path(IIO_SYSFS_DIR, iio_device_get_id(dev));
+	if (!dir)
+		return NULL;
+	char *path = join_path(dir, file);
+	free(dir);
+	return path;
+}
+
+static int batch_open(struct batch* batch, enum batch_file file, const char* path, int flags)
+{
+	if (!path)
+		return -ENOMEM;
+	const int fd = open(path, flags | O_CLOEXEC);
+	if (fd < 0) {
+		const int r = -errno;
+		pr_err("%s [%d] open: %s\n", path, -r, strerror(-r));
+		return r;
+	}
+	batch->fds[file] = fd;
+	batch->owned[file] = 1;
+	return 0;
+}
+
+static void batch_free(struct batch* batch)
+{
+	uring_free(&batch->ring);
+	for (int i = 0; i < BATCH_FILES; ++i) {
+		if (batch->owned[i])
+			close(batch->fds[i]);
+		batch->fds[i] = -1;
+		batch->owned[i] = 0;
+	}
+}
+
+/* Read files in mask, a bit per enum batch_file, with one submission */
+static int batch_prefetch(struct batch* batch, unsigned int mask)
+{
+	int count = 0;
+	for (int i = 0; i < BATCH_FILES; ++i) {
+		batch->fresh[i] = 0;
+		if (!(mask & (1U << i)) || batch->fds[i] < 0)
+			continue;
+		const int r = uring_prep_read(&batch->ring, i, batch->buf[i], BATCH_BUF_SIZE - 1, 0, i);
+		if (r)
+			return r;
+		count++;
+	}
+	if (!count)
+		return 0;
+
+	struct uring_result results[BATCH_FILES];
+	const int n = uring_submit_and_wait(&batch->ring, results, BATCH_FILES);
+	if (n < 0)
+		return n;
+	for (int i = 0; i < n; ++i) {
+		const int file = results[i].user_data;
+		batch->res[file] = results[i].res;
+		if (results[i].res >= 0)
+			batch->buf[file][results[i].res] = '\0';
+		batch->fresh[file] = 1;
+	}
+	return 0;
+}
+
+/* Queue write of value, written by batch_flush() */
+static void batch_write(struct batch* batch, enum batch_file file, uint32_t value)
+{
+	batch->value[file] = value;
+	batch->queued[file] = 1;
+}
+
+/* Submit queued writes with one submission and check their completions.
+ * Returns 0 on success or negative errno of first failed write. */
+static int batch_flush(struct batch* batch)
+{
+	int count[BATCH_FILES];
+	int prepared = 0;
+	int r = 0;
+	for (int i = 0; i < BATCH_FILES; ++i) {
+		if (!batch->queued[i])
+			continue;
+		batch->queued[i] = 0;
+		count[i] = snprintf(batch->buf[i], BATCH_BUF_SIZE, "%" PRIu32 "\n", batch->value[i]);
+		r = uring_prep_write(&batch->ring, i, batch->buf[i], count[i], 0, i);
+		if (r)
+			break;
+		prepared++;
+	}
+	if (!prepared)
+		return r;
+
+	struct uring_result results[BATCH_FILES];
+	const int n = uring_submit_and_wait(&batch->ring, results, BATCH_FILES);
+	if (n < 0)
+		return n;
+	for (int i = 0; i < n && !r; ++i) {
+		const int file = results[i].user_data;
+		if (results[i].res < 0)
+			r = results[i].res;
+		else
+		if (results[i].res != count[file])
+			r = -EIO;
+	}
+	return r;
+}
+
+/* Open and register files read each wakeup and the brightness file.
+ * Fails if io_uring or its read and write operations are unavailable. */
+static int batch_init(struct batch* batch, const struct sensor* sensor, const struct proximity* proximity,
+						const struct interrupt* interrupt, const struct backlight* backlight)
+{
+	memset(batch, 0, sizeof(struct batch));
+	for (int i = 0; i < BATCH_FILES; ++i)
+		batch->fds[i] = -1;
+	int r = uring_init(&batch->ring, BATCH_FILES * 2);
+	if (r)
+		return r;
+
+	/* Buffered sensors are started after init, they are not read through raw attribute */
+	for (unsigned int i = 0; sensor->rate <= 0.0 && i < sensor->count; ++i) {
+		if ((r = batch_open(batch, BATCH_SENSOR + i, iio_attr_path(sensor->channels[i], "raw"), O_RDONLY)))
+			goto exit;
+	}
+	if (proximity->channel && (r = batch_open(batch, BATCH_PROXIMITY, iio_attr_path(proximity->channel, "raw"), O_RDONLY)))
+		goto exit;
+	if (interrupt->fd_set)
+		batch->fds[BATCH_INTERRUPT] = interrupt->fd;
+	if ((r = batch_open(batch, BATCH_BRIGHTNESS, backlight->brightness, O_WRONLY)))
+		goto exit;
+	if ((r = uring_register_files(&batch->ring, batch->fds, BATCH_FILES)))
+		goto exit;
+
+	/* Older kernels fail read operations with -EINVAL */
+	if ((r = batch_prefetch(batch, BATCH_SENSOR_MASK | (1U << BATCH_PROXIMITY))))
+		goto exit;
+	for (int i = 0; i < BATCH_FILES; ++i) {
+		if (batch->fresh[i] && batch->res[i] == -EINVAL)
+			r = -EOPNOTSUPP;
+		batch->fresh[i] = 0;
+	}
+exit:
+	if (r)
+		batch_free(batch);
+	return r;
+}
+
+static int device_backlight_set(struct backlight* backlight, uint32_t value)
 {
 	if (!backlight || !backlight->brightness)
 		return -EINVAL;
-	return write_u32(backlight->brightness, value);
+	if (batch) {
+		batch_write(batch, BATCH_BRIGHTNESS, value);
+		TRACE2(backlightctl, backlight_set, value, 0);
+		return 0;
+	}
+	const int r = write_u32(backlight->brightness, value);
+	TRACE2(backlightctl, backlight_set, value, r);
+	return r;
+}
+
+/* Complete writes queued by device_backlight_set() */
+static int backlight_flush(void)
+{
+	return batch ? batch_flush(batch) : 0;
+}
+
+static int device_backlight_restore(struct backlight* backlight, uint32_t value)
+{
+	const int r = device_backlight_set(backlight, value);
+	return r ? r : backlight_flush();
 }
 
-static int backlight_max(struct backlight* backlight, uint32_t* value)
+static int device_backlight_max(struct backlight* backlight, uint32_t* value)
 {
 	if (!backlight || !value || !backlight->max_brightness)
 		return -EINVAL;
 	return read_u32(backlight->max_brightness, value);
 }
 
-static int timestamp(struct timespec* ts)
+static int device_now(struct timespec* ts)
 {
 	if (clock_gettime(CLOCK_MONOTONIC, ts)) {
 		pr_err("Failed getting CLOCK_MONOTONIC [%d]: %s\n", errno, strerror(errno));
@@ -438,20 +1304,596 @@ static int timestamp(struct timespec* ts)
 	return 0;
 }
 
-/* Used for array indexing, be careful */
-enum FDS {
-	FDS_SIGNAL = 0,
-	FDS_INTERRUPT,
-	FDS_LENGTH, /* Number of array entries */
-};
+/* Return ts1 - ts2 in milliseconds */
+static long long timespec_diff_ms(const struct timespec* ts1, const struct timespec* ts2)
+{
+	return (ts1->tv_sec - ts2->tv_sec) * 1000LL + (ts1->tv_nsec - ts2->tv_nsec) / 1000000LL;
+}
 
-int main(int argc, char** argv)
+/* Wall time since process start in milliseconds, on the real clock also when simulating */
+static double startup_ms(const struct timespec* since)
 {
-	char *backlight_device = NULL;
-	char *sensor_device = NULL;
-	char *proximity_device = NULL;
-	long long proximity_nearlevel = -1;
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0.0;
+	return (ts.tv_sec - since->tv_sec) * 1e3 + (ts.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+/* Coarse wall clock, read from vDSO without a system call */
+static int device_wall(struct timespec* ts)
+{
+	if (clock_gettime(CLOCK_REALTIME_COARSE, ts)) {
+		const int r = -errno;
+		pr_err("Failed getting CLOCK_REALTIME_COARSE [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	return 0;
+}
+
+/* Time until next multiple of period_ms on the wall clock.
+ * Coarse clock is sufficient and lets wakeups coalesce with other timers aligned the same way. */
+static int aligned_timeout_ms(int period_ms, int* timeout_ms)
+{
+	struct timespec ts;
+	const int r = io->wall(&ts);
+	if (r)
+		return r;
+	const long long ms = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+	*timeout_ms = period_ms - (int) (ms % period_ms);
+	return 0;
+}
+
+/* Touch stack pages so they are resident before locking */
+static void prefault_stack(void)
+{
+	volatile unsigned char stack[RT_PREFAULT_STACK_SIZE];
+	for (size_t i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/* priority < 1 leaves scheduling policy, cpu < 0 leaves affinity untouched. */
+static int realtime_init(int priority, int cpu, int lock)
+{
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+			const int r = -errno;
+			pr_err("Failed setting cpu affinity [%d]: %s\n", -r, strerror(-r));
+			return r;
+		}
+		pr_info("realtime: cpu: %d\n", cpu);
+	}
+	if (lock) {
+		prefault_stack();
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			const int r = -errno;
+			pr_err("Failed locking memory [%d]: %s\n", -r, strerror(-r));
+			return r;
+		}
+		pr_info("realtime: memory locked\n");
+	}
+	if (priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+		if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+			const int r = -errno;
+			pr_err("Failed setting SCHED_FIFO [%d]: %s\n", -r, strerror(-r));
+			return r;
+		}
+		pr_info("realtime: SCHED_FIFO priority: %d\n", priority);
+	}
+	return 0;
+}
+
+static int sensor_source_sample(struct source* source, struct source_sample* sample)
+{
+	struct sensor *sensor = source->priv;
+	const int r = sensor_get(sensor, 0, sample->lux);
+	if (r == -EAGAIN)
+		return 0;
+	sensor->reads++;
+	if (r) {
+		sensor->failures++;
+		pr_err("sensor: failed reading [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	sample->lux_set = 1;
+	return 0;
+}
+
+static int proximity_source_sample(struct source* source, struct source_sample* sample)
+{
+	int trigger = 0;
+	const int r = proximity_get(source->priv, &trigger);
+	if (r) {
+		pr_err("proximity: failed reading [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	if (trigger)
+		pr_dbg("proximity: yes\n");
+	sample->trigger |= trigger;
+	return 0;
+}
+
+static int interrupt_source_ready(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	if ((events & (EPOLLPRI | EPOLLERR)) == 0)
+		return 0;
+	struct interrupt *interrupt = source->priv;
+	int trigger = 0;
+	int r = interrupt_get(interrupt, &trigger);
+	if (r) {
+		pr_err("interrupt: failed reading [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	struct timespec now = {0,0};
+	if (edge_filter_timed(&interrupt->filter)) {
+		r = io->now(&now);
+		if (r)
+			return r;
+	}
+
+	switch (edge_filter_add(&interrupt->filter, &now)) {
+	case EDGE_COALESCED:
+		return 0;
+	case EDGE_STORM:
+		pr_info("interrupt: storm, masking for %d ms\n", INTERRUPT_STORM_HOLD_MS);
+		r = source_set_masked(source->reg, source, 1);
+		if (!r)
+			r = source_set_interval(source->reg, source, INTERRUPT_STORM_SAMPLE_MS, &now);
+		if (r) {
+			pr_err("interrupt: failed masking [%d]: %s\n", -r, strerror(-r));
+			return r;
+		}
+		break;
+	case EDGE_ACCEPTED:
+		break;
+	}
+
+	if (trigger)
+		pr_dbg("interrupt: yes\n");
+	sample->trigger |= trigger;
+	return 0;
+}
+
+/* Sample level while masked due to storm */
+static int interrupt_source_sample(struct source* source, struct source_sample* sample)
+{
+	struct interrupt *interrupt = source->priv;
+	int trigger = 0;
+	int r = interrupt_get(interrupt, &trigger);
+	if (r) {
+		pr_err("interrupt: failed reading [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	if (trigger)
+		pr_dbg("interrupt: level yes\n");
+	sample->trigger |= trigger;
+
+	struct timespec now;
+	r = io->now(&now);
+	if (r)
+		return r;
+	if (edge_filter_storm_over(&interrupt->filter, &now)) {
+		pr_info("interrupt: storm over, unmasking\n");
+		r = source_set_interval(source->reg, source, 0, &now);
+		if (r)
+			return r;
+		r = source_set_masked(source->reg, source, 0);
+		if (r) {
+			/* No longer sampled, fault it so it is reopened and polled after backoff */
+			pr_err("interrupt: failed unmasking [%d]: %s\n", -r, strerror(-r));
+			return source_fault(source->reg, source, &now);
+		}
+	}
+	return 0;
+}
+
+static int input_source_ready(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	(void) events;
+	const struct input *input = source->priv;
+	int trigger = 0;
+	struct timespec ts = {0,0};
+	const int r = input_get(input, &trigger, &ts);
+	if (r) {
+		pr_err("input: failed reading [%d]: %s\n", -r, strerror(-r));
+		return r;
+	}
+	if (!trigger)
+		return 0;
+	pr_dbg("input: yes\n");
+	/* Without kernel timestamps the event is considered to happen now */
+	if (!input->kernel_time) {
+		sample->trigger = 1;
+	}
+	else
+	if (!sample->trigger_ts_set || timespec_diff_ms(&ts, &sample->trigger_ts) >= 0) {
+		sample->trigger_ts = ts;
+		sample->trigger_ts_set = 1;
+	}
+	return 0;
+}
+
+/* Buffered sampling may be left in error state, restart it */
+static int sensor_source_recover(struct source* source)
+{
+	struct sensor *sensor = source->priv;
+	if (sensor->suspended)
+		return 0;
+	sensor_buffer_stop(sensor);
+	return io->sensor_start(sensor);
+}
+
+static int interrupt_source_recover(struct source* source)
+{
+	struct interrupt *interrupt = source->priv;
+	const int r = interrupt_reopen(interrupt);
+	if (r)
+		return r;
+	source->fd = interrupt->fd;
+	pr_info("interrupt: reopened\n");
+	return 0;
+}
+
+static int input_source_recover(struct source* source)
+{
+	struct input *input = source->priv;
+	const int r = input_open(input, input->device);
+	if (r)
+		return r;
+	source->fd = input->fd;
+	pr_info("input: reopened\n");
+	return 0;
+}
+
+static int signal_source_ready(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	(void) events;
+	struct signalfd_siginfo info;
+	if (read(source->fd, &info, sizeof(info)) != sizeof(info))
+		return -errno;
+	pr_info("signal: %s\n", strsignal(info.ssi_signo));
+	if (info.ssi_signo == SIGHUP)
+		sample->reload = 1;
+	else
+		sample->quit = 1;
+	return 0;
+}
+
+/* Control socket requests are applied to the controller as they arrive */
+struct control_target {
+	struct control control;
+	struct libbacklight_ctrl *bctl;
+};
+
+static int control_handle(void* priv, const struct control_request* request, char* reply, size_t len)
+{
+	struct control_target *target = priv;
+	struct libbacklight_ctrl *bctl = target->bctl;
+	const struct libbacklight_conf *conf = libbacklight_get_conf(bctl);
+	struct timespec now;
+	int r = io->now(&now);
+	if (r)
+		return r;
+
+	switch (request->command) {
+	case CONTROL_QUERY:
+		break;
+	case CONTROL_OVERRIDE:
+		r = libbacklight_override(bctl, request->value);
+		break;
+	case CONTROL_INHIBIT:
+		if (!conf->enable_trigger) {
+			r = -EOPNOTSUPP;
+		}
+		else {
+			const struct timespec duration = {request->value, 0};
+			libbacklight_inhibit(bctl, &now, &duration);
+		}
+		break;
+	case CONTROL_RESUME:
+		libbacklight_resume(bctl, &now);
+		break;
+	}
+	if (r)
+		return r;
+	pr_dbg("control: request %d: %" PRIu32 ": brightness: %" PRIu32 "\n",
+			request->command, request->value, libbacklight_brightness(bctl));
+
+	const struct timespec left = libbacklight_timeout_remaining(bctl, &now);
+	snprintf(reply, len, "ok brightness %" PRIu32 " lux %" PRIu32 " overridden %d timeout_ms %lld",
+			libbacklight_brightness(bctl), libbacklight_lux(bctl), libbacklight_overridden(bctl),
+			conf->enable_trigger ? left.tv_sec * 1000LL + left.tv_nsec / 1000000LL : -1LL);
+	return 0;
+}
+
+static int control_source_ready(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	(void) events;
+	struct control_target *target = source->priv;
+	const uint32_t before = libbacklight_brightness(target->bctl);
+	const int r = control_dispatch(&target->control, control_handle, target);
+	if (r < 0)
+		return r;
+	if (libbacklight_brightness(target->bctl) != before)
+		sample->brightness_changed = 1;
+	return 0;
+}
+
+/* Settings from command line overridden by config file, fields decided at start up kept from running controller.
+ * Running controller is left as is if file or resulting configuration is invalid. */
+static int config_reload(struct libbacklight_ctrl* bctl, const struct libbacklight_conf* base, const char* path)
+{
+	const struct libbacklight_conf *current = libbacklight_get_conf(bctl);
+	struct libbacklight_conf conf = *base;
+	conf.max_brightness_step = current->max_brightness_step;
+	conf.initial_brightness_step = current->initial_brightness_step;
+	conf.enable_sensor = current->enable_sensor;
+	conf.enable_trigger = current->enable_trigger;
+	conf.sensors = current->sensors;
+
+	unsigned int line = 0;
+	const int r = config_load(path, &conf, &line);
+	if (r == -EINVAL)
+		pr_err("config: %s: invalid line %u\n", path, line);
+	if (r)
+		return r;
+	return libbacklight_reconfigure(bctl, &conf);
+}
+
+static void metrics_fill(struct metrics_values* values, unsigned long long wakeups, const struct sensor* sensor,
+							const struct libbacklight_ctrl* bctl, const struct energy* energy,
+							const struct source_registry* sources)
+{
+	values->energy = &energy->counters;
+	values->source_errors = 0;
+	values->source_recoveries = 0;
+	for (size_t i = 0; i < sources->count; ++i) {
+		values->source_errors += sources->sources[i]->errors;
+		values->source_recoveries += sources->sources[i]->recoveries;
+	}
+	values->wakeups = wakeups;
+	values->sensor_reads = sensor->reads;
+	values->sensor_failures = sensor->failures;
+	values->brightness_step = libbacklight_brightness(bctl);
+	values->max_brightness_step = libbacklight_get_conf(bctl)->max_brightness_step;
+	values->filtered_lux = libbacklight_lux(bctl);
+}
+
+/* First valid sensor reading of sample as raw lux, failed sensors are skipped.
+ * Returns 0 if there is none. */
+static int sample_raw_lux(const struct source_sample* sample, unsigned int sensors, uint32_t* lux)
+{
+	if (!sample->lux_set)
+		return 0;
+	for (unsigned int i = 0; i < sensors; ++i) {
+		if (sample->lux[i] != LIBBACKLIGHT_LUX_INVALID) {
+			*lux = sample->lux[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Periodic source will be sampled by source_sample_due() */
+static int sample_pending(const struct source* source, const struct timespec* now, int all)
+{
+	return source->registered && source->interval_ms > 0 && (all || source_due(source, now));
+}
+
+static const struct io_ops device_io = {
+	.now = device_now,
+	.wall = device_wall,
+	.wait = source_wait,
+	.sensor_open = device_sensor_open,
+	.sensor_read = device_sensor_read,
+	.sensor_start = device_sensor_start,
+	.sensor_suspend = device_sensor_suspend,
+	.sensor_resume = device_sensor_resume,
+	.proximity_open = device_proximity_open,
+	.proximity_read = device_proximity_read,
+	.backlight_open = device_backlight_open,
+	.backlight_get = device_backlight_get,
+	.backlight_max = device_backlight_max,
+	.backlight_set = device_backlight_set,
+	.backlight_restore = device_backlight_restore,
+};
+
+/* Loaded by --simulate, only accessed through sim_io */
+static struct sim sim;
+
+/* Both clocks are the virtual clock */
+static int sim_clock(struct timespec* ts)
+{
+	sim_now(&sim, ts);
+	return 0;
+}
+
+/* Handle ready real sources, such as signals, without blocking and advance virtual clock.
+ * Scripted triggers are reported as a trigger from a ready source. */
+static int sim_wait(struct source_registry* reg, int timeout_ms, struct source_sample* sample)
+{
+	const int ready = source_wait(reg, 0, sample);
+	if (ready < 0 || sample->quit)
+		return ready;
+	const int triggers = sim_advance(&sim, timeout_ms);
+	if (triggers == -ECANCELED) {
+		pr_info("simulate: ended at %" PRIu64 " ms: writes: %llu\n", sim.now_ms, sim.writes);
+		sample->quit = 1;
+		return ready;
+	}
+	if (triggers > 0) {
+		pr_dbg("simulate: trigger\n");
+		sample->trigger = 1;
+	}
+	return ready + triggers;
+}
+
+static int sim_sensor_open(struct sensor* sensor, unsigned int i, const struct iio_context* ctx, const char* device)
+{
+	(void) sensor;
+	(void) i;
+	(void) ctx;
+	(void) device;
+	return 0;
+}
+
+/* Virtual time buffered sampling started, a first block takes SAMPLE_PERIOD_MS like on a device */
+static uint64_t sim_buffer_ms;
+static int sim_buffered;
+
+/* All sensors read the scripted lux */
+static int sim_sensor_read(struct sensor* sensor, unsigned int i, int raw, uint32_t* lux)
+{
+	(void) sensor;
+	(void) i;
+	if (!raw && sim_buffered && sim.now_ms - sim_buffer_ms < SAMPLE_PERIOD_MS)
+		return -EAGAIN;
+	*lux = sim.lux;
+	TRACE2(backlightctl, sensor_read, 0, *lux);
+	return 0;
+}
+
+static int sim_sensor_start(struct sensor* sensor)
+{
+	sim_buffered = sensor->rate > 0.0;
+	sim_buffer_ms = sim.now_ms;
+	return 0;
+}
+
+static int sim_sensor_suspend(struct sensor* sensor)
+{
+	(void) sensor;
+	sim_buffered = 0;
+	return 0;
+}
+
+/* No device to provide nearlevel, it must be given */
+static int sim_proximity_open(struct proximity* proximity, const struct iio_context* ctx, const char* device,
+								long long* nearlevel)
+{
+	(void) proximity;
+	(void) ctx;
+	(void) device;
+	return *nearlevel < 0 ? -EINVAL : 0;
+}
+
+static int sim_proximity_read(struct proximity* proximity, long long* val)
+{
+	(void) proximity;
+	*val = sim.proximity;
+	return 0;
+}
+
+static int sim_backlight_open(struct backlight* backlight, const char* device)
+{
+	(void) backlight;
+	(void) device;
+	pr_info("backlight: simulated\n");
+	return 0;
+}
+
+static int sim_backlight_get(struct backlight* backlight, uint32_t* value)
+{
+	(void) backlight;
+	*value = sim.brightness;
+	return 0;
+}
+
+static int sim_backlight_max(struct backlight* backlight, uint32_t* value)
+{
+	(void) backlight;
+	*value = sim.max_brightness;
+	return 0;
+}
+
+/* Decisions are recorded to the simulation output */
+static int sim_backlight_set(struct backlight* backlight, uint32_t value)
+{
+	(void) backlight;
+	sim_write(&sim, value);
+	TRACE2(backlightctl, backlight_set, value, 0);
+	return 0;
+}
+
+/* Not a decision, left out of the output */
+static int sim_backlight_restore(struct backlight* backlight, uint32_t value)
+{
+	(void) backlight;
+	(void) value;
+	return 0;
+}
+
+static const struct io_ops sim_io = {
+	.now = sim_clock,
+	.wall = sim_clock,
+	.wait = sim_wait,
+	.sensor_open = sim_sensor_open,
+	.sensor_read = sim_sensor_read,
+	.sensor_start = sim_sensor_start,
+	.sensor_suspend = sim_sensor_suspend,
+	.sensor_resume = sim_sensor_start,
+	.proximity_open = sim_proximity_open,
+	.proximity_read = sim_proximity_read,
+	.backlight_open = sim_backlight_open,
+	.backlight_get = sim_backlight_get,
+	.backlight_max = sim_backlight_max,
+	.backlight_set = sim_backlight_set,
+	.backlight_restore = sim_backlight_restore,
+};
+
+/* Time in ms until trigger timeout, -1 if no timeout pending */
+static int trigger_timeout_ms(const struct libbacklight_ctrl* bctl, const struct timespec* now)
+{
+	if (!libbacklight_get_conf(bctl)->enable_trigger || libbacklight_brightness(bctl) == 0
+		|| libbacklight_overridden(bctl))
+		return -1;
+	const struct timespec left = libbacklight_timeout_remaining(bctl, now);
+	/* Round up, waking early would only spin */
+	return left.tv_sec * 1000 + (left.tv_nsec + 999999L) / 1000000L;
+}
+
+int main(int argc, char** argv)
+{
+	/* Reference for time to first brightness decision */
+	struct timespec main_ts = {0,0};
+	clock_gettime(CLOCK_MONOTONIC, &main_ts);
+	char *backlight_device = NULL;
+	char *sensor_devices[LIBBACKLIGHT_MAX_SENSORS];
+	unsigned int sensor_count = 0;
+	double sensor_dark_frequency = 0.0;
+	double sensor_rate = 0.0;
+	int sensor_stale_ms = SENSOR_STALE_MS;
+	char *proximity_device = NULL;
+	long long proximity_nearlevel = -1;
+	long long proximity_farlevel = -1;
+	unsigned int proximity_debounce_n = 1;
+	unsigned int proximity_debounce_m = 1;
+	int rt_priority = 0;
+	int rt_cpu = -1;
+	int rt_mlock = 0;
+	int power_save = 0;
+	int use_uring = 0;
+	char *metrics_path = NULL;
+	char *config_path = NULL;
+	char *control_path = NULL;
+	double base_watts = 0.0;
+	double step_watts = 0.0;
+	int metrics_interval_sec = METRICS_INTERVAL_SEC;
+	char *status_name = NULL;
+	char *state_path = NULL;
+	char *history_path = NULL;
+	int history_pages = HISTORY_DEFAULT_PAGES;
+	char *sim_script = NULL;
+	char *sim_output = NULL;
 	char *interrupt_device = NULL;
+	int interrupt_coalesce_ms = 0;
+	int interrupt_storm_edges = 0;
+	char *input_device = NULL;
 	struct libbacklight_conf conf;
 	memset(&conf, 0, sizeof(conf));
 	conf.trigger_timeout.tv_sec = DEFAULT_ON_TIME_SEC;
@@ -468,60 +1910,319 @@ int main(int argc, char** argv)
 			enable_debug();
 		}
 		else
-		if (!strcmp("--int", argv[i]) || !strcmp("-i", argv[i])) {
+		if (!strcmp("--int", argv[i]) || !strcmp("-i", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid -i/--int\n");
+				return 1;
+			}
+			interrupt_device = argv[i];
+		}
+		else
+		if (!strcmp("--int-coalesce", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &interrupt_coalesce_ms)) {
+				fprintf(stderr, "invalid --int-coalesce\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--int-storm", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 1, INT_MAX, &interrupt_storm_edges)) {
+				fprintf(stderr, "invalid --int-storm\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--input", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid --input\n");
+				return 1;
+			}
+			input_device = argv[i];
+		}
+		else
+		if (!strcmp("--sensor", argv[i]) || !strcmp("-s", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid -s/--sensor\n");
+				return 1;
+			}
+			if (sensor_count >= LIBBACKLIGHT_MAX_SENSORS) {
+				fprintf(stderr, "too many -s/--sensor, max %d\n", LIBBACKLIGHT_MAX_SENSORS);
+				return 1;
+			}
+			sensor_devices[sensor_count++] = argv[i];
+		}
+		else
+		if (!strcmp("--lmin", argv[i])) {
+			int lux = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &lux)) {
+				fprintf(stderr, "invalid --lmin\n");
+				return 1;
+			}
+			conf.min_lux = lux;
+		}
+		else
+		if (!strcmp("--lmax", argv[i])) {
+			int lux = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &lux)) {
+				fprintf(stderr, "invalid --lmax\n");
+				return 1;
+			}
+			conf.max_lux = lux;
+		}
+		else
+		if (!strcmp("--window", argv[i])) {
+			int window = 0;
+			if (++i >= argc || parse_int(argv[i], 1, LIBBACKLIGHT_STATE_MAX_SAMPLES, &window)) {
+				fprintf(stderr, "invalid --window\n");
+				return 1;
+			}
+			conf.sensor_window = window;
+		}
+		else
+		if (!strcmp("--step-ratio", argv[i])) {
+			int ratio = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &ratio) || ratio == 1) {
+				fprintf(stderr, "invalid --step-ratio\n");
+				return 1;
+			}
+			conf.step_ratio = ratio;
+		}
+		else
+		if (!strcmp("--step-samples", argv[i])) {
+			int samples = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &samples)) {
+				fprintf(stderr, "invalid --step-samples\n");
+				return 1;
+			}
+			conf.step_samples = samples;
+		}
+		else
+		if (!strcmp("--auto-range", argv[i])) {
+			if (++i >= argc || sscanf(argv[i], "%u:%u", &conf.auto_min_percentile, &conf.auto_max_percentile) != 2) {
+				fprintf(stderr, "invalid --auto-range\n");
+				return 1;
+			}
+			conf.enable_auto_range = 1;
+		}
+		else
+		if (!strcmp("--dark-freq", argv[i])) {
+			if (++i >= argc || parse_double(argv[i], 0.0, &sensor_dark_frequency)) {
+				fprintf(stderr, "invalid --dark-freq\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--rate", argv[i])) {
+			if (++i >= argc || parse_double(argv[i], 0.0, &sensor_rate) || sensor_rate == 0.0) {
+				fprintf(stderr, "invalid --rate\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--stale", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &sensor_stale_ms)) {
+				fprintf(stderr, "invalid --stale\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--fusion", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid --fusion\n");
+				return 1;
+			}
+			if (!strcmp("mean", argv[i]))
+				conf.fusion = LIBBACKLIGHT_FUSION_MEAN;
+			else
+			if (!strcmp("max", argv[i]))
+				conf.fusion = LIBBACKLIGHT_FUSION_MAX;
+			else
+			if (!strcmp("median", argv[i]))
+				conf.fusion = LIBBACKLIGHT_FUSION_MEDIAN;
+			else {
+				fprintf(stderr, "invalid --fusion\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--weights", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid --weights\n");
+				return 1;
+			}
+			char *weight = argv[i];
+			for (int n = 0; n < LIBBACKLIGHT_MAX_SENSORS && *weight; ++n) {
+				char *end = NULL;
+				conf.sensor_weight[n] = strtoul(weight, &end, 10);
+				if (end == weight || (*end && *end != ',')) {
+					fprintf(stderr, "invalid --weights\n");
+					return 1;
+				}
+				weight = *end ? end + 1 : end;
+			}
+		}
+		else
+		if (!strcmp("--fault-ratio", argv[i])) {
+			int ratio = 0;
+			if (++i >= argc || parse_int(argv[i], 2, INT_MAX, &ratio)) {
+				fprintf(stderr, "invalid --fault-ratio\n");
+				return 1;
+			}
+			conf.fault_ratio = ratio;
+		}
+		else
+		if (!strcmp("--prox", argv[i]) || !strcmp("-p", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid -p/--prox\n");
+				return 1;
+			}
+			proximity_device = argv[i];
+		}
+		else
+		if (!strcmp("--near", argv[i]) || !strcmp("-n", argv[i])) {
+			int level = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &level)) {
+				fprintf(stderr, "invalid -n/--near\n");
+				return 1;
+			}
+			proximity_nearlevel = level;
+		}
+		else
+		if (!strcmp("--far", argv[i]) || !strcmp("-f", argv[i])) {
+			int level = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &level)) {
+				fprintf(stderr, "invalid -f/--far\n");
+				return 1;
+			}
+			proximity_farlevel = level;
+		}
+		else
+		if (!strcmp("--debounce", argv[i])) {
+			if (++i >= argc || sscanf(argv[i], "%u:%u", &proximity_debounce_n, &proximity_debounce_m) != 2) {
+				fprintf(stderr, "invalid --debounce\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--rt-priority", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO), &rt_priority)) {
+				fprintf(stderr, "invalid --rt-priority\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--cpu", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 0, CPU_SETSIZE - 1, &rt_cpu)) {
+				fprintf(stderr, "invalid --cpu\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--mlock", argv[i])) {
+			rt_mlock = 1;
+		}
+		else
+		if (!strcmp("--power-save", argv[i])) {
+			power_save = 1;
+		}
+		else
+		if (!strcmp("--config", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid -i/--int\n");
+				fprintf(stderr, "invalid --config\n");
 				return 1;
 			}
-			interrupt_device = argv[i];
+			config_path = argv[i];
 		}
 		else
-		if (!strcmp("--sensor", argv[i]) || !strcmp("-s", argv[i])) {
+		if (!strcmp("--control", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid -s/--sensor\n");
+				fprintf(stderr, "invalid --control\n");
 				return 1;
 			}
-			sensor_device = argv[i];
+			control_path = argv[i];
 		}
 		else
-		if (!strcmp("--lmin", argv[i])) {
+		if (!strcmp("--metrics", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid --lmin\n");
+				fprintf(stderr, "invalid --metrics\n");
 				return 1;
 			}
-			conf.min_lux = atoi(argv[i]);
+			metrics_path = argv[i];
 		}
 		else
-		if (!strcmp("--lmax", argv[i])) {
+		if (!strcmp("--metrics-interval", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 1, INT_MAX, &metrics_interval_sec)) {
+				fprintf(stderr, "invalid --metrics-interval\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--watts", argv[i])) {
+			if (++i >= argc || sscanf(argv[i], "%lf:%lf", &base_watts, &step_watts) != 2
+				|| base_watts < 0.0 || step_watts < 0.0) {
+				fprintf(stderr, "invalid --watts\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--uring", argv[i])) {
+			use_uring = 1;
+		}
+		else
+		if (!strcmp("--simulate", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid --lmax\n");
+				fprintf(stderr, "invalid --simulate\n");
 				return 1;
 			}
-			conf.max_lux = atoi(argv[i]);
+			sim_script = argv[i];
 		}
 		else
-		if (!strcmp("--prox", argv[i]) || !strcmp("-p", argv[i])) {
+		if (!strcmp("--sim-output", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid -p/--prox\n");
+				fprintf(stderr, "invalid --sim-output\n");
 				return 1;
 			}
-			proximity_device = argv[i];
+			sim_output = argv[i];
 		}
 		else
-		if (!strcmp("--near", argv[i]) || !strcmp("-n", argv[i])) {
+		if (!strcmp("--state", argv[i])) {
 			if (++i >= argc) {
-				fprintf(stderr, "invalid -n/--near\n");
+				fprintf(stderr, "invalid --state\n");
 				return 1;
 			}
-			proximity_nearlevel = atoi(argv[i]);
+			state_path = argv[i];
 		}
 		else
-		if (!strcmp("--time", argv[i]) || !strcmp("-t", argv[i])) {
+		if (!strcmp("--history", argv[i])) {
+			if (++i >= argc) {
+				fprintf(stderr, "invalid --history\n");
+				return 1;
+			}
+			history_path = argv[i];
+		}
+		else
+		if (!strcmp("--history-pages", argv[i])) {
+			if (++i >= argc || parse_int(argv[i], 1, HISTORY_MAX_PAGES, &history_pages)) {
+				fprintf(stderr, "invalid --history-pages\n");
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--status", argv[i])) {
 			if (++i >= argc) {
+				fprintf(stderr, "invalid --status\n");
+				return 1;
+			}
+			status_name = argv[i];
+		}
+		else
+		if (!strcmp("--time", argv[i]) || !strcmp("-t", argv[i])) {
+			int timeout = 0;
+			if (++i >= argc || parse_int(argv[i], 0, INT_MAX, &timeout)) {
 				fprintf(stderr, "invalid -t/--time\n");
 				return 1;
 			}
-			conf.trigger_timeout.tv_sec = atoi(argv[i]);
+			conf.trigger_timeout.tv_sec = timeout;
 		}
 		else
 		if (!strcmp("--help", argv[i]) || !strcmp("-h", argv[i])) {
@@ -544,78 +2245,156 @@ int main(int argc, char** argv)
 		}
 	}
 
-	if (!backlight_device) {
+	io = &device_io;
+	if (sim_script) {
+		FILE *out = stdout;
+		if (sim_output && (out = fopen(sim_output, "w")) == NULL) {
+			pr_err("Failed opening %s: %s\n", sim_output, strerror(errno));
+			return 1;
+		}
+		const int r = sim_load(&sim, sim_script, out);
+		if (r) {
+			pr_err("Failed loading simulation %s [%d]: %s\n", sim_script, -r, strerror(-r));
+			return 1;
+		}
+		io = &sim_io;
+		pr_info("simulate: %s: %zu events\n", sim_script, sim.count);
+	}
+
+	if (!backlight_device && !sim_script) {
 		pr_err("mandatory argument PATH missing\n");
 		return 1;
 	}
-	if (!interrupt_device && !sensor_device && !proximity_device) {
-		pr_err("Control source missing (interrupt/sensor/proxmitity) -- see help\n");
+	if (!interrupt_device && !sensor_count && !proximity_device && !input_device) {
+		pr_err("Control source missing (interrupt/sensor/proxmitity/input) -- see help\n");
 		return 1;
 	}
 
+	/* Base for reload, file settings override command line */
+	const struct libbacklight_conf args_conf = conf;
+	if (config_path) {
+		unsigned int line = 0;
+		const int err = config_load(config_path, &conf, &line);
+		if (err) {
+			if (err == -EINVAL) {
+				pr_err("config: %s: invalid line %u\n", config_path, line);
+			}
+			else {
+				pr_err("Failed loading config %s [%d]: %s\n", config_path, -err, strerror(-err));
+			}
+			return 1;
+		}
+		pr_info("config: %s\n", config_path);
+	}
+
 	struct iio_context *ctx = NULL;
+	struct iio_scan scan;
+	memset(&scan, 0, sizeof(scan));
 	struct libbacklight_ctrl *bctl = NULL;
+	struct status_page *status = NULL;
+	struct statefile *statefile = NULL;
+	struct libbacklight_state state;
+	int window_restored = 0;		// Sensor window restored from state
+	struct status_values status_values;
+	memset(&status_values, 0, sizeof(status_values));
 	struct backlight backlight;
 	memset(&backlight, 0, sizeof(backlight));
 	struct sensor sensor;
 	memset(&sensor, 0, sizeof(sensor));
+	sensor.dark_frequency = sensor_dark_frequency;
+	sensor.rate = sensor_rate;
 	struct proximity proximity;
 	memset(&proximity, 0, sizeof(proximity));
 	struct interrupt interrupt;
 	memset(&interrupt, 0, sizeof(interrupt));
+	struct input input;
+	memset(&input, 0, sizeof(input));
+	struct batch batch_state;
+	struct metrics metrics;
+	struct energy energy;
+	struct history history;
+	memset(&history, 0, sizeof(history));
+	memset(&metrics, 0, sizeof(metrics));
+	struct metrics_values metrics_values;
+	memset(&metrics_values, 0, sizeof(metrics_values));
+	struct timespec metrics_next = {0,0};
 	struct timespec start = {0,0};
 	struct timespec now = {0,0};
-	struct pollfd fds[FDS_LENGTH];
-	fds[FDS_SIGNAL].fd = -1;
-	fds[FDS_INTERRUPT].fd = -1;
+	struct timespec sensor_good = {0,0};	// Last successful sensor reading
+	int sensor_stale = 0;					// Last readings too old, brightness fell back to initial step
+	unsigned long long wakeups = 0;
+	unsigned long long samples = 0;
+	unsigned long long missed_deadlines = 0;
+	long long worst_lateness_ms = 0;
+	/* Timer slack lets the kernel delay wakeups on purpose, that is not a missed deadline */
+	const long long deadline_slack_ms = RT_DEADLINE_SLACK_MS + (power_save ? POWER_SAVE_TIMER_SLACK_NS / 1000000LL : 0);
+	struct source_registry sources;
+	struct source signal_source = {.name = "signal", .fd = -1};
+	/* Device sources survive transient errors, see source_sample_due() */
+	struct source sensor_source = {.name = "sensor", .fd = -1, .interval_ms = SAMPLE_PERIOD_MS, .caps = SOURCE_LUX,
+									.sample = sensor_source_sample, .retry = 1, .recover = sensor_source_recover,
+									.priv = &sensor};
+	struct source proximity_source = {.name = "proximity", .fd = -1, .interval_ms = SAMPLE_PERIOD_MS, .caps = SOURCE_TRIGGER,
+									.sample = proximity_source_sample, .retry = 1, .priv = &proximity};
+	struct source interrupt_source = {.name = "interrupt", .fd = -1, .caps = SOURCE_TRIGGER,
+									.ready = interrupt_source_ready, .sample = interrupt_source_sample, .retry = 1,
+									.recover = interrupt_source_recover, .priv = &interrupt};
+	struct source input_source = {.name = "input", .fd = -1, .caps = SOURCE_TRIGGER,
+									.ready = input_source_ready, .retry = 1, .recover = input_source_recover,
+									.priv = &input};
+	struct source *device_sources[] = {&sensor_source, &proximity_source, &interrupt_source, &input_source};
+	struct control_target control_target;
+	memset(&control_target, 0, sizeof(control_target));
+	struct source control_source = {.name = "control", .fd = -1, .events = EPOLLIN,
+									.ready = control_source_ready, .priv = &control_target};
 	sigset_t mask;
-	int r = 0;
+	int r = source_registry_init(&sources);
+	if (r) {
+		pr_err("Failed creating epoll instance [%d]: %s\n", -r, strerror(-r));
+		return -r;
+	}
 
-	if (sensor_device || proximity_device) {
-		ctx = iio_create_local_context();
-		if (!ctx) {
-			r = -errno;
-			pr_err("Failed creating iio context: %s\n", strerror(-r));
-			goto exit;
-		}
+	/* Any trigger source enables the inactivity timeout */
+	conf.enable_trigger = interrupt_device || input_device || proximity_device;
+	if (sim_script && (interrupt_device || input_device)) {
+		pr_info("simulate: interrupt and input triggers are taken from script\n");
+		interrupt_device = NULL;
+		input_device = NULL;
 	}
-	if (sensor_device) {
-		r = sensor_init(&sensor, ctx, sensor_device);
+	if ((sensor_count || proximity_device) && !sim_script) {
+		r = iio_scan_start(&scan, iio_create_local_context);
 		if (r) {
-			pr_err("Failed initializing sensor [%d]: %s\n", -r, strerror(-r));
+			pr_err("Failed starting iio scan [%d]: %s\n", -r, strerror(-r));
 			goto exit;
 		}
-		conf.enable_sensor = 1;
-		pr_info("sensor: max: %" PRIu32 ": min: %" PRIu32"\n", conf.max_lux, conf.min_lux);
 	}
-	if (proximity_device) {
-		r = proximity_init(&proximity, ctx, proximity_device, proximity_nearlevel);
+	if (interrupt_device) {
+		r = interrupt_init(&interrupt, interrupt_device, interrupt_coalesce_ms, interrupt_storm_edges);
 		if (r) {
-			pr_err("Failed initializing proximity [%d]: %s\n", -r, strerror(-r));
+			pr_err("Failed initializing interrupt [%d]: %s\n", -r, strerror(-r));
 			goto exit;
 		}
-		conf.enable_trigger = 1;
 	}
-	if (interrupt_device) {
-		r = interrupt_init(&interrupt, interrupt_device);
+	if (input_device) {
+		r = input_init(&input, input_device);
 		if (r) {
-			pr_err("Failed initializing interrupt [%d]: %s\n", -r, strerror(-r));
+			pr_err("Failed initializing input [%d]: %s\n", -r, strerror(-r));
 			goto exit;
 		}
 	}
-	r = backlight_init(&backlight, backlight_device);
+	r = io->backlight_open(&backlight, backlight_device);
 	if (r) {
 		pr_err("Failed initializing backlight [%d]: %s\n", -r, strerror(-r));
 		goto exit;
 	}
 
-	r = backlight_get(&backlight, &conf.initial_brightness_step);
+	r = io->backlight_get(&backlight, &conf.initial_brightness_step);
 	if (r) {
 		pr_err("Failed reading actual backlight [%d]: %s\n", -r, strerror(-r));
 		goto exit;
 	}
 
-	r = backlight_max(&backlight, &conf.max_brightness_step);
+	r = io->backlight_max(&backlight, &conf.max_brightness_step);
 	if (r) {
 		pr_err("Failed reading max backlight [%d]: %s\n", -r, strerror(-r));
 		goto exit;
@@ -624,8 +2403,66 @@ int main(int argc, char** argv)
 	pr_info("backlight: max: %" PRIu32 ": initial: %" PRIu32 "\n",
 			conf.max_brightness_step, conf.initial_brightness_step);
 
+	if (metrics_path) {
+		r = metrics_init(&metrics, metrics_path);
+		if (r) {
+			pr_err("Failed initializing metrics [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+		pr_info("metrics: %s: interval: %d s\n", metrics_path, metrics_interval_sec);
+	}
+
+	if (scan.started) {
+		r = iio_scan_join(&scan, &ctx);
+		if (r) {
+			pr_err("Failed creating iio context [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+		pr_dbg("startup: iio context: %.1f ms\n", startup_ms(&main_ts));
+	}
+	for (unsigned int i = 0; i < sensor_count; ++i) {
+		r = sensor_init(&sensor, ctx, sensor_devices[i]);
+		if (r) {
+			pr_err("Failed initializing sensor [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+	if (sensor_count) {
+		if (sensor_rate > 0.0)
+			pr_info("sensor: rate: %.1f Hz\n", sensor_rate);
+		conf.enable_sensor = 1;
+		conf.sensors = sensor_count;
+		if (sensor_count > 1)
+			pr_info("sensor: fusion: %s: fault ratio: %" PRIu32 "\n",
+					conf.fusion == LIBBACKLIGHT_FUSION_MAX ? "max" :
+					conf.fusion == LIBBACKLIGHT_FUSION_MEDIAN ? "median" : "mean", conf.fault_ratio);
+		pr_info("sensor: max: %" PRIu32 ": min: %" PRIu32"\n", conf.max_lux, conf.min_lux);
+		if (conf.enable_auto_range)
+			pr_info("sensor: auto range: percentiles: %u:%u\n", conf.auto_min_percentile, conf.auto_max_percentile);
+	}
+	if (proximity_device) {
+		r = proximity_init(&proximity, ctx, proximity_device, proximity_nearlevel, proximity_farlevel,
+							proximity_debounce_n, proximity_debounce_m);
+		if (r) {
+			pr_err("Failed initializing proximity [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+
+	if (use_uring && !sim_script) {
+		r = batch_init(&batch_state, &sensor, &proximity, &interrupt, &backlight);
+		if (r) {
+			pr_info("uring: unavailable, using regular reads [%d]: %s\n", -r, strerror(-r));
+			r = 0;
+		}
+		else {
+			batch = &batch_state;
+			pr_info("uring: enabled\n");
+		}
+	}
+
 
-	r = timestamp(&start);
+	r = io->now(&start);
 	if (r)
 		goto exit;
 
@@ -635,100 +2472,512 @@ int main(int argc, char** argv)
 		goto exit;
 	}
 
+	if (state_path) {
+		statefile = statefile_open(state_path);
+		if (!statefile) {
+			r = -errno;
+			pr_err("Failed opening state file %s [%d]: %s\n", state_path, -r, strerror(-r));
+			goto exit;
+		}
+		r = statefile_load(statefile, &state);
+		if (r == 0) {
+			/* Monotonic clock restarts on reboot */
+			if (timespec_diff_ms(&state.last_trigger, &start) > 0)
+				state.last_trigger = start;
+			r = libbacklight_restore(bctl, &state);
+		}
+		if (r == 0) {
+			window_restored = state.samples > 0;
+			pr_info("state: restored: %s: brightness: %" PRIu32 "\n", state_path, libbacklight_brightness(bctl));
+		}
+		else {
+			pr_info("state: not restored [%d]: %s\n", -r, strerror(-r));
+		}
+		r = 0;
+	}
+
+	/* Seed filter with a burst of current readings instead of waiting for a full window.
+	 * A restored window is kept, it holds more readings than a burst.
+	 * Raw attribute is read, buffered sampling is started after the first decision. */
+	if (sensor_count && !window_restored) {
+		uint32_t lux[LIBBACKLIGHT_MAX_SENSORS];
+		const int err = sensor_burst(&sensor, lux);
+		if (err) {
+			pr_err("sensor: failed seeding filter [%d]: %s\n", -err, strerror(-err));
+		}
+		else {
+			libbacklight_reseed(bctl, lux);
+			libbacklight_update(bctl, &start, 0);
+		}
+	}
+	/* Restored state and seeded decision take one write */
+	if (libbacklight_brightness(bctl) != conf.initial_brightness_step) {
+		r = io->backlight_set(&backlight, libbacklight_brightness(bctl));
+		if (!r)
+			r = backlight_flush();
+		if (r)
+			goto exit;
+	}
+	metrics_values.first_decision_seconds = startup_ms(&main_ts) / 1e3;
+	pr_info("startup: first decision: %.1f ms: brightness: %" PRIu32 ": lux: %" PRIu32 "\n",
+			metrics_values.first_decision_seconds * 1e3, libbacklight_brightness(bctl), libbacklight_lux(bctl));
+
+	if (sensor_count) {
+		r = io->sensor_start(&sensor);
+		if (r) {
+			pr_err("Failed starting buffered sampling [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+
+	if (history_path) {
+		r = history_open(&history, history_path, history_pages);
+		if (r) {
+			pr_err("Failed opening history %s [%d]: %s\n", history_path, -r, strerror(-r));
+			goto exit;
+		}
+		if (history.reset)
+			pr_info("history: %s: stale version or damaged header, started over\n", history_path);
+		pr_info("history: %s: pages: %" PRIu32 "\n", history_path, history.header->pages);
+	}
+
+	/* Counters accumulate across restarts when state or history is kept.
+	 * History survives reboots, state file is updated more often, counters only grow so the larger is newer. */
+	energy_init(&energy, conf.max_brightness_step, base_watts, step_watts);
+	struct energy_counters saved;
+	int restored = statefile && statefile_load_energy(statefile, &energy.counters) == 0;
+	if (history_path && history_load_energy(&history, &saved) == 0
+		&& saved.lit_seconds + saved.dark_seconds > energy.counters.lit_seconds + energy.counters.dark_seconds) {
+		energy.counters = saved;
+		restored = 1;
+	}
+	if (restored)
+		pr_info("energy: restored: lit: %.0f s: dark: %.0f s\n", energy.counters.lit_seconds, energy.counters.dark_seconds);
+	energy_account(&energy, &start, libbacklight_brightness(bctl));
+	struct timespec energy_stored = start;
+
+	if (status_name) {
+		status = status_create(status_name);
+		if (!status) {
+			r = -errno;
+			pr_err("Failed creating status segment %s [%d]: %s\n", status_name, -r, strerror(-r));
+			goto exit;
+		}
+		status_values.max_brightness_step = conf.max_brightness_step;
+		pr_info("status: %s\n", status_name);
+	}
+
 	/* Install signal handler */
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
+	if (config_path)
+		sigaddset(&mask, SIGHUP);
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
 		r = -errno;
 		pr_err("Failed blocking signals [%d]: %s\n", -r, strerror(-r));
 		goto exit;
 	}
-	fds[FDS_SIGNAL].events = POLLIN;
-	fds[FDS_SIGNAL].fd = signalfd(-1, &mask, 0);
-	if (fds[FDS_SIGNAL].fd < 0) {
+	signal_source.events = EPOLLIN;
+	signal_source.ready = signal_source_ready;
+	signal_source.fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (signal_source.fd < 0) {
 		r = -errno;
 		pr_err("Failed installing signal handler [%d]: %s\n", -r, strerror(-r));
 		goto exit;
 	}
+	r = source_add(&sources, &signal_source, &start);
+	if (r) {
+		pr_err("Failed adding signal source [%d]: %s\n", -r, strerror(-r));
+		goto exit;
+	}
+
+	if (sensor_count) {
+		r = source_add(&sources, &sensor_source, &start);
+		if (r) {
+			pr_err("Failed adding sensor source [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+
+	if (proximity_device) {
+		r = source_add(&sources, &proximity_source, &start);
+		if (r) {
+			pr_err("Failed adding proximity source [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
 
 	if (interrupt_device) {
-		fds[FDS_INTERRUPT].events = interrupt_events(&interrupt);
-		r = interrupt_fd(&interrupt, &fds[FDS_INTERRUPT].fd);
+		interrupt_source.events = interrupt_events(&interrupt);
+		r = interrupt_fd(&interrupt, &interrupt_source.fd);
 		if (r) {
 			pr_err ("Failed getting interrupt fd [%d]: %s\n", -r, strerror(-r));
 			goto exit;
 		}
+		r = source_add(&sources, &interrupt_source, &start);
+		if (r) {
+			pr_err("Failed adding interrupt source [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+
+	if (input_device) {
+		input_source.events = input_events(&input);
+		r = input_fd(&input, &input_source.fd);
+		if (r) {
+			pr_err ("Failed getting input fd [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+		r = source_add(&sources, &input_source, &start);
+		if (r) {
+			pr_err("Failed adding input source [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+	}
+
+	if (control_path) {
+		control_target.bctl = bctl;
+		r = control_init(&control_target.control, control_path);
+		if (r) {
+			pr_err("Failed creating control socket %s [%d]: %s\n", control_path, -r, strerror(-r));
+			goto exit;
+		}
+		control_source.fd = control_fd(&control_target.control);
+		r = source_add(&sources, &control_source, &start);
+		if (r) {
+			pr_err("Failed adding control source [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+		pr_info("control: %s\n", control_path);
+	}
+
+	r = realtime_init(rt_priority, rt_cpu, rt_mlock);
+	if (r)
+		goto exit;
+
+	if (power_save) {
+		if (prctl(PR_SET_TIMERSLACK, POWER_SAVE_TIMER_SLACK_NS, 0, 0, 0) != 0) {
+			r = -errno;
+			pr_err("Failed setting timer slack [%d]: %s\n", -r, strerror(-r));
+			goto exit;
+		}
+		pr_info("power save: period: %d ms: timer slack: %lu ns\n", POWER_SAVE_PERIOD_MS, POWER_SAVE_TIMER_SLACK_NS);
 	}
 
+	now = start;
+	sensor_good = start;
 	r = 0;
 	while (1) {
-		const int delay_ms = 100;
-		int detect_interrupt = 0;
-		int trigger = 0;
-		uint32_t lux = 0;
-
-		/* poll for events */
-		r = poll(fds, FDS_LENGTH, delay_ms);
-		if (r < 0) {
-			r = -errno;
-			pr_err("Failed polling [%d]: %s\n", -r, strerror(-r));
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+
+		int timeout_ms = -1;
+		if (power_save) {
+			r = aligned_timeout_ms(POWER_SAVE_PERIOD_MS, &timeout_ms);
+			if (r)
+				break;
+		}
+		else {
+			timeout_ms = source_timeout_ms(&sources, &now);
+			const int trigger_ms = trigger_timeout_ms(bctl, &now);
+			if (trigger_ms >= 0 && (timeout_ms < 0 || trigger_ms < timeout_ms))
+				timeout_ms = trigger_ms;
+			if (metrics_path) {
+				long long metrics_ms = timespec_diff_ms(&metrics_next, &now);
+				metrics_ms = metrics_ms > 0 ? metrics_ms : 0;
+				if (timeout_ms < 0 || metrics_ms < timeout_ms)
+					timeout_ms = metrics_ms;
+			}
+		}
+
+		/* Wait for events, ready sources are handled by their callbacks */
+		struct timespec wait_start;
+		const int timed = timeout_ms >= 0 && io->now(&wait_start) == 0;
+		const int ready = io->wait(&sources, timeout_ms, &sample);
+		if (ready < 0) {
+			r = ready;
+			pr_err("Failed waiting for sources [%d]: %s\n", -r, strerror(-r));
 			break;
 		}
+		wakeups++;
+
+		/* Woken by timeout, check how late we are. Only the wait is measured, not the processing before it. */
+		struct timespec woke;
+		if (ready == 0 && timed && io->now(&woke) == 0) {
+			const long long lateness_ms = timespec_diff_ms(&woke, &wait_start) - timeout_ms;
+			if (lateness_ms > deadline_slack_ms) {
+				missed_deadlines++;
+				pr_dbg("loop: missed deadline by %lld ms\n", lateness_ms);
+			}
+			if (lateness_ms > worst_lateness_ms)
+				worst_lateness_ms = lateness_ms;
+		}
 
 		/* Exit due to signal */
-		if (fds[FDS_SIGNAL].revents != 0)
+		if (sample.quit)
 			break;
 
-		/* Check for triggered interrupts */
-		if ((fds[FDS_INTERRUPT].revents & (POLLPRI | POLLERR)) != 0) {
-			r = interrupt_get(&interrupt, &trigger);
-			if (r) {
-				pr_err("interrupt: failed reading [%d]: %s\n", -r, strerror(-r));
-				break;
+		/* Swap in new configuration, applied by next decision */
+		if (sample.reload && config_path) {
+			const int err = config_reload(bctl, &args_conf, config_path);
+			if (err) {
+				pr_err("config: reload failed, keeping current [%d]: %s\n", -err, strerror(-err));
+			}
+			else {
+				pr_info("config: reloaded\n");
 			}
-			if (trigger)
-				pr_dbg("interrupt: yes\n");
-			detect_interrupt |= trigger;
 		}
 
-		if (sensor_device) {
-			r = sensor_get(&sensor, &lux);
-			if (r) {
-				pr_err("sensor: failed reading [%d]: %s\n", -r, strerror(-r));
-				break;
+		/* In power save mode only sample on period boundaries or trigger */
+		const int triggered = sample.trigger || sample.trigger_ts_set;
+		if (power_save && ready != 0 && !triggered && !sample.brightness_changed)
+			continue;
+
+		r = io->now(&now);
+		if (r)
+			break;
+
+		/* Read files of periodic sources due now in one submission, taken by their sample() */
+		if (batch) {
+			unsigned int mask = 0;
+			if (sample_pending(&sensor_source, &now, power_save))
+				mask |= BATCH_SENSOR_MASK;
+			if (sample_pending(&proximity_source, &now, power_save))
+				mask |= 1U << BATCH_PROXIMITY;
+			if (sample_pending(&interrupt_source, &now, power_save))
+				mask |= 1U << BATCH_INTERRUPT;
+			const int err = batch_prefetch(batch, mask);
+			if (err)
+				pr_err("uring: failed reading [%d]: %s\n", -err, strerror(-err));
+		}
+
+		/* Periodic sources, all of them on a power save boundary or trigger */
+		r = source_sample_due(&sources, &now, power_save, &sample);
+		if (r < 0)
+			break;
+		r = 0;
+		samples++;
+
+		/* Sensor was suspended while dark, reseed filter before deciding brightness on wake up by trigger or control.
+		 * Sensor is left as it is while brightness is overridden, an override of 0 isn't dark. */
+		if (sensor.suspended && !libbacklight_overridden(bctl) && (triggered || libbacklight_brightness(bctl) > 0)) {
+			uint32_t lux[LIBBACKLIGHT_MAX_SENSORS];
+			int err = sensor_burst(&sensor, lux);
+			if (err) {
+				pr_err("sensor: failed burst reading [%d]: %s\n", -err, strerror(-err));
+			}
+			else {
+				libbacklight_reseed(bctl, lux);
+				sensor_stale = 0;
+			}
+			sensor_good = now;
+			err = sensor_resume(&sensor);
+			if (err)
+				pr_err("sensor: failed restoring sampling frequency [%d]: %s\n", -err, strerror(-err));
+			source_set_interval(&sources, &sensor_source, SAMPLE_PERIOD_MS, &now);
+			pr_dbg("sensor: resumed: lux: %" PRIu32 "\n", libbacklight_lux(bctl));
+		}
+
+		/* Last readings are used while sensor reads fail, until they are too old to trust */
+		if (sensor_count && !sensor.suspended) {
+			if (sample.lux_set) {
+				if (sensor_stale) {
+					libbacklight_reseed(bctl, sample.lux);
+					sensor_stale = 0;
+					pr_info("sensor: reading again\n");
+				}
+				sensor_good = now;
 			}
+			else
+			if (!sensor_stale && sensor_stale_ms > 0 && timespec_diff_ms(&now, &sensor_good) > sensor_stale_ms) {
+				uint32_t lost[LIBBACKLIGHT_MAX_SENSORS];
+				for (unsigned int i = 0; i < sensor.count; ++i)
+					lost[i] = LIBBACKLIGHT_LUX_INVALID;
+				libbacklight_reseed(bctl, lost);
+				sensor_stale = 1;
+				pr_err("sensor: no reading for %d ms, falling back to initial brightness\n", sensor_stale_ms);
+			}
+		}
+
+		enum libbacklight_action action = LIBBACKLIGHT_NONE;
+		if (sample.trigger_ts_set)
+			action = libbacklight_trigger(bctl, &sample.trigger_ts);
+		if (sample.lux_set) {
+			if (libbacklight_operate_multi(bctl, &now, sample.trigger, sample.lux) == LIBBACKLIGHT_BRIGHTNESS)
+				action = LIBBACKLIGHT_BRIGHTNESS;
+		}
+		else {
+			if (libbacklight_update(bctl, &now, sample.trigger) == LIBBACKLIGHT_BRIGHTNESS)
+				action = LIBBACKLIGHT_BRIGHTNESS;
 		}
-		if (proximity_device) {
-			r = proximity_get(&proximity, &trigger);
+		if (sample.brightness_changed)
+			action = LIBBACKLIGHT_BRIGHTNESS;
+
+		if (action == LIBBACKLIGHT_BRIGHTNESS) {
+			pr_dbg("backlight: brightness -> %" PRIu32 ": lux: %" PRIu32 "\n", libbacklight_brightness(bctl), libbacklight_lux(bctl));
+			r = io->backlight_set(&backlight, libbacklight_brightness(bctl));
+			metrics_values.brightness_writes++;
 			if (r) {
-				pr_err("proximity: failed reading [%d]: %s\n", -r, strerror(-r));
+				metrics_values.brightness_failures++;
 				break;
 			}
-			if (trigger)
-				pr_dbg("proximity: yes\n");
-			detect_interrupt |= trigger;
 		}
 
-		r = timestamp(&now);
-		if (r)
+		/* Lux is ignored while dark, stop sampling until next trigger */
+		if (conf.enable_sensor && conf.enable_trigger && !sensor.suspended && !libbacklight_overridden(bctl)
+			&& libbacklight_brightness(bctl) == 0) {
+			source_set_interval(&sources, &sensor_source, 0, &now);
+			const int err = sensor_suspend(&sensor);
+			if (err)
+				pr_err("sensor: failed lowering sampling frequency [%d]: %s\n", -err, strerror(-err));
+			pr_dbg("sensor: suspended\n");
+		}
+
+		uint32_t raw_lux = LIBBACKLIGHT_LUX_INVALID;
+		const int raw_lux_set = sample_raw_lux(&sample, sensor.count, &raw_lux);
+
+		energy_account(&energy, &now, libbacklight_brightness(bctl));
+		const int store_energy = timespec_diff_ms(&now, &energy_stored) >= ENERGY_STORE_MS;
+		if (store_energy)
+			energy_stored = now;
+		if (statefile) {
+			libbacklight_save(bctl, &state);
+			statefile_store(statefile, &state);
+			if (store_energy)
+				statefile_store_energy(statefile, &energy.counters);
+		}
+		if (history_path) {
+			struct timespec wall;
+			if (io->wall(&wall) == 0)
+				history_add(&history, &wall, raw_lux,
+							libbacklight_brightness(bctl), triggered);
+			if (store_energy)
+				history_store_energy(&history, &energy.counters);
+		}
+
+		if (status) {
+			const struct timespec left = libbacklight_timeout_remaining(bctl, &now);
+			status_values.brightness_step = libbacklight_brightness(bctl);
+			status_values.filtered_lux = libbacklight_lux(bctl);
+			if (raw_lux_set)
+				status_values.raw_lux = raw_lux;
+			status_values.triggered = triggered;
+			status_values.timeout_ms = conf.enable_trigger ? left.tv_sec * 1000LL + left.tv_nsec / 1000000LL : -1;
+			status_values.updated_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000LL;
+			status_publish(status, &status_values);
+		}
+
+		/* Writes queued during this wakeup, submitted together */
+		r = backlight_flush();
+		if (r) {
+			metrics_values.brightness_failures++;
 			break;
+		}
 
-		if (libbacklight_operate(bctl, &now, detect_interrupt, lux) == LIBBACKLIGHT_BRIGHTNESS) {
-			pr_dbg("backlight: brightness -> %" PRIu32 ": lux: %" PRIu32 "\n", libbacklight_brightness(bctl), lux);
-			r = backlight_set(&backlight, libbacklight_brightness(bctl));
-			if (r)
-				break;
+		if (metrics_path) {
+			if (triggered)
+				metrics_values.triggers++;
+			if (raw_lux_set)
+				metrics_values.raw_lux = raw_lux;
+			struct timespec done;
+			if (io->now(&done) == 0)
+				metrics_latency(&metrics, (done.tv_sec - now.tv_sec) + (done.tv_nsec - now.tv_nsec) / 1e9);
+			if (timespec_diff_ms(&now, &metrics_next) >= 0) {
+				metrics_fill(&metrics_values, wakeups, &sensor, bctl, &energy, &sources);
+				const int err = metrics_write(&metrics, &metrics_values);
+				if (err)
+					pr_err("metrics: failed writing %s [%d]: %s\n", metrics_path, -err, strerror(-err));
+				metrics_next.tv_sec = now.tv_sec + metrics_interval_sec;
+				metrics_next.tv_nsec = now.tv_nsec;
+			}
 		}
 	}
+	if (io->now(&now) == 0)
+		energy_account(&energy, &now, libbacklight_brightness(bctl));
+	if (statefile)
+		statefile_store_energy(statefile, &energy.counters);
+	if (history_path)
+		history_store_energy(&history, &energy.counters);
+	/* Config as applied, a reload may have replaced the one from startup */
+	const struct libbacklight_conf *applied = libbacklight_get_conf(bctl);
 	/* Restore backlight setting */
-	backlight_set(&backlight, libbacklight_get_conf(bctl)->initial_brightness_step);
+	io->backlight_restore(&backlight, applied->initial_brightness_step);
+	if (metrics_path) {
+		metrics_fill(&metrics_values, wakeups, &sensor, bctl, &energy, &sources);
+		metrics_write(&metrics, &metrics_values);
+	}
+	if (sensor.suspended)
+		sensor_resume(&sensor);
+	if (power_save && io->now(&now) == 0) {
+		const long long elapsed_ms = timespec_diff_ms(&now, &start);
+		pr_info("power save: wakeups: %llu: samples: %llu: wakeups/s: %.3f\n", wakeups, samples,
+				elapsed_ms > 0 ? wakeups * 1000.0 / elapsed_ms : 0.0);
+	}
+	if (rt_priority > 0)
+		pr_info("realtime: missed deadlines: %llu: worst lateness: %lld ms\n", missed_deadlines, worst_lateness_ms);
+	if (interrupt_device)
+		pr_info("interrupt: edges: %llu: coalesced: %llu: storms: %llu\n",
+				interrupt.filter.edges, interrupt.filter.coalesced, interrupt.filter.storms);
+	if (batch)
+		pr_info("uring: submits: %llu: operations: %llu\n", batch->ring.submits, batch->ring.ops);
+	if (sensor_count && applied->enable_trigger)
+		pr_info("sensor: suspends: %llu\n", sensor.suspends);
+	for (unsigned int i = 0; sensor_rate > 0.0 && i < sensor.count; ++i)
+		pr_info("sensor %u: decimated values dropped: %llu\n", i, sensor.dropped[i]);
+	if (applied->enable_sensor && applied->step_ratio)
+		pr_info("sensor: step resets: %" PRIu32 "\n", libbacklight_steps(bctl));
+	if (applied->enable_sensor && applied->enable_auto_range) {
+		uint32_t min_lux = 0;
+		uint32_t max_lux = 0;
+		libbacklight_lux_range(bctl, &min_lux, &max_lux);
+		pr_info("sensor: auto range: max: %" PRIu32 ": min: %" PRIu32 "\n", max_lux, min_lux);
+	}
+	for (size_t i = 0; i < sizeof(device_sources) / sizeof(device_sources[0]); ++i) {
+		if (device_sources[i]->errors)
+			pr_info("%s: errors: %llu: recoveries: %llu\n", device_sources[i]->name,
+					device_sources[i]->errors, device_sources[i]->recoveries);
+	}
+	if (control_path)
+		pr_info("control: requests: %llu: errors: %llu: rejected: %llu\n", control_target.control.requests,
+				control_target.control.errors, control_target.control.rejected);
+	if (history_path)
+		pr_info("history: records: %llu\n", history.records);
+	if (proximity_device)
+		pr_info("proximity: transitions: %llu: spurious: %llu\n", proximity.debounce.transitions,
+				debounce_spurious(&proximity.debounce));
+	const struct energy_counters *counters = &energy.counters;
+	pr_info("energy: lit: %.0f s: dark: %.0f s: average step when lit: %.1f\n", counters->lit_seconds,
+			counters->dark_seconds, counters->step_seconds / (counters->lit_seconds > 0.0 ? counters->lit_seconds : 1.0));
+	if (base_watts > 0.0 || step_watts > 0.0)
+		pr_info("energy: used: %.2f Wh: saved: %.2f Wh\n", counters->joules / 3600.0,
+				(counters->full_joules - counters->joules) / 3600.0);
 exit:
 
+	source_registry_free(&sources);
+	if (signal_source.fd >= 0)
+		close(signal_source.fd);
+	if (control_target.control.path)
+		control_free(&control_target.control);
+	status_destroy(&status, status_name);
+	statefile_close(&statefile);
+	history_close(&history);
+	if (batch)
+		batch_free(batch);
+	metrics_free(&metrics);
 	backlight_free(&backlight);
 	interrupt_free(&interrupt);
+	input_free(&input);
+	sensor_free(&sensor);
+	if (scan.started)
+		iio_scan_join(&scan, &ctx);
 	if (ctx)
 		iio_context_destroy(ctx);
+	if (sim_script) {
+		if (sim.out != stdout)
+			fclose(sim.out);
+		sim_free(&sim);
+	}
 	destroy_libbacklight(&bctl);
 	return -r;
 }
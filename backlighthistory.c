@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include "history.h"
+
+#define xstr(a) str(a)
+#define str(a) #a
+
+#define STEP_SLOTS 16
+
+static void print_usage(void)
+{
+	printf("backlighthistory, print lux and brightness history kept by backlightctl, Data Respons Solutions AB\n");
+	printf("Version:   %s\n", xstr(SRC_VERSION));
+	printf("\n");
+
+	printf("Usage:   backlighthistory [OPTION] FILE\n");
+	printf("\n");
+
+	printf("FILE: History file given to backlightctl --history\n");
+	printf("  Read one page at a time, oldest first, may be read while backlightctl appends\n");
+	printf("\n");
+
+	printf("Options:\n");
+	printf("  --from TIME     First minute printed, format \"YYYY-MM-DD HH:MM\" or \"YYYY-MM-DD\"\n");
+	printf("    Default: oldest record\n");
+	printf("  --to TIME       Print minutes before TIME, same format as --from\n");
+	printf("    Default: newest record\n");
+	printf("  --interval MIN  Minutes combined into each line, aligned to UTC, for example 60 or 1440\n");
+	printf("    Default: 1\n");
+	printf("  --utc           Times in UTC instead of local time\n");
+	printf("\n");
+
+	printf("Output, one line per interval with records:\n");
+	printf("  time min_lux avg_lux max_lux step triggers minutes\n");
+	printf("  avg_lux is the mean of minute averages, step the one most minutes were dominated by\n");
+	printf("  Lux is - if the sensor wasn't read, minutes is the number of minutes recorded\n");
+	printf("\n");
+
+	printf("Return values:\n");
+	printf("  0 if ok\n");
+	printf("  errno for error\n");
+	printf("\n");
+}
+
+struct interval {
+	int64_t start;					// Minute
+	int set;
+	uint32_t minutes;
+	uint32_t lux_minutes;
+	uint32_t min_lux;
+	uint32_t max_lux;
+	uint64_t avg_sum;
+	uint64_t triggers;
+	uint32_t step[STEP_SLOTS];
+	uint32_t step_minutes[STEP_SLOTS];	// 0 if slot is free
+};
+
+static void interval_start(struct interval* in, int64_t start)
+{
+	memset(in, 0, sizeof(struct interval));
+	in->start = start;
+	in->set = 1;
+	in->min_lux = UINT32_MAX;
+}
+
+/* Step not fitting replaces the one seen fewest minutes */
+static void interval_add(struct interval* in, const struct history_record* record)
+{
+	in->minutes++;
+	in->triggers += record->triggers;
+	if (record->has_lux) {
+		in->lux_minutes++;
+		in->min_lux = record->min_lux < in->min_lux ? record->min_lux : in->min_lux;
+		in->max_lux = record->max_lux > in->max_lux ? record->max_lux : in->max_lux;
+		in->avg_sum += record->avg_lux;
+	}
+
+	int slot = -1;
+	for (int i = 0; i < STEP_SLOTS && slot < 0; ++i) {
+		if (in->step_minutes[i] && in->step[i] == record->step)
+			slot = i;
+	}
+	if (slot < 0) {
+		slot = 0;
+		for (int i = 1; i < STEP_SLOTS; ++i) {
+			if (in->step_minutes[i] < in->step_minutes[slot])
+				slot = i;
+		}
+		in->step[slot] = record->step;
+		in->step_minutes[slot] = 0;
+	}
+	in->step_minutes[slot]++;
+}
+
+static void interval_print(const struct interval* in, int utc)
+{
+	const time_t t = in->start * 60;
+	struct tm tm;
+	if (utc)
+		gmtime_r(&t, &tm);
+	else
+		localtime_r(&t, &tm);
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+
+	int dominant = 0;
+	for (int i = 1; i < STEP_SLOTS; ++i) {
+		if (in->step_minutes[i] > in->step_minutes[dominant])
+			dominant = i;
+	}
+
+	if (in->lux_minutes)
+		printf("%s %" PRIu32 " %" PRIu64 " %" PRIu32, when, in->min_lux, in->avg_sum / in->lux_minutes, in->max_lux);
+	else
+		printf("%s - - -", when);
+	printf(" %" PRIu32 " %" PRIu64 " %" PRIu32 "\n", in->step[dominant], in->triggers, in->minutes);
+}
+
+/* Returns minute of time or -1 if not parsable */
+static int64_t parse_time(const char* text, int utc)
+{
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	const char *end = strptime(text, "%Y-%m-%d %H:%M", &tm);
+	if (!end || *end) {
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(text, "%Y-%m-%d", &tm);
+		if (!end || *end)
+			return -1;
+	}
+	tm.tm_isdst = -1;
+	const time_t t = utc ? timegm(&tm) : mktime(&tm);
+	if (t == (time_t) -1)
+		return -1;
+	return t / 60;
+}
+
+int main(int argc, char** argv)
+{
+	const char *path = NULL;
+	const char *from_text = NULL;
+	const char *to_text = NULL;
+	long interval_minutes = 1;
+	int utc = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp("--from", argv[i]) && i + 1 < argc) {
+			from_text = argv[++i];
+		}
+		else
+		if (!strcmp("--to", argv[i]) && i + 1 < argc) {
+			to_text = argv[++i];
+		}
+		else
+		if (!strcmp("--interval", argv[i]) && i + 1 < argc) {
+			char *end = NULL;
+			interval_minutes = strtol(argv[++i], &end, 10);
+			if (*end || interval_minutes < 1) {
+				fprintf(stderr, "invalid --interval\n");
+				return EINVAL;
+			}
+		}
+		else
+		if (!strcmp("--utc", argv[i])) {
+			utc = 1;
+		}
+		else
+		if (argv[i][0] != '-' && !path) {
+			path = argv[i];
+		}
+		else {
+			print_usage();
+			return EINVAL;
+		}
+	}
+	if (!path) {
+		print_usage();
+		return EINVAL;
+	}
+
+	int64_t from = INT64_MIN;
+	int64_t to = INT64_MAX;
+	if (from_text && (from = parse_time(from_text, utc)) < 0) {
+		fprintf(stderr, "invalid --from\n");
+		return EINVAL;
+	}
+	if (to_text && (to = parse_time(to_text, utc)) < 0) {
+		fprintf(stderr, "invalid --to\n");
+		return EINVAL;
+	}
+
+	struct history_reader reader;
+	int r = history_reader_open(&reader, path);
+	if (r) {
+		fprintf(stderr, "Failed opening %s [%d]: %s\n", path, -r, strerror(-r));
+		return -r;
+	}
+
+	printf("# time min_lux avg_lux max_lux step triggers minutes\n");
+	struct interval in;
+	in.set = 0;
+	struct history_record record;
+	while ((r = history_reader_next(&reader, &record)) == 1) {
+		if (record.minute < from || record.minute >= to)
+			continue;
+		/* Floor division, minutes before epoch are negative */
+		int64_t start = record.minute / interval_minutes * interval_minutes;
+		if (start > record.minute)
+			start -= interval_minutes;
+		if (in.set && start != in.start) {
+			interval_print(&in, utc);
+			in.set = 0;
+		}
+		if (!in.set)
+			interval_start(&in, start);
+		interval_add(&in, &record);
+	}
+	if (in.set)
+		interval_print(&in, utc);
+	history_reader_close(&reader);
+
+	if (r < 0) {
+		fprintf(stderr, "Failed reading %s [%d]: %s\n", path, -r, strerror(-r));
+		return -r;
+	}
+	return 0;
+}
@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+#include "libbacklight.h"
+
+#define xstr(a) str(a)
+#define str(a) #a
+
+#define DEFAULT_STEPS 10
+#define DEFAULT_ACTIVE_SEC 30
+#define DEFAULT_TOP 10
+
+static void print_usage(void)
+{
+	printf("backlighttune, parameter sweep over recorded traces, Data Respons Solutions AB\n");
+	printf("Version:   %s\n", xstr(SRC_VERSION));
+	printf("\n");
+
+	printf("Usage:   backlighttune [OPTION] TRACE\n");
+	printf("\n");
+
+	printf("TRACE: Text file with one sample per line\n");
+	printf("  Format: time_ms lux trigger\n");
+	printf("  time_ms increasing, trigger 0 or 1, lines starting with # ignored\n");
+	printf("\n");
+
+	printf("Options:\n");
+	printf("  RANGE is given as first:last:increment or a single value\n");
+	printf("  --lmin RANGE   Lux values where backlight is set to 1\n");
+	printf("  --lmax RANGE   Lux values where backlight is set to max\n");
+	printf("  --time RANGE   Trigger timeouts in seconds, 0 disables trigger\n");
+	printf("  --window RANGE Number of sensor readings averaged\n");
+	printf("  --steps        Number of brightness steps\n");
+	printf("    Default: %d\n", DEFAULT_STEPS);
+	printf("  --active       Seconds user is considered active after a trace trigger\n");
+	printf("    Default: %d\n", DEFAULT_ACTIVE_SEC);
+	printf("  --threads      Number of worker threads\n");
+	printf("    Default: number of online cpus\n");
+	printf("  --top          Number of ranked configurations to print\n");
+	printf("    Default: %d\n", DEFAULT_TOP);
+	printf("\n");
+
+	printf("Configurations are ranked by sum of their ranks in:\n");
+	printf("  changes:     number of brightness changes\n");
+	printf("  dark_active: seconds with backlight off while user is active\n");
+	printf("  error:       mean distance to step given by instantaneous lux, in fraction of max step\n");
+	printf("Configurations libbacklight rejects are counted as invalid and not ranked,\n");
+	printf("  for example lmax - lmin below steps - 1, where a step would cover less than one lux\n");
+	printf("\n");
+
+	printf("Return values:\n");
+	printf("  0 if ok\n");
+	printf("  errno for error\n");
+	printf("\n");
+}
+
+struct range {
+	uint32_t first;
+	uint32_t last;
+	uint32_t inc;
+};
+
+static int parse_range(const char* arg, struct range* range)
+{
+	const int n = sscanf(arg, "%" SCNu32 ":%" SCNu32 ":%" SCNu32, &range->first, &range->last, &range->inc);
+	if (n == 1) {
+		range->last = range->first;
+		range->inc = 1;
+		return 0;
+	}
+	if (n == 2)
+		range->inc = 1;
+	else
+	if (n != 3)
+		return -EINVAL;
+	if (range->last < range->first || range->inc == 0)
+		return -EINVAL;
+	return 0;
+}
+
+/* Parse whole text as unsigned integer within min and max.
+ * Returns 0 on success or -EINVAL. */
+static int parse_u64(const char* text, uint64_t min, uint64_t max, uint64_t* value)
+{
+	char *end = NULL;
+	errno = 0;
+	/* strtoull() silently negates a leading minus */
+	const unsigned long long v = strtoull(text, &end, 10);
+	if (errno || end == text || *end || strchr(text, '-') || v < min || v > max)
+		return -EINVAL;
+	*value = v;
+	return 0;
+}
+
+static size_t range_count(const struct range* range)
+{
+	return (range->last - range->first) / range->inc + 1;
+}
+
+/* Value i of range, i below range_count() */
+static uint32_t range_value(const struct range* range, size_t i)
+{
+	return range->first + (uint32_t) i * range->inc;
+}
+
+/* Read-only after load, shared by all workers */
+struct trace {
+	size_t count;
+	uint64_t *time_ms;
+	uint32_t *lux;
+	uint8_t *trigger;
+};
+
+static void trace_free(struct trace* trace)
+{
+	free(trace->time_ms);
+	free(trace->lux);
+	free(trace->trigger);
+	memset(trace, 0, sizeof(struct trace));
+}
+
+static int trace_load(struct trace* trace, const char* path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	int r = 0;
+	size_t capacity = 0;
+	size_t line_no = 0;
+	char line[256];
+	memset(trace, 0, sizeof(struct trace));
+	while (fgets(line, sizeof(line), fp)) {
+		line_no++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		uint64_t time_ms = 0;
+		uint32_t lux = 0;
+		unsigned int trigger = 0;
+		if (sscanf(line, "%" SCNu64 " %" SCNu32 " %u", &time_ms, &lux, &trigger) != 3
+				|| (trace->count > 0 && time_ms < trace->time_ms[trace->count - 1])) {
+			pr_err("%s:%zu: invalid sample\n", path, line_no);
+			r = -EINVAL;
+			goto exit;
+		}
+		if (trace->count == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			uint64_t *t = realloc(trace->time_ms, capacity * sizeof(uint64_t));
+			if (t)
+				trace->time_ms = t;
+			uint32_t *l = realloc(trace->lux, capacity * sizeof(uint32_t));
+			if (l)
+				trace->lux = l;
+			uint8_t *g = realloc(trace->trigger, capacity * sizeof(uint8_t));
+			if (g)
+				trace->trigger = g;
+			if (!t || !l || !g) {
+				r = -ENOMEM;
+				goto exit;
+			}
+		}
+		trace->time_ms[trace->count] = time_ms;
+		trace->lux[trace->count] = lux;
+		trace->trigger[trace->count] = trigger ? 1 : 0;
+		trace->count++;
+	}
+	if (ferror(fp))
+		r = -EIO;
+	else
+	if (trace->count < 2)
+		r = -ENODATA;
+exit:
+	fclose(fp);
+	if (r)
+		trace_free(trace);
+	return r;
+}
+
+struct result {
+	struct libbacklight_conf conf;
+	int valid;
+	uint64_t changes;
+	double dark_active_s;
+	double error;
+	size_t score;					// Sum of ranks
+};
+
+static struct timespec ms_to_timespec(uint64_t ms)
+{
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	return ts;
+}
+
+/* Same mapping as libbacklight without averaging */
+static uint32_t ideal_step(const struct libbacklight_conf* conf, uint32_t lux)
+{
+	const uint32_t steps = conf->max_brightness_step;
+	const uint32_t per_step = steps < 2 ? conf->max_lux - conf->min_lux
+								: (conf->max_lux - conf->min_lux) / (steps - 1);
+	if (lux <= conf->min_lux || per_step == 0)
+		return lux <= conf->min_lux ? 1 : steps;
+	const uint32_t step = (lux - conf->min_lux) / per_step + 1;
+	return step > steps ? steps : step;
+}
+
+static void evaluate(const struct trace* trace, uint64_t active_ms, struct result* result)
+{
+	const struct timespec start = ms_to_timespec(trace->time_ms[0]);
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &result->conf);
+	if (!bctl) {
+		result->valid = 0;
+		return;
+	}
+
+	const double max_step = result->conf.max_brightness_step;
+	uint64_t last_trigger_ms = trace->time_ms[0];
+	uint64_t dark_active_ms = 0;
+	double error_sum = 0.0;
+	uint64_t changes = 0;
+	for (size_t i = 0; i < trace->count; ++i) {
+		const uint64_t now_ms = trace->time_ms[i];
+		const struct timespec now = ms_to_timespec(now_ms);
+		if (trace->trigger[i])
+			last_trigger_ms = now_ms;
+		if (libbacklight_operate(bctl, &now, trace->trigger[i], trace->lux[i]) == LIBBACKLIGHT_BRIGHTNESS)
+			changes++;
+
+		const uint32_t step = libbacklight_brightness(bctl);
+		if (step > 0) {
+			const uint32_t ideal = ideal_step(&result->conf, trace->lux[i]);
+			error_sum += (step > ideal ? step - ideal : ideal - step) / max_step;
+		}
+		if (i + 1 < trace->count && step == 0 && now_ms - last_trigger_ms < active_ms)
+			dark_active_ms += trace->time_ms[i + 1] - now_ms;
+	}
+	destroy_libbacklight(&bctl);
+
+	result->valid = 1;
+	result->changes = changes;
+	result->dark_active_s = dark_active_ms / 1000.0;
+	result->error = error_sum / trace->count;
+}
+
+struct work {
+	const struct trace *trace;
+	uint64_t active_ms;
+	struct result *results;
+	size_t count;
+	size_t next;					// Next result to evaluate, shared by workers
+};
+
+static void* worker(void* arg)
+{
+	struct work *work = arg;
+	while (1) {
+		const size_t i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+		if (i >= work->count)
+			break;
+		evaluate(work->trace, work->active_ms, &work->results[i]);
+	}
+	return NULL;
+}
+
+/* Ranking helpers, qsort has no context argument */
+static int cmp_changes(const void* a, const void* b)
+{
+	const struct result *r1 = *(const struct result* const*) a;
+	const struct result *r2 = *(const struct result* const*) b;
+	return (r1->changes > r2->changes) - (r1->changes < r2->changes);
+}
+
+static int cmp_dark_active(const void* a, const void* b)
+{
+	const struct result *r1 = *(const struct result* const*) a;
+	const struct result *r2 = *(const struct result* const*) b;
+	return (r1->dark_active_s > r2->dark_active_s) - (r1->dark_active_s < r2->dark_active_s);
+}
+
+static int cmp_error(const void* a, const void* b)
+{
+	const struct result *r1 = *(const struct result* const*) a;
+	const struct result *r2 = *(const struct result* const*) b;
+	return (r1->error > r2->error) - (r1->error < r2->error);
+}
+
+static int cmp_score(const void* a, const void* b)
+{
+	const struct result *r1 = *(const struct result* const*) a;
+	const struct result *r2 = *(const struct result* const*) b;
+	return (r1->score > r2->score) - (r1->score < r2->score);
+}
+
+/* Add rank by cmp to score, equal values share rank */
+static void add_rank(struct result** sorted, size_t count, int (*cmp)(const void*, const void*))
+{
+	qsort(sorted, count, sizeof(struct result*), cmp);
+	size_t rank = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (i > 0 && cmp(&sorted[i - 1], &sorted[i]) != 0)
+			rank = i;
+		sorted[i]->score += rank;
+	}
+}
+
+static double elapsed_s(const struct timespec* start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+	char *trace_path = NULL;
+	struct range lmin = {10, 10, 1};
+	struct range lmax = {600, 600, 1};
+	struct range time = {30, 30, 1};
+	struct range window = {LIBBACKLIGHT_DEFAULT_WINDOW, LIBBACKLIGHT_DEFAULT_WINDOW, 1};
+	uint32_t steps = DEFAULT_STEPS;
+	uint64_t active_ms = DEFAULT_ACTIVE_SEC * 1000ULL;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t top = DEFAULT_TOP;
+
+	if (argc < 2) {
+		print_usage();
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		struct range *range = NULL;
+		if (!strcmp("--lmin", argv[i]))
+			range = &lmin;
+		else
+		if (!strcmp("--lmax", argv[i]))
+			range = &lmax;
+		else
+		if (!strcmp("--time", argv[i]))
+			range = &time;
+		else
+		if (!strcmp("--window", argv[i]))
+			range = &window;
+
+		if (range) {
+			if (++i >= argc || parse_range(argv[i], range) || (range == &window && window.first == 0)) {
+				fprintf(stderr, "invalid %s\n", argv[i - 1]);
+				return 1;
+			}
+		}
+		else
+		if (!strcmp("--steps", argv[i])) {
+			uint64_t value = 0;
+			if (++i >= argc || parse_u64(argv[i], 1, UINT32_MAX, &value)) {
+				fprintf(stderr, "invalid --steps\n");
+				return 1;
+			}
+			steps = value;
+		}
+		else
+		if (!strcmp("--active", argv[i])) {
+			uint64_t sec = 0;
+			if (++i >= argc || parse_u64(argv[i], 0, UINT64_MAX / 1000, &sec)) {
+				fprintf(stderr, "invalid --active\n");
+				return 1;
+			}
+			active_ms = sec * 1000ULL;
+		}
+		else
+		if (!strcmp("--threads", argv[i])) {
+			uint64_t value = 0;
+			if (++i >= argc || parse_u64(argv[i], 1, LONG_MAX, &value)) {
+				fprintf(stderr, "invalid --threads\n");
+				return 1;
+			}
+			threads = value;
+		}
+		else
+		if (!strcmp("--top", argv[i])) {
+			uint64_t value = 0;
+			if (++i >= argc || parse_u64(argv[i], 1, SIZE_MAX, &value)) {
+				fprintf(stderr, "invalid --top\n");
+				return 1;
+			}
+			top = value;
+		}
+		else
+		if (!strcmp("--help", argv[i]) || !strcmp("-h", argv[i])) {
+			print_usage();
+			return 1;
+		}
+		else
+		if ('-' == argv[i][0]) {
+			fprintf(stderr, "invalid option: %s\n", argv[i]);
+			return 1;
+		}
+		else {
+			if (!trace_path) {
+				trace_path = argv[i];
+			}
+			else {
+				fprintf(stderr, "invalid argument: %s\n", argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	if (!trace_path) {
+		pr_err("mandatory argument TRACE missing\n");
+		return 1;
+	}
+	if (threads < 1)
+		threads = 1;
+
+	struct trace trace;
+	struct result *results = NULL;
+	struct result **sorted = NULL;
+	pthread_t *workers = NULL;
+	long started = 0;
+	struct timespec start;
+
+	int r = trace_load(&trace, trace_path);
+	if (r) {
+		pr_err("Failed loading trace %s [%d]: %s\n", trace_path, -r, strerror(-r));
+		return -r;
+	}
+	pr_info("trace: %zu samples: %.1f hours\n", trace.count,
+			(trace.time_ms[trace.count - 1] - trace.time_ms[0]) / 3600000.0);
+
+	const size_t count = range_count(&lmin) * range_count(&lmax) * range_count(&time) * range_count(&window);
+	results = calloc(count, sizeof(struct result));
+	sorted = calloc(count, sizeof(struct result*));
+	workers = calloc(threads, sizeof(pthread_t));
+	if (!results || !sorted || !workers) {
+		r = -ENOMEM;
+		pr_err("Failed allocating %zu configurations\n", count);
+		goto exit;
+	}
+
+	/* Counted loops, stepping a value past last could wrap around UINT32_MAX */
+	size_t n = 0;
+	for (size_t l1 = 0; l1 < range_count(&lmin); ++l1)
+	for (size_t l2 = 0; l2 < range_count(&lmax); ++l2)
+	for (size_t t = 0; t < range_count(&time); ++t)
+	for (size_t w = 0; w < range_count(&window); ++w) {
+		struct libbacklight_conf *conf = &results[n++].conf;
+		conf->max_brightness_step = steps;
+		conf->initial_brightness_step = steps;
+		conf->enable_sensor = 1;
+		conf->min_lux = range_value(&lmin, l1);
+		conf->max_lux = range_value(&lmax, l2);
+		conf->sensor_window = range_value(&window, w);
+		conf->enable_trigger = range_value(&time, t) > 0;
+		conf->trigger_timeout.tv_sec = range_value(&time, t);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct work work = {
+		.trace = &trace,
+		.active_ms = active_ms,
+		.results = results,
+		.count = count,
+		.next = 0,
+	};
+	for (started = 0; started < threads; ++started) {
+		r = -pthread_create(&workers[started], NULL, worker, &work);
+		if (r) {
+			pr_err("Failed starting worker [%d]: %s\n", -r, strerror(-r));
+			break;
+		}
+	}
+	for (long i = 0; i < started; ++i)
+		pthread_join(workers[i], NULL);
+	if (r)
+		goto exit;
+
+	const double eval_s = elapsed_s(&start);
+
+	size_t valid = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (results[i].valid)
+			sorted[valid++] = &results[i];
+	}
+	add_rank(sorted, valid, cmp_changes);
+	add_rank(sorted, valid, cmp_dark_active);
+	add_rank(sorted, valid, cmp_error);
+	qsort(sorted, valid, sizeof(struct result*), cmp_score);
+
+	pr_info("configurations: %zu: invalid: %zu: threads: %ld: %.3f s: %.0f configurations/s\n",
+			count, count - valid, threads, eval_s, eval_s > 0 ? count / eval_s : 0.0);
+	pr_info("%6s %6s %6s %6s %6s %10s %12s %8s\n",
+			"rank", "lmin", "lmax", "time", "window", "changes", "dark_active", "error");
+	for (size_t i = 0; i < valid && i < top; ++i) {
+		const struct result *res = sorted[i];
+		pr_info("%6zu %6" PRIu32 " %6" PRIu32 " %6ld %6" PRIu32 " %10" PRIu64 " %12.1f %8.4f\n",
+				i + 1, res->conf.min_lux, res->conf.max_lux, (long) res->conf.trigger_timeout.tv_sec,
+				res->conf.sensor_window, res->changes, res->dark_active_s, res->error);
+	}
+
+exit:
+	free(workers);
+	free(sorted);
+	free(results);
+	trace_free(&trace);
+	return -r;
+}
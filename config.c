@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "config.h"
+
+static int parse_u32(const char* value, uint32_t* out)
+{
+	char *end = NULL;
+	errno = 0;
+	const unsigned long long v = strtoull(value, &end, 10);
+	if (errno || end == value || *end || value[0] == '-' || v > UINT32_MAX)
+		return -EINVAL;
+	*out = v;
+	return 0;
+}
+
+static int parse_weights(const char* value, uint32_t* weights)
+{
+	uint32_t parsed[LIBBACKLIGHT_MAX_SENSORS] = {0};
+	const char *weight = value;
+	for (int n = 0; *weight; ++n) {
+		char *end = NULL;
+		if (n >= LIBBACKLIGHT_MAX_SENSORS || *weight == '-')
+			return -EINVAL;
+		parsed[n] = strtoul(weight, &end, 10);
+		if (end == weight || (*end && *end != ','))
+			return -EINVAL;
+		weight = *end ? end + 1 : end;
+	}
+	memcpy(weights, parsed, sizeof(parsed));
+	return 0;
+}
+
+static int parse(const char* key, const char* value, struct libbacklight_conf* conf)
+{
+	uint32_t v = 0;
+	if (!strcmp(key, "lmin"))
+		return parse_u32(value, &conf->min_lux);
+	else
+	if (!strcmp(key, "lmax"))
+		return parse_u32(value, &conf->max_lux);
+	else
+	if (!strcmp(key, "time")) {
+		if (parse_u32(value, &v))
+			return -EINVAL;
+		conf->trigger_timeout.tv_sec = v;
+		conf->trigger_timeout.tv_nsec = 0;
+		return 0;
+	}
+	else
+	if (!strcmp(key, "window"))
+		return parse_u32(value, &conf->sensor_window);
+	else
+	if (!strcmp(key, "auto-range")) {
+		if (!strcmp(value, "off")) {
+			conf->enable_auto_range = 0;
+			return 0;
+		}
+		unsigned int low = 0;
+		unsigned int high = 0;
+		char c = 0;
+		if (sscanf(value, "%u:%u%c", &low, &high, &c) != 2)
+			return -EINVAL;
+		conf->auto_min_percentile = low;
+		conf->auto_max_percentile = high;
+		conf->enable_auto_range = 1;
+		return 0;
+	}
+	else
+	if (!strcmp(key, "step-ratio"))
+		return parse_u32(value, &conf->step_ratio);
+	else
+	if (!strcmp(key, "step-samples"))
+		return parse_u32(value, &conf->step_samples);
+	else
+	if (!strcmp(key, "fusion")) {
+		if (!strcmp(value, "mean"))
+			conf->fusion = LIBBACKLIGHT_FUSION_MEAN;
+		else
+		if (!strcmp(value, "max"))
+			conf->fusion = LIBBACKLIGHT_FUSION_MAX;
+		else
+		if (!strcmp(value, "median"))
+			conf->fusion = LIBBACKLIGHT_FUSION_MEDIAN;
+		else
+			return -EINVAL;
+		return 0;
+	}
+	else
+	if (!strcmp(key, "weights"))
+		return parse_weights(value, conf->sensor_weight);
+	else
+	if (!strcmp(key, "fault-ratio")) {
+		if (parse_u32(value, &v) || v == 1)
+			return -EINVAL;
+		conf->fault_ratio = v;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+int config_load(const char* path, struct libbacklight_conf* conf, unsigned int* line)
+{
+	*line = 0;
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	struct libbacklight_conf next = *conf;
+	int r = 0;
+	char text[256];
+	while (fgets(text, sizeof(text), fp)) {
+		(*line)++;
+		if (text[0] == '#' || text[0] == '\n')
+			continue;
+		char key[32];
+		char value[128];
+		char extra[2];
+		if (sscanf(text, "%31s %127s %1s", key, value, extra) != 2 || parse(key, value, &next)) {
+			r = -EINVAL;
+			break;
+		}
+	}
+	if (!r && ferror(fp))
+		r = -EIO;
+	fclose(fp);
+	if (!r)
+		*conf = next;
+	return r;
+}
@@ -0,0 +1,24 @@
+#ifndef CONFIG__H__
+#define CONFIG__H__
+
+#include "libbacklight.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Controller settings which can be changed while running.
+ * One "key value" per line, lines starting with # are ignored.
+ * Keys are named after long options: lmin, lmax, time, window, auto-range, step-ratio, step-samples,
+ * fusion, weights and fault-ratio. Only settings present in file are changed. */
+
+/* Apply file at path on top of conf.
+ * Returns 0 on success, -errno if file can't be read or -EINVAL with line set to offending line number.
+ * conf is only changed on success. */
+int config_load(const char* path, struct libbacklight_conf* conf, unsigned int* line);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG__H__ */
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "control.h"
+
+/* epoll data of listening socket, clients are index + 1 */
+#define CONTROL_LISTEN 0
+
+/* Unlink socket at addr left behind by a previous instance, anything else at path is kept.
+ * Returns 0 if path may be bound, -EADDRINUSE if a running instance accepts connections or negative errno. */
+static int remove_stale(const struct sockaddr_un* addr)
+{
+	struct stat st;
+	if (lstat(addr->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+		return 0;
+
+	const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	int r = 0;
+	if (connect(fd, (const struct sockaddr*) addr, sizeof(*addr)) == 0 || errno == EAGAIN)
+		r = -EADDRINUSE;
+	else
+	if (errno == ECONNREFUSED)
+		r = unlink(addr->sun_path) == 0 ? 0 : -errno;
+	else
+		r = -errno;
+	close(fd);
+	return r;
+}
+
+int control_init(struct control* control, const char* path)
+{
+	memset(control, 0, sizeof(struct control));
+	control->listen_fd = -1;
+	control->epfd = -1;
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i)
+		control->clients[i] = -1;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	int r = remove_stale(&addr);
+	if (r)
+		return r;
+	control->path = strdup(path);
+	if (!control->path)
+		return -ENOMEM;
+
+	const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		goto fail;
+	if (bind(fd, (const struct sockaddr*) &addr, sizeof(addr)) != 0) {
+		/* Path isn't ours to unlink */
+		r = -errno;
+		close(fd);
+		control_free(control);
+		return r;
+	}
+	control->listen_fd = fd;
+	if (chmod(path, 0660) != 0 || listen(control->listen_fd, CONTROL_MAX_CLIENTS) != 0)
+		goto fail;
+
+	control->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (control->epfd < 0)
+		goto fail;
+	struct epoll_event ev = {.events = EPOLLIN, .data.u32 = CONTROL_LISTEN};
+	if (epoll_ctl(control->epfd, EPOLL_CTL_ADD, control->listen_fd, &ev) != 0)
+		goto fail;
+	return 0;
+
+fail:
+	r = -errno;
+	control_free(control);
+	return r;
+}
+
+static void drop(struct control* control, int i)
+{
+	epoll_ctl(control->epfd, EPOLL_CTL_DEL, control->clients[i], NULL);
+	close(control->clients[i]);
+	control->clients[i] = -1;
+}
+
+void control_free(struct control* control)
+{
+	for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i) {
+		if (control->clients[i] >= 0)
+			drop(control, i);
+	}
+	if (control->epfd >= 0) {
+		close(control->epfd);
+		control->epfd = -1;
+	}
+	if (control->listen_fd >= 0) {
+		close(control->listen_fd);
+		control->listen_fd = -1;
+		unlink(control->path);
+	}
+	free(control->path);
+	control->path = NULL;
+}
+
+int control_fd(const struct control* control)
+{
+	return control->epfd;
+}
+
+int control_parse(const char* text, size_t len, struct control_request* request)
+{
+	char buf[CONTROL_MESSAGE_MAX];
+	if (len >= sizeof(buf))
+		return -EINVAL;
+	memcpy(buf, text, len);
+	buf[len] = '\0';
+
+	char command[16];
+	char value[16];
+	char extra;
+	const int n = sscanf(buf, "%15s %15s %c", command, value, &extra);
+	if (n < 1 || n > 2)
+		return -EINVAL;
+
+	memset(request, 0, sizeof(struct control_request));
+	if (!strcmp(command, "query") && n == 1)
+		request->command = CONTROL_QUERY;
+	else
+	if (!strcmp(command, "resume") && n == 1)
+		request->command = CONTROL_RESUME;
+	else
+	if ((!strcmp(command, "override") || !strcmp(command, "inhibit")) && n == 2) {
+		char *end = NULL;
+		errno = 0;
+		const unsigned long v = strtoul(value, &end, 10);
+		if (errno || *end || value[0] == '-' || v > UINT32_MAX)
+			return -EINVAL;
+		request->command = command[0] == 'o' ? CONTROL_OVERRIDE : CONTROL_INHIBIT;
+		request->value = v;
+	}
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static void accept_clients(struct control* control)
+{
+	for (;;) {
+		const int fd = accept4(control->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+		int i = 0;
+		while (i < CONTROL_MAX_CLIENTS && control->clients[i] >= 0)
+			i++;
+		struct epoll_event ev = {.events = EPOLLIN, .data.u32 = i + 1};
+		if (i == CONTROL_MAX_CLIENTS || epoll_ctl(control->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			control->rejected++;
+			close(fd);
+			continue;
+		}
+		control->clients[i] = fd;
+	}
+}
+
+/* Serve all queued requests of one client, returns number served or -1 if client is gone */
+static int serve(struct control* control, int i, control_handler_fn handler, void* priv)
+{
+	int served = 0;
+	for (;;) {
+		char msg[CONTROL_MESSAGE_MAX];
+		const ssize_t n = recv(control->clients[i], msg, sizeof(msg), MSG_DONTWAIT);
+		if (n < 0 && errno == EAGAIN)
+			return served;
+		if (n <= 0)
+			return -1;
+
+		char reply[CONTROL_MESSAGE_MAX];
+		struct control_request request;
+		int r = control_parse(msg, n, &request);
+		if (r == 0)
+			r = handler(priv, &request, reply, sizeof(reply));
+		if (r) {
+			control->errors++;
+			snprintf(reply, sizeof(reply), "error %s", strerror(-r));
+		}
+		control->requests++;
+		served++;
+		if (send(control->clients[i], reply, strlen(reply), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+			control->rejected++;
+			return -1;
+		}
+	}
+}
+
+int control_dispatch(struct control* control, control_handler_fn handler, void* priv)
+{
+	struct epoll_event events[CONTROL_MAX_CLIENTS + 1];
+	const int ready = epoll_wait(control->epfd, events, CONTROL_MAX_CLIENTS + 1, 0);
+	if (ready < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	int served = 0;
+	for (int e = 0; e < ready; ++e) {
+		if (events[e].data.u32 == CONTROL_LISTEN) {
+			accept_clients(control);
+			continue;
+		}
+		const int i = events[e].data.u32 - 1;
+		if (control->clients[i] < 0)
+			continue;
+		const int n = serve(control, i, handler, priv);
+		if (n < 0)
+			drop(control, i);
+		else
+			served += n;
+	}
+	return served;
+}
@@ -0,0 +1,71 @@
+#ifndef CONTROL__H__
+#define CONTROL__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Unix domain control socket of backlightctl.
+ * SOCK_SEQPACKET keeps message boundaries, one request per message and one reply for each:
+ *   query             "ok brightness N lux N overridden 0|1 timeout_ms N"
+ *   override STEP     Hold brightness at STEP until resume
+ *   inhibit SECONDS   Keep backlight on for SECONDS, wake it if off
+ *   resume            Back to automatic control
+ * Failed requests are answered with "error <reason>".
+ * Listening socket and clients are polled through one epoll fd, so the caller polls a single fd.
+ * Everything is non-blocking, a client not taking its reply is disconnected. */
+
+#define CONTROL_MAX_CLIENTS 32
+#define CONTROL_MESSAGE_MAX 128
+
+enum control_command {
+	CONTROL_QUERY,
+	CONTROL_OVERRIDE,
+	CONTROL_INHIBIT,
+	CONTROL_RESUME,
+};
+
+struct control_request {
+	enum control_command command;
+	uint32_t value;					// Step or seconds
+};
+
+/* Fill reply, up to len bytes including terminator, for a parsed request.
+ * Returns 0 on success or negative errno, then reply is replaced with an error. */
+typedef int (*control_handler_fn)(void* priv, const struct control_request* request, char* reply, size_t len);
+
+struct control {
+	char *path;
+	int listen_fd;
+	int epfd;
+	int clients[CONTROL_MAX_CLIENTS];	// -1 if free
+	unsigned long long requests;
+	unsigned long long errors;			// Invalid or failed requests
+	unsigned long long rejected;		// Clients refused or dropped
+};
+
+/* Returns 0 on success or negative errno.
+ * A stale socket at path is replaced, -EADDRINUSE if another instance is listening on it. */
+int control_init(struct control* control, const char* path);
+/* Close clients and remove socket */
+void control_free(struct control* control);
+
+/* Single fd to poll for new clients and requests */
+int control_fd(const struct control* control);
+
+/* Parse request text of len bytes, not necessarily terminated.
+ * Returns 0 on success or -EINVAL. */
+int control_parse(const char* text, size_t len, struct control_request* request);
+
+/* Accept pending clients and serve pending requests, never blocks.
+ * Returns number of requests served or negative errno. */
+int control_dispatch(struct control* control, control_handler_fn handler, void* priv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROL__H__ */
@@ -0,0 +1,51 @@
+#include <string.h>
+#include <errno.h>
+#include "debounce.h"
+
+int debounce_init(struct debounce* debounce, long long nearlevel, long long farlevel, unsigned int n, unsigned int m)
+{
+	if (m < 1 || m > DEBOUNCE_MAX_SAMPLES || n < 1 || n > m || farlevel > nearlevel)
+		return -EINVAL;
+	memset(debounce, 0, sizeof(struct debounce));
+	debounce->nearlevel = nearlevel;
+	debounce->farlevel = farlevel;
+	debounce->n = n;
+	debounce->m = m;
+	return 0;
+}
+
+int debounce_update(struct debounce* debounce, long long val)
+{
+	const uint32_t window = debounce->m < 32 ? (1U << debounce->m) - 1 : UINT32_MAX;
+	const int raw_near = val >= debounce->nearlevel ? 1 : 0;
+
+	debounce->near_history = ((debounce->near_history << 1) | (uint32_t) raw_near) & window;
+	debounce->far_history = ((debounce->far_history << 1) | (val < debounce->farlevel ? 1U : 0U)) & window;
+
+	int near = debounce->near;
+	if (!near && (unsigned int) __builtin_popcount(debounce->near_history) >= debounce->n)
+		near = 1;
+	else
+	if (near && (unsigned int) __builtin_popcount(debounce->far_history) >= debounce->n)
+		near = 0;
+
+	/* Readings before a change must not count towards the next one */
+	if (near != debounce->near) {
+		debounce->near = near;
+		debounce->transitions++;
+		debounce->near_history = 0;
+		debounce->far_history = 0;
+	}
+	if (raw_near != debounce->last_raw_near) {
+		debounce->last_raw_near = raw_near;
+		debounce->raw_transitions++;
+	}
+	return debounce->near;
+}
+
+unsigned long long debounce_spurious(const struct debounce* debounce)
+{
+	if (debounce->raw_transitions < debounce->transitions)
+		return 0;
+	return debounce->raw_transitions - debounce->transitions;
+}
@@ -0,0 +1,43 @@
+#ifndef DEBOUNCE__H__
+#define DEBOUNCE__H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEBOUNCE_MAX_SAMPLES 32
+
+/* Near/far state of a noisy level, such as a proximity reading.
+ * A reading at or above nearlevel counts as near, below farlevel as far, readings between keep the state.
+ * State changes when at least n of the last m readings since the previous change agree.
+ */
+struct debounce {
+	long long nearlevel;
+	long long farlevel;
+	unsigned int n;				// Readings required in window to change state
+	unsigned int m;				// Window size in readings, max DEBOUNCE_MAX_SAMPLES
+	uint32_t near_history;		// Bit set for each reading in window at or above nearlevel
+	uint32_t far_history;		// Bit set for each reading in window below farlevel
+	int near;					// Debounced state
+	int last_raw_near;			// Undebounced state of previous reading
+	unsigned long long raw_transitions;	// Undebounced state changes
+	unsigned long long transitions;		// Accepted state changes
+};
+
+/* Starts in far state.
+ * Returns 0 on success or -EINVAL if farlevel is above nearlevel or n of m is out of range. */
+int debounce_init(struct debounce* debounce, long long nearlevel, long long farlevel, unsigned int n, unsigned int m);
+
+/* Returns debounced state after reading val, 1 if near */
+int debounce_update(struct debounce* debounce, long long val);
+
+/* Raw state changes never accepted as a state change */
+unsigned long long debounce_spurious(const struct debounce* debounce);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEBOUNCE__H__ */
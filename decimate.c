@@ -0,0 +1,55 @@
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "decimate.h"
+
+int decimate_init(struct decimate* dec, double rate_hz, uint32_t period_ms)
+{
+	memset(dec, 0, sizeof(struct decimate));
+	if (period_ms == 0 || period_ms % DECIMATE_FLICKER_MS)
+		return -EINVAL;
+	const double factor = round(rate_hz * period_ms / 1000.0);
+	if (!(factor >= 1.0) || factor > UINT32_MAX)
+		return -EINVAL;
+	dec->factor = factor;
+	return 0;
+}
+
+/* Lanes are independent, letting the compiler use vector adds without target specific code */
+static int64_t sum(const int32_t* restrict in, size_t n)
+{
+	int64_t lanes[DECIMATE_LANES] = {0};
+	size_t i = 0;
+	for (; i + DECIMATE_LANES <= n; i += DECIMATE_LANES) {
+		for (size_t l = 0; l < DECIMATE_LANES; ++l)
+			lanes[l] += in[i + l];
+	}
+	int64_t total = 0;
+	for (; i < n; ++i)
+		total += in[i];
+	for (size_t l = 0; l < DECIMATE_LANES; ++l)
+		total += lanes[l];
+	return total;
+}
+
+size_t decimate_run(struct decimate* dec, const int32_t* in, size_t n, double* out, size_t max_out)
+{
+	size_t outputs = 0;
+	size_t i = 0;
+	while (i < n) {
+		size_t chunk = dec->factor - dec->count;
+		if (chunk > n - i)
+			chunk = n - i;
+		dec->sum += sum(&in[i], chunk);
+		dec->count += chunk;
+		i += chunk;
+		if (dec->count < dec->factor)
+			break;
+
+		if (max_out)
+			out[outputs < max_out ? outputs++ : max_out - 1] = (double) dec->sum / dec->factor;
+		dec->sum = 0;
+		dec->count = 0;
+	}
+	return outputs;
+}
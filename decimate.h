@@ -0,0 +1,38 @@
+#ifndef DECIMATE__H__
+#define DECIMATE__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Integrate and dump decimation of high rate sensor samples.
+ * A boxcar spanning whole periods of mains flicker has nulls at its frequency and harmonics,
+ * DECIMATE_FLICKER_MS covers 5 periods of 100 Hz and 6 periods of 120 Hz.
+ */
+
+#define DECIMATE_FLICKER_MS 50
+#define DECIMATE_LANES 8				// Partial sums kept apart so the compiler can vectorize
+
+struct decimate {
+	uint32_t factor;					// Input samples per output
+	uint32_t count;						// Input samples in current block
+	int64_t sum;						// Sum of current block
+};
+
+/* Average blocks of period_ms at rate_hz, period_ms must be a multiple of DECIMATE_FLICKER_MS.
+ * Returns 0 or -EINVAL if period isn't a multiple or less than one sample per block. */
+int decimate_init(struct decimate* dec, double rate_hz, uint32_t period_ms);
+
+/* Feed n samples, writing mean of each completed block to out.
+ * Blocks completed past max_out replace the last output, so the latest is kept.
+ * Returns number of outputs written. */
+size_t decimate_run(struct decimate* dec, const int32_t* in, size_t n, double* out, size_t max_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DECIMATE__H__ */
@@ -0,0 +1,65 @@
+#include <string.h>
+#include <errno.h>
+#include "edge.h"
+
+/* Return ts1 - ts2 in milliseconds */
+static long long diff_ms(const struct timespec* ts1, const struct timespec* ts2)
+{
+	return (ts1->tv_sec - ts2->tv_sec) * 1000LL + (ts1->tv_nsec - ts2->tv_nsec) / 1000000LL;
+}
+
+int edge_filter_init(struct edge_filter* filter, int coalesce_ms, int storm_edges, int hold_ms)
+{
+	if (coalesce_ms < 0 || storm_edges < 0 || hold_ms < 0)
+		return -EINVAL;
+	memset(filter, 0, sizeof(struct edge_filter));
+	filter->coalesce_ms = coalesce_ms;
+	filter->storm_edges = storm_edges;
+	filter->hold_ms = hold_ms;
+	return 0;
+}
+
+int edge_filter_timed(const struct edge_filter* filter)
+{
+	return filter->coalesce_ms || filter->storm_edges;
+}
+
+enum edge_result edge_filter_add(struct edge_filter* filter, const struct timespec* now)
+{
+	filter->edges++;
+	if (!edge_filter_timed(filter))
+		return EDGE_ACCEPTED;
+
+	if (filter->storm_edges && !filter->storm) {
+		if (diff_ms(now, &filter->window_start) >= EDGE_STORM_WINDOW_MS) {
+			filter->window_start = *now;
+			filter->window_edges = 0;
+		}
+		if (++filter->window_edges > filter->storm_edges) {
+			filter->storms++;
+			filter->storm = 1;
+			filter->storm_at = *now;
+			filter->last_edge = *now;
+			filter->last_edge_set = 1;
+			return EDGE_STORM;
+		}
+	}
+
+	if (filter->coalesce_ms && filter->last_edge_set && diff_ms(now, &filter->last_edge) < filter->coalesce_ms) {
+		filter->coalesced++;
+		return EDGE_COALESCED;
+	}
+	filter->last_edge = *now;
+	filter->last_edge_set = 1;
+	return EDGE_ACCEPTED;
+}
+
+int edge_filter_storm_over(struct edge_filter* filter, const struct timespec* now)
+{
+	if (!filter->storm || diff_ms(now, &filter->storm_at) < filter->hold_ms)
+		return 0;
+	filter->storm = 0;
+	filter->window_start = *now;
+	filter->window_edges = 0;
+	return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef EDGE__H__
+#define EDGE__H__
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EDGE_STORM_WINDOW_MS 1000		// Storm threshold is edges within this window
+
+/* Rate limiting of edges on an interrupt line.
+ * Edges arriving within coalesce_ms of an accepted edge are coalesced into it.
+ * More than storm_edges edges within EDGE_STORM_WINDOW_MS is a storm, the caller stops polling the line
+ * and samples its level until edge_filter_storm_over().
+ */
+struct edge_filter {
+	int coalesce_ms;				// 0 to disable
+	unsigned int storm_edges;		// 0 to disable
+	int hold_ms;					// Time masked after a storm
+	struct timespec last_edge;		// Last accepted edge
+	int last_edge_set;
+	struct timespec window_start;	// Start of current storm detection window
+	unsigned int window_edges;		// Edges in current storm detection window
+	struct timespec storm_at;		// Start of storm
+	int storm;						// Storm in progress
+	unsigned long long edges;
+	unsigned long long coalesced;
+	unsigned long long storms;
+};
+
+enum edge_result {
+	EDGE_ACCEPTED,					// Trigger
+	EDGE_COALESCED,					// Ignored, follows an accepted edge
+	EDGE_STORM,						// Starts a storm, trigger and stop polling the line
+};
+
+/* Returns 0 on success or -EINVAL if a value is negative */
+int edge_filter_init(struct edge_filter* filter, int coalesce_ms, int storm_edges, int hold_ms);
+
+/* Edges need a timestamp, otherwise every edge is accepted */
+int edge_filter_timed(const struct edge_filter* filter);
+
+/* Account edge at now, now is unused unless edge_filter_timed() */
+enum edge_result edge_filter_add(struct edge_filter* filter, const struct timespec* now);
+
+/* Returns 1 if storm has been held hold_ms at now, the line is then polled again */
+int edge_filter_storm_over(struct edge_filter* filter, const struct timespec* now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EDGE__H__ */
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "energy.h"
+
+void energy_init(struct energy* energy, uint32_t max_brightness_step, double base_watts, double step_watts)
+{
+	memset(energy, 0, sizeof(struct energy));
+	energy->max_brightness_step = max_brightness_step ? max_brightness_step : 1;
+	energy->base_watts = base_watts;
+	energy->step_watts = step_watts;
+}
+
+unsigned int energy_bucket(const struct energy* energy, uint32_t step)
+{
+	if (step == 0)
+		return 0;
+	if (step > energy->max_brightness_step)
+		step = energy->max_brightness_step;
+	return 1 + (uint64_t) (step - 1) * (ENERGY_STEP_BUCKETS - 1) / energy->max_brightness_step;
+}
+
+double energy_watts(const struct energy* energy, uint32_t step)
+{
+	if (step == 0)
+		return 0.0;
+	return energy->base_watts + energy->step_watts * step;
+}
+
+void energy_account(struct energy* energy, const struct timespec* now, uint32_t step)
+{
+	if (energy->since_set) {
+		const double elapsed = (now->tv_sec - energy->since.tv_sec) + (now->tv_nsec - energy->since.tv_nsec) / 1e9;
+		if (elapsed > 0.0) {
+			struct energy_counters *c = &energy->counters;
+			if (energy->step)
+				c->lit_seconds += elapsed;
+			else
+				c->dark_seconds += elapsed;
+			c->step_seconds += elapsed * energy->step;
+			c->bucket_seconds[energy_bucket(energy, energy->step)] += elapsed;
+			c->joules += elapsed * energy_watts(energy, energy->step);
+			c->full_joules += elapsed * energy_watts(energy, energy->max_brightness_step);
+		}
+	}
+	energy->step = step;
+	energy->since = *now;
+	energy->since_set = 1;
+}
@@ -0,0 +1,49 @@
+#ifndef ENERGY__H__
+#define ENERGY__H__
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Backlight on-time and energy accounting.
+ * Time is integrated from loop timestamps, no wakeups of its own.
+ * Counters are cumulative and meant to be persisted across restarts.
+ */
+
+/* Bucket 0 is backlight off, buckets 1 to 10 are tenths of the step range */
+#define ENERGY_STEP_BUCKETS 11
+
+struct energy_counters {
+	double lit_seconds;
+	double dark_seconds;
+	double step_seconds;							// Brightness step integrated over time
+	double bucket_seconds[ENERGY_STEP_BUCKETS];		// Time spent in each step bucket
+	double joules;									// Estimated backlight energy, 0 without power model
+	double full_joules;								// Estimate had backlight stayed at max step
+};
+
+struct energy {
+	struct energy_counters counters;
+	uint32_t max_brightness_step;
+	double base_watts;					// Power while lit at any step
+	double step_watts;					// Power added per brightness step
+	uint32_t step;						// Step since since
+	struct timespec since;
+	int since_set;
+};
+
+/* Without power model, watts 0, only time is accounted */
+void energy_init(struct energy* energy, uint32_t max_brightness_step, double base_watts, double step_watts);
+/* Account time at previous step until now and continue at step, call whenever step may have changed */
+void energy_account(struct energy* energy, const struct timespec* now, uint32_t step);
+unsigned int energy_bucket(const struct energy* energy, uint32_t step);
+double energy_watts(const struct energy* energy, uint32_t step);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENERGY__H__ */
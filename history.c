@@ -0,0 +1,452 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libbacklight.h"
+#include "history.h"
+
+static size_t put_varint(uint8_t* out, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80) {
+		out[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	out[n++] = v;
+	return n;
+}
+
+/* Returns bytes read or 0 if truncated or longer than 64 bits */
+static size_t get_varint(const uint8_t* in, size_t len, uint64_t* v)
+{
+	*v = 0;
+	for (size_t n = 0; n < len && n < 10; ++n) {
+		*v |= (uint64_t) (in[n] & 0x7f) << (7 * n);
+		if (!(in[n] & 0x80))
+			return n + 1;
+	}
+	return 0;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+size_t history_encode(uint8_t* out, const struct history_record* record, const struct history_record* last)
+{
+	size_t n = 0;
+	n += put_varint(&out[n], zigzag(record->minute - last->minute));
+	n += put_varint(&out[n], (uint64_t) record->triggers << 1 | (record->has_lux ? 1 : 0));
+	n += put_varint(&out[n], zigzag((int64_t) record->step - last->step));
+	if (record->has_lux) {
+		n += put_varint(&out[n], zigzag((int64_t) record->avg_lux - last->avg_lux));
+		n += put_varint(&out[n], record->avg_lux - record->min_lux);
+		n += put_varint(&out[n], record->max_lux - record->avg_lux);
+	}
+	return n;
+}
+
+size_t history_decode(const uint8_t* in, size_t len, struct history_record* record, const struct history_record* last)
+{
+	uint64_t v[6];
+	size_t n = 0;
+	for (int i = 0; i < 6; ++i) {
+		/* Lux fields only follow if flagged */
+		if (i == 3 && !(v[1] & 1))
+			break;
+		const size_t r = get_varint(&in[n], len - n, &v[i]);
+		if (r == 0)
+			return 0;
+		n += r;
+	}
+
+	memset(record, 0, sizeof(struct history_record));
+	record->minute = last->minute + unzigzag(v[0]);
+	if (v[1] >> 1 > UINT32_MAX)
+		return 0;
+	record->triggers = v[1] >> 1;
+	const int64_t step = (int64_t) last->step + unzigzag(v[2]);
+	if (step < 0 || step > UINT32_MAX)
+		return 0;
+	record->step = step;
+	if (v[1] & 1) {
+		const int64_t avg = (int64_t) last->avg_lux + unzigzag(v[3]);
+		if (avg < 0 || avg > UINT32_MAX || v[4] > (uint64_t) avg || v[5] > UINT32_MAX - (uint64_t) avg)
+			return 0;
+		record->has_lux = 1;
+		record->avg_lux = avg;
+		record->min_lux = avg - v[4];
+		record->max_lux = avg + v[5];
+	}
+	return n;
+}
+
+/* Base for record after record, avg lux carries over records without lux */
+static void advance(struct history_record* last, const struct history_record* record)
+{
+	const uint32_t avg = last->avg_lux;
+	*last = *record;
+	if (!record->has_lux)
+		last->avg_lux = avg;
+}
+
+static void page_base(struct history_record* last, const struct history_page* page)
+{
+	memset(last, 0, sizeof(struct history_record));
+	last->minute = page->minute;
+}
+
+/* Decode records of head page left by previous run, dropping anything after a damaged record */
+static void resume(struct history* history)
+{
+	struct history_page *page = &history->pages[history->header->head];
+	history->seq = page->seq;
+	page_base(&history->last, page);
+	if (page->used > sizeof(page->data))
+		page->used = sizeof(page->data);
+
+	uint32_t offset = 0;
+	uint16_t records = 0;
+	while (records < page->records) {
+		struct history_record record;
+		const size_t n = history_decode(&page->data[offset], page->used - offset, &record, &history->last);
+		if (n == 0)
+			break;
+		advance(&history->last, &record);
+		offset += n;
+		records++;
+	}
+	page->records = records;
+	page->used = offset;
+}
+
+int history_open(struct history* history, const char* path, uint32_t pages)
+{
+	memset(history, 0, sizeof(struct history));
+	if (pages == 0 || pages > HISTORY_MAX_PAGES)
+		return -EINVAL;
+
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	int r = 0;
+	struct history_header header;
+	const ssize_t n = pread(fd, &header, sizeof(header), 0);
+	struct stat st;
+	if (n < 0 || fstat(fd, &st) != 0)
+		goto fail;
+	/* Anything but an empty file or one of ours is left alone */
+	if (st.st_size > 0 && ((size_t) n < sizeof(header.magic) || header.magic != HISTORY_MAGIC)) {
+		close(fd);
+		return -EEXIST;
+	}
+	int valid = n == sizeof(header) && header.version == HISTORY_VERSION
+				&& header.page_size == HISTORY_PAGE_SIZE && header.pages > 0 && header.pages <= HISTORY_MAX_PAGES
+				&& header.head < header.pages
+				&& (uint64_t) st.st_size == ((uint64_t) header.pages + 1) * HISTORY_PAGE_SIZE;
+	if (valid) {
+		pages = header.pages;
+	}
+	else {
+		/* Start over with a zeroed file */
+		history->reset = st.st_size > 0;
+		if (ftruncate(fd, 0) != 0)
+			goto fail;
+	}
+	history->size = ((size_t) pages + 1) * HISTORY_PAGE_SIZE;
+	if (!valid && ftruncate(fd, history->size) != 0)
+		goto fail;
+
+	void *map = mmap(NULL, history->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	close(fd);
+	history->header = map;
+	history->pages = (struct history_page*) ((uint8_t*) map + HISTORY_PAGE_SIZE);
+
+	if (!valid) {
+		history->header->page_size = HISTORY_PAGE_SIZE;
+		history->header->pages = pages;
+		history->header->head = 0;
+		history->header->version = HISTORY_VERSION;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		history->header->magic = HISTORY_MAGIC;
+	}
+	resume(history);
+	return 0;
+
+fail:
+	r = -errno;
+	close(fd);
+	history->size = 0;
+	return r;
+}
+
+/* Start page after head for records from minute on */
+static void next_page(struct history* history, int64_t minute)
+{
+	struct history_header *header = history->header;
+	if (history->pages[header->head].seq != 0)
+		header->head = (header->head + 1) % header->pages;
+	struct history_page *page = &history->pages[header->head];
+
+	/* Readers skip the page until it's consistent again */
+	page->seq = 0;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	page->records = 0;
+	page->used = 0;
+	page->minute = minute;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	if (++history->seq == 0)
+		history->seq = 1;
+	page->seq = history->seq;
+	page_base(&history->last, page);
+}
+
+static void append(struct history* history, const struct history_record* record)
+{
+	struct history_page *page = &history->pages[history->header->head];
+	uint8_t buf[HISTORY_RECORD_MAX];
+	size_t n = 0;
+	if (page->seq != 0)
+		n = history_encode(buf, record, &history->last);
+	if (page->seq == 0 || page->used + n > sizeof(page->data) || page->records == UINT16_MAX) {
+		next_page(history, record->minute);
+		page = &history->pages[history->header->head];
+		n = history_encode(buf, record, &history->last);
+	}
+
+	memcpy(&page->data[page->used], buf, n);
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	page->used += n;
+	page->records++;
+	advance(&history->last, record);
+	history->records++;
+}
+
+static uint32_t dominant_step(const struct history* history)
+{
+	const struct history_minute *m = &history->current;
+	uint32_t step = history->step;
+	double longest = 0.0;
+	for (int i = 0; i < HISTORY_STEP_SLOTS; ++i) {
+		if (m->seconds[i] > longest) {
+			longest = m->seconds[i];
+			step = m->step[i];
+		}
+	}
+	return step;
+}
+
+void history_flush(struct history* history)
+{
+	if (!history->header || !history->current_set)
+		return;
+	const struct history_minute *m = &history->current;
+	struct history_record record;
+	memset(&record, 0, sizeof(record));
+	record.minute = m->minute;
+	record.step = dominant_step(history);
+	record.triggers = m->triggers;
+	if (m->readings) {
+		record.has_lux = 1;
+		record.min_lux = m->min_lux;
+		record.max_lux = m->max_lux;
+		record.avg_lux = m->lux_sum / m->readings;
+	}
+	append(history, &record);
+	history->current_set = 0;
+}
+
+void history_close(struct history* history)
+{
+	history_flush(history);
+	if (history->header) {
+		munmap(history->header, history->size);
+		history->header = NULL;
+		history->pages = NULL;
+	}
+}
+
+/* Time at step until t goes to one of the minute's slots, a step not fitting replaces the shortest */
+static void account(struct history* history, const struct timespec* t)
+{
+	if (!history->since_set)
+		return;
+	const double elapsed = (t->tv_sec - history->since.tv_sec) + (t->tv_nsec - history->since.tv_nsec) / 1e9;
+	history->since = *t;
+	if (elapsed <= 0.0)
+		return;
+
+	struct history_minute *m = &history->current;
+	int slot = -1;
+	for (int i = 0; i < HISTORY_STEP_SLOTS && slot < 0; ++i) {
+		if (m->seconds[i] > 0.0 && m->step[i] == history->step)
+			slot = i;
+	}
+	if (slot < 0) {
+		slot = 0;
+		for (int i = 1; i < HISTORY_STEP_SLOTS; ++i) {
+			if (m->seconds[i] < m->seconds[slot])
+				slot = i;
+		}
+		m->step[slot] = history->step;
+		m->seconds[slot] = 0.0;
+	}
+	m->seconds[slot] += elapsed;
+}
+
+static void start_minute(struct history* history, int64_t minute)
+{
+	memset(&history->current, 0, sizeof(struct history_minute));
+	history->current.minute = minute;
+	history->current.min_lux = UINT32_MAX;
+	history->current_set = 1;
+}
+
+void history_add(struct history* history, const struct timespec* now, uint32_t lux, uint32_t step, int triggered)
+{
+	if (!history->header)
+		return;
+
+	const int64_t minute = now->tv_sec / 60;
+	if (history->current_set && minute != history->current.minute) {
+		/* Time up to end of minute belongs to it, unless clock went back */
+		const int later = minute > history->current.minute;
+		if (later) {
+			const struct timespec end = {(history->current.minute + 1) * 60, 0};
+			account(history, &end);
+		}
+		history_flush(history);
+		if (later && history->since_set)
+			history->since = (struct timespec) {minute * 60, 0};
+	}
+	if (!history->current_set)
+		start_minute(history, minute);
+
+	account(history, now);
+	history->since = *now;
+	history->since_set = 1;
+	history->step = step;
+
+	struct history_minute *m = &history->current;
+	if (lux != LIBBACKLIGHT_LUX_INVALID) {
+		m->min_lux = lux < m->min_lux ? lux : m->min_lux;
+		m->max_lux = lux > m->max_lux ? lux : m->max_lux;
+		m->lux_sum += lux;
+		m->readings++;
+	}
+	if (triggered)
+		m->triggers++;
+}
+
+int history_load_energy(const struct history* history, struct energy_counters* energy)
+{
+	const struct history_header *header = history->header;
+	if (header->energy_seq & 1)
+		return -EINVAL;
+	memcpy(energy, &header->energy, sizeof(struct energy_counters));
+	return 0;
+}
+
+void history_store_energy(struct history* history, const struct energy_counters* energy)
+{
+	struct history_header *header = history->header;
+	/* Forced odd rather than incremented, a store interrupted by a crash is not left odd forever */
+	const uint32_t seq = header->energy_seq | 1;
+	header->energy_seq = seq;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	memcpy(&header->energy, energy, sizeof(struct energy_counters));
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	header->energy_seq = seq + 1;
+}
+
+int history_reader_open(struct history_reader* reader, const char* path)
+{
+	memset(reader, 0, sizeof(struct history_reader));
+	reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (reader->fd < 0)
+		return -errno;
+
+	struct history_header header;
+	const ssize_t n = pread(reader->fd, &header, sizeof(header), 0);
+	if (n < 0) {
+		const int r = -errno;
+		history_reader_close(reader);
+		return r;
+	}
+	if (n != sizeof(header) || header.magic != HISTORY_MAGIC || header.version != HISTORY_VERSION
+		|| header.page_size != HISTORY_PAGE_SIZE || header.pages == 0 || header.head >= header.pages) {
+		history_reader_close(reader);
+		return -EINVAL;
+	}
+	reader->pages = header.pages;
+	reader->head = header.head;
+	return 0;
+}
+
+void history_reader_close(struct history_reader* reader)
+{
+	if (reader->fd >= 0)
+		close(reader->fd);
+	reader->fd = -1;
+}
+
+/* Load next page in ring order after head, which is oldest.
+ * Returns 1 if loaded, 0 if all pages visited or negative errno. */
+static int next_page_read(struct history_reader* reader)
+{
+	while (reader->visited < reader->pages) {
+		const uint32_t index = (reader->head + 1 + reader->visited) % reader->pages;
+		reader->visited++;
+		const ssize_t n = pread(reader->fd, &reader->page, sizeof(reader->page),
+								((off_t) index + 1) * HISTORY_PAGE_SIZE);
+		if (n < 0)
+			return -errno;
+		if (n != sizeof(reader->page))
+			return 0;
+		/* Unused, or reused by writer since reading started */
+		if (reader->page.seq == 0 || reader->page.seq <= reader->last_seq)
+			continue;
+		reader->last_seq = reader->page.seq;
+		if (reader->page.used > sizeof(reader->page.data))
+			reader->page.used = sizeof(reader->page.data);
+		reader->offset = 0;
+		reader->record = 0;
+		page_base(&reader->last, &reader->page);
+		return 1;
+	}
+	return 0;
+}
+
+int history_reader_next(struct history_reader* reader, struct history_record* record)
+{
+	for (;;) {
+		const struct history_page *page = &reader->page;
+		if (page->seq && reader->record < page->records) {
+			const size_t n = history_decode(&page->data[reader->offset], page->used - reader->offset, record,
+											&reader->last);
+			if (n) {
+				advance(&reader->last, record);
+				reader->offset += n;
+				reader->record++;
+				return 1;
+			}
+		}
+		const int r = next_page_read(reader);
+		if (r <= 0) {
+			reader->page.seq = 0;
+			return r;
+		}
+	}
+}
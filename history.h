@@ -0,0 +1,146 @@
+#ifndef HISTORY__H__
+#define HISTORY__H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "energy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Long term history of lux and brightness, one record per wall clock minute.
+ * Memory mapped file of a header page followed by a ring of fixed size pages, the oldest page is reused
+ * when the newest is full. Appending only writes to the mapping, the kernel writes dirty pages back on
+ * its own schedule, so flash sees about one page write per writeback interval.
+ *
+ * Each page decodes on its own. Records are varints of differences to the previous record in the page:
+ *   minutes since previous record, zigzag (0 for first record of page, its minute is in page header)
+ *   triggers << 1 | has lux
+ *   dominant step, zigzag difference
+ *   if has lux: avg lux as zigzag difference to previous avg, avg - min, max - avg
+ * A page's record count is updated after its bytes, a crash loses at most the record being written.
+ * Minutes without loop iterations have no record, brightness didn't change during them.
+ * The header page also holds cumulative energy counters, so they survive reboots unlike a state file on tmpfs.
+ */
+
+#define HISTORY_MAGIC 0x424c4853 // "BLHS"
+#define HISTORY_VERSION 1
+#define HISTORY_PAGE_SIZE 4096
+#define HISTORY_DEFAULT_PAGES 128		// 512 KiB, about 5 weeks at typical 6 to 8 bytes per minute
+#define HISTORY_MAX_PAGES 65536			// 256 MiB, keeps mapping size within 32 bit size_t
+#define HISTORY_STEP_SLOTS 8			// Distinct steps timed per minute for dominant step
+#define HISTORY_RECORD_MAX 40			// Encoded record size limit
+
+struct history_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t page_size;
+	uint32_t pages;					// Pages in ring, not counting header
+	uint32_t head;					// Page appended to
+	uint32_t energy_seq;			// Odd while energy is updated, zero in files written before it was kept
+	struct energy_counters energy;
+	uint8_t pad[HISTORY_PAGE_SIZE - 6 * sizeof(uint32_t) - sizeof(struct energy_counters)];
+};
+
+struct history_page {
+	uint32_t seq;					// Increasing over pages written, 0 if unused
+	uint16_t records;
+	uint16_t used;					// Bytes of data holding records
+	int64_t minute;					// First record, minutes since epoch
+	uint8_t data[HISTORY_PAGE_SIZE - 16];
+};
+
+/* Decoded record */
+struct history_record {
+	int64_t minute;					// Minutes since epoch
+	uint32_t step;					// Brightness step held longest in the minute
+	uint32_t triggers;
+	int has_lux;					// Lux fields valid, no readings while sensor suspended
+	uint32_t min_lux;
+	uint32_t avg_lux;
+	uint32_t max_lux;
+};
+
+/* Minute being aggregated, not yet in file */
+struct history_minute {
+	int64_t minute;
+	uint32_t min_lux;
+	uint32_t max_lux;
+	uint64_t lux_sum;
+	uint32_t readings;
+	uint32_t triggers;
+	uint32_t step[HISTORY_STEP_SLOTS];
+	double seconds[HISTORY_STEP_SLOTS];	// Time at step, 0 if slot is free
+};
+
+struct history {
+	struct history_header *header;
+	struct history_page *pages;
+	size_t size;					// Bytes mapped
+	struct history_minute current;
+	int current_set;
+	uint32_t step;					// Step since since
+	struct timespec since;
+	int since_set;
+	uint32_t seq;					// Of head page
+	struct history_record last;		// Base of next record in head page
+	unsigned long long records;		// Appended since open
+	int reset;						// Open started over a history of another version or a damaged header
+};
+
+/* Open path, created with pages if it doesn't exist or is empty.
+ * An existing valid file keeps its own number of pages. A history of another version or with a damaged header
+ * is started over with pages and reset is set.
+ * Returns 0 on success, -EEXIST if path is a non-empty file which isn't a history, -EINVAL if pages is 0 or above
+ * HISTORY_MAX_PAGES or other negative errno. */
+int history_open(struct history* history, const char* path, uint32_t pages);
+/* Appends minute in progress */
+void history_close(struct history* history);
+
+/* Account loop iteration at wall clock now.
+ * lux is a reading taken now or LIBBACKLIGHT_LUX_INVALID, step the brightness from now on.
+ * Records are appended when a minute has passed, no system calls are made. */
+void history_add(struct history* history, const struct timespec* now, uint32_t lux, uint32_t step, int triggered);
+
+/* Append minute in progress now instead of when it's over */
+void history_flush(struct history* history);
+
+/* Cumulative energy counters kept in header.
+ * Returns 0 on success or -EINVAL if an update was interrupted. */
+int history_load_energy(const struct history* history, struct energy_counters* energy);
+/* Only writes to mapping, store periodically to keep header page writeback rare */
+void history_store_energy(struct history* history, const struct energy_counters* energy);
+
+/* Streaming reader, one page in memory at a time, oldest record first */
+struct history_reader {
+	int fd;
+	uint32_t pages;
+	uint32_t head;
+	uint32_t visited;				// Pages read
+	uint32_t last_seq;				// Pages reused while reading are skipped
+	struct history_page page;
+	uint32_t offset;				// Next record in page
+	uint32_t record;
+	struct history_record last;
+};
+
+/* Returns 0 on success, negative errno or -EINVAL if not a history file */
+int history_reader_open(struct history_reader* reader, const char* path);
+void history_reader_close(struct history_reader* reader);
+/* Returns 1 with next record, 0 at end or negative errno */
+int history_reader_next(struct history_reader* reader, struct history_record* record);
+
+/* Encode record after last, for first record of page last is zero except minute of page.
+ * Returns bytes written, at most HISTORY_RECORD_MAX. */
+size_t history_encode(uint8_t* out, const struct history_record* record, const struct history_record* last);
+/* Decode record after last from len bytes.
+ * Returns bytes read or 0 if data is truncated or invalid. */
+size_t history_decode(const uint8_t* in, size_t len, struct history_record* record, const struct history_record* last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HISTORY__H__ */
@@ -0,0 +1,36 @@
+#include <errno.h>
+#include "iioscan.h"
+
+static void* iio_scan_run(void* arg)
+{
+	struct iio_scan *scan = arg;
+	errno = 0;
+	scan->ctx = scan->create();
+	scan->err = scan->ctx ? 0 : (errno ? -errno : -ENODEV);
+	return NULL;
+}
+
+int iio_scan_start(struct iio_scan* scan, struct iio_context* (*create)(void))
+{
+	if (scan->started || !create)
+		return -EINVAL;
+	scan->create = create;
+	scan->ctx = NULL;
+	scan->err = 0;
+	const int r = pthread_create(&scan->thread, NULL, iio_scan_run, scan);
+	if (r)
+		return -r;
+	scan->started = 1;
+	return 0;
+}
+
+int iio_scan_join(struct iio_scan* scan, struct iio_context** ctx)
+{
+	if (!scan->started)
+		return -EINVAL;
+	pthread_join(scan->thread, NULL);
+	scan->started = 0;
+	*ctx = scan->ctx;
+	scan->ctx = NULL;
+	return scan->err;
+}
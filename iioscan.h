@@ -0,0 +1,34 @@
+#ifndef IIOSCAN__H__
+#define IIOSCAN__H__
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct iio_context;
+
+/* Local context scans every iio device in sysfs, which dominates startup.
+ * It runs on a thread while backlight, interrupt and input are set up. */
+struct iio_scan {
+	pthread_t thread;
+	struct iio_context* (*create)(void);	// Sets errno and returns NULL on failure
+	struct iio_context *ctx;
+	int err;
+	int started;
+};
+
+/* Run create, normally iio_create_local_context, on a new thread.
+ * Returns 0 on success or negative errno. */
+int iio_scan_start(struct iio_scan* scan, struct iio_context* (*create)(void));
+
+/* Wait for scan, ctx is set on success.
+ * Returns 0, negative errno of create, -ENODEV if it gave none, or -EINVAL if not started. */
+int iio_scan_join(struct iio_scan* scan, struct iio_context** ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IIOSCAN__H__ */
@@ -0,0 +1,94 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include "trace.h"
+#include "input.h"
+
+#define INPUT_READ_EVENTS 64
+
+int input_open(struct input* input, const char* device)
+{
+	const int fd = open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (input->fd_set)
+		close(input->fd);
+	input->device = device;
+	input->fd = fd;
+	input->fd_set = 1;
+
+	int clk = CLOCK_MONOTONIC;
+	input->kernel_time = ioctl(input->fd, EVIOCSCLOCKID, &clk) == 0 ? 1 : 0;
+	return 0;
+}
+
+void input_free(struct input* input)
+{
+	if (!input)
+		return;
+	if (input->fd_set) {
+		close(input->fd);
+		input->fd = -1;
+		input->fd_set = 0;
+	}
+}
+
+int input_fd(const struct input* input, int* fd)
+{
+	if (!input)
+		return -EINVAL;
+	if (!input->fd_set || input->fd < 0)
+		return -EBADF;
+	*fd = input->fd;
+	return 0;
+}
+
+uint32_t input_events(const struct input* input)
+{
+	(void) input;
+	return EPOLLIN;
+}
+
+int input_get(const struct input* input, int* trigger, struct timespec* ts)
+{
+	if (!input || !trigger || !ts)
+		return -EINVAL;
+	if (!input->fd_set || input->fd < 0)
+		return -EBADF;
+
+	struct input_event events[INPUT_READ_EVENTS];
+	*trigger = 0;
+	while (1) {
+		const ssize_t bytes = read(input->fd, events, sizeof(events));
+		if (bytes < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (bytes == 0)
+			return -EPIPE;
+		if (bytes % sizeof(struct input_event) != 0)
+			return -EIO;
+
+		const size_t count = bytes / sizeof(struct input_event);
+		for (size_t i = 0; i < count; ++i) {
+			if (events[i].type == EV_SYN)
+				continue;
+			*trigger = 1;
+			if (input->kernel_time) {
+				ts->tv_sec = events[i].input_event_sec;
+				ts->tv_nsec = events[i].input_event_usec * 1000L;
+			}
+		}
+		TRACE2(backlightctl, input_read, count, *trigger);
+		if (count < INPUT_READ_EVENTS)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef INPUT__H__
+#define INPUT__H__
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Trigger from an evdev device, for example /dev/input/event0.
+ * Any file delivering struct input_event, such as a pipe, may be used,
+ * but then event timestamps are ignored. */
+struct input {
+	const char *device;
+	int fd;
+	int fd_set;
+	int kernel_time;	// Event timestamps are CLOCK_MONOTONIC
+};
+
+/* Open device, non-blocking, replacing fd if already open.
+ * Returns 0 on success or negative errno. */
+int input_open(struct input* input, const char* device);
+void input_free(struct input* input);
+
+/* Returns 0 on success or negative errno */
+int input_fd(const struct input* input, int* fd);
+/* epoll events to wait for on fd */
+uint32_t input_events(const struct input* input);
+
+/* Drain all pending events.
+ * trigger is set if any event other than EV_SYN was read.
+ * ts is set to time of latest such event if kernel timestamps are available, otherwise left untouched.
+ * Returns 0 on success, -EPIPE if writer is gone, -EIO on partial event or negative errno. */
+int input_get(const struct input* input, int* trigger, struct timespec* ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INPUT__H__ */
@@ -2,16 +2,35 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
-#include "ringbuf.h"
+#include <errno.h>
+#include "quantile.h"
+#include "trace.h"
 #include "libbacklight.h"
 
 struct libbacklight_ctrl {
 	struct libbacklight_conf conf;
 	struct timespec last_trigger;	// Last time trigger received
-	struct ringbuf *sensor_ring;	// Ringbuffer for sensor readings
-	uint64_t sensor_sum;			// Sum of ringbuffer values
+	/* Sensor windows as struct of arrays, a row holds one reading per sensor */
+	uint32_t sensors;				// Number of sensors
+	uint32_t window;				// Rows, readings per sensor
+	uint32_t oldest;				// Row overwritten by next reading
+	uint32_t *samples;				// window * sensors readings
+	uint64_t *sums;					// Sum of each sensor's window
+	uint32_t *failures;				// Consecutive failed readings of each sensor
+	uint32_t *weights;				// Weight of each sensor, at least 1
+	int32_t *beyond;				// Consecutive readings of each sensor beyond step_ratio, negative if below
+	uint32_t steps;					// Window resets by step_ratio
+	uint32_t lux;					// Fused average of sensor windows
+	uint32_t min_lux;				// Lux mapped to step 1, adapted if auto range
+	uint32_t max_lux;				// Lux mapped to max step, adapted if auto range
 	uint32_t lux_per_step;			// lux per brightness step
+	struct quantile lux_low;		// Estimate of auto_min_percentile
+	struct quantile lux_high;		// Estimate of auto_max_percentile
+	uint32_t auto_range_left;		// Sensor readings until next adaption
 	uint32_t brightness_step; 		// Brightness now
+	int overridden;					// Brightness held at override_step, brightness_step kept up to date
+	uint32_t override_step;
+	struct timespec inhibit_until;	// Trigger timeout doesn't turn backlight off before this
 };
 
 static uint32_t lux_per_step(uint32_t min_lux, uint32_t max_lux, uint32_t max_steps)
@@ -41,6 +60,208 @@ static uint32_t lux_to_step(uint32_t min_lux, uint32_t max_step, uint32_t lux_pe
 	return step;
 }
 
+/* Fill all sensor windows with lux */
+static void fill(struct libbacklight_ctrl* bctl, uint32_t lux)
+{
+	for (uint32_t i = 0; i < bctl->window * bctl->sensors; ++i)
+		bctl->samples[i] = lux;
+	for (uint32_t s = 0; s < bctl->sensors; ++s) {
+		bctl->sums[s] = (uint64_t) lux * bctl->window;
+		bctl->failures[s] = 0;
+		bctl->beyond[s] = 0;
+	}
+	bctl->oldest = 0;
+	bctl->lux = lux;
+}
+
+/* Replace oldest row with lux, one per sensor. Failed readings hold previous reading. */
+/* Fill sensor's whole window with value */
+static void fill_sensor(struct libbacklight_ctrl* bctl, uint32_t s, uint32_t value)
+{
+	for (uint32_t i = 0; i < bctl->window; ++i)
+		bctl->samples[i * bctl->sensors + s] = value;
+	bctl->sums[s] = (uint64_t) value * bctl->window;
+	bctl->failures[s] = 0;
+}
+
+static void push(struct libbacklight_ctrl* bctl, const uint32_t* lux)
+{
+	const uint32_t n = bctl->sensors;
+	/* A window without real readings starts from the first one, not averaged with what it was padded with */
+	for (uint32_t s = 0; s < n; ++s) {
+		if (lux[s] != LIBBACKLIGHT_LUX_INVALID && bctl->failures[s] >= bctl->window)
+			fill_sensor(bctl, s, lux[s]);
+	}
+	uint32_t *restrict row = &bctl->samples[bctl->oldest * n];
+	const uint32_t *restrict prev = &bctl->samples[((bctl->oldest + bctl->window - 1) % bctl->window) * n];
+	uint64_t *restrict sums = bctl->sums;
+	uint32_t *restrict failures = bctl->failures;
+	for (uint32_t s = 0; s < n; ++s) {
+		const int failed = lux[s] == LIBBACKLIGHT_LUX_INVALID;
+		const uint32_t value = failed ? prev[s] : lux[s];
+		sums[s] = sums[s] - row[s] + value;
+		row[s] = value;
+		failures[s] = failed ? failures[s] + 1 : 0;
+	}
+	bctl->oldest = (bctl->oldest + 1) % bctl->window;
+}
+
+/* Change point detection against each sensor's window average.
+ * A sensor far off its average in the same direction for step_samples readings has its window filled with the reading,
+ * so a jump is followed at once instead of after a whole window. */
+static void step(struct libbacklight_ctrl* bctl, const uint32_t* lux)
+{
+	const uint64_t ratio = bctl->conf.step_ratio;
+	const int32_t required = bctl->conf.step_samples ? bctl->conf.step_samples : 1;
+	const uint32_t n = bctl->sensors;
+	for (uint32_t s = 0; s < n; ++s) {
+		if (lux[s] == LIBBACKLIGHT_LUX_INVALID)
+			continue;
+		const uint64_t avg = bctl->sums[s] / bctl->window + 1;
+		const uint64_t val = (uint64_t) lux[s] + 1;
+		if (val > avg * ratio)
+			bctl->beyond[s] = bctl->beyond[s] > 0 ? bctl->beyond[s] + 1 : 1;
+		else
+		if (val * ratio < avg)
+			bctl->beyond[s] = bctl->beyond[s] < 0 ? bctl->beyond[s] - 1 : -1;
+		else
+			bctl->beyond[s] = 0;
+		if (bctl->beyond[s] < required && -bctl->beyond[s] < required)
+			continue;
+
+		fill_sensor(bctl, s, lux[s]);
+		bctl->beyond[s] = 0;
+		bctl->steps++;
+		TRACE2(libbacklight, step_reset, s, lux[s]);
+	}
+}
+
+static void sort(uint32_t* v, uint32_t n)
+{
+	for (uint32_t i = 1; i < n; ++i) {
+		const uint32_t x = v[i];
+		uint32_t j = i;
+		for (; j > 0 && v[j - 1] > x; --j)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+static uint32_t median(const uint32_t* v, uint32_t n)
+{
+	uint32_t sorted[LIBBACKLIGHT_MAX_SENSORS];
+	memcpy(sorted, v, n * sizeof(uint32_t));
+	sort(sorted, n);
+	if (n % 2)
+		return sorted[n / 2];
+	return ((uint64_t) sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/* Combine window averages of working sensors into one lux.
+ * Keeps previous value if every sensor has failed a whole window. */
+static uint32_t fuse(const struct libbacklight_ctrl* bctl)
+{
+	uint32_t avg[LIBBACKLIGHT_MAX_SENSORS];
+	uint32_t weight[LIBBACKLIGHT_MAX_SENSORS];
+	uint32_t n = 0;
+	for (uint32_t s = 0; s < bctl->sensors; ++s) {
+		if (bctl->failures[s] >= bctl->window)
+			continue;
+		avg[n] = bctl->sums[s] / bctl->window;
+		weight[n] = bctl->weights[s];
+		n++;
+	}
+	if (n == 0)
+		return bctl->lux;
+	if (n == 1)
+		return avg[0];
+
+	/* Outliers can only be told apart with a majority */
+	if (bctl->conf.fault_ratio && n >= 3) {
+		const uint64_t med = median(avg, n);
+		const uint64_t ratio = bctl->conf.fault_ratio;
+		uint32_t kept = 0;
+		for (uint32_t i = 0; i < n; ++i) {
+			if ((uint64_t) avg[i] * ratio < med || avg[i] > med * ratio)
+				continue;
+			avg[kept] = avg[i];
+			weight[kept] = weight[i];
+			kept++;
+		}
+		/* Guarded by validate(), but an empty set must not reach fusion */
+		if (kept == 0) {
+			avg[0] = med;
+			weight[0] = 1;
+			kept = 1;
+		}
+		n = kept;
+	}
+
+	switch (bctl->conf.fusion) {
+	case LIBBACKLIGHT_FUSION_MAX: {
+		uint32_t max = 0;
+		for (uint32_t i = 0; i < n; ++i)
+			max = avg[i] > max ? avg[i] : max;
+		return max;
+	}
+	case LIBBACKLIGHT_FUSION_MEDIAN:
+		return median(avg, n);
+	case LIBBACKLIGHT_FUSION_MEAN:
+	default: {
+		uint64_t sum = 0;
+		uint64_t weights = 0;
+		for (uint32_t i = 0; i < n; ++i) {
+			sum += (uint64_t) avg[i] * weight[i];
+			weights += weight[i];
+		}
+		return sum / weights;
+	}
+	}
+}
+
+static int validate(const struct libbacklight_conf* conf)
+{
+	if (conf->max_brightness_step == 0 || conf->initial_brightness_step == 0)
+		return -EINVAL;
+	if (conf->enable_trigger && conf->trigger_timeout.tv_sec == 0 && conf->trigger_timeout.tv_nsec == 0)
+		return -EINVAL;
+	if (!conf->enable_sensor)
+		return 0;
+	if (conf->max_lux < 1 || conf->min_lux > conf->max_lux)
+		return -EINVAL;
+	/* Every step must cover at least one lux, lux_to_step() divides by it */
+	if (conf->max_lux - conf->min_lux < (conf->max_brightness_step > 1 ? conf->max_brightness_step - 1 : 1))
+		return -EINVAL;
+	if (conf->sensor_window > LIBBACKLIGHT_STATE_MAX_SAMPLES || conf->sensors > LIBBACKLIGHT_MAX_SENSORS)
+		return -EINVAL;
+	if (conf->fusion != LIBBACKLIGHT_FUSION_MEAN && conf->fusion != LIBBACKLIGHT_FUSION_MAX
+		&& conf->fusion != LIBBACKLIGHT_FUSION_MEDIAN)
+		return -EINVAL;
+	/* Ratio 1 would reset the window on every increase */
+	if (conf->step_ratio == 1 || conf->step_samples > INT32_MAX)
+		return -EINVAL;
+	/* Ratio 1 keeps only sensors equal to the median, none with an even count */
+	if (conf->fault_ratio == 1)
+		return -EINVAL;
+	if (conf->enable_auto_range &&
+		(conf->auto_min_percentile >= conf->auto_max_percentile || conf->auto_max_percentile > 100))
+		return -EINVAL;
+	return 0;
+}
+
+/* Lux mapping and auto range derived from conf */
+static void set_range(struct libbacklight_ctrl* bctl, const struct libbacklight_conf* conf)
+{
+	if (conf->enable_auto_range) {
+		quantile_init(&bctl->lux_low, conf->auto_min_percentile / 100.0);
+		quantile_init(&bctl->lux_high, conf->auto_max_percentile / 100.0);
+		bctl->auto_range_left = conf->auto_range_interval ? conf->auto_range_interval : LIBBACKLIGHT_DEFAULT_AUTO_RANGE_INTERVAL;
+	}
+	bctl->min_lux = conf->min_lux;
+	bctl->max_lux = conf->max_lux;
+	bctl->lux_per_step = lux_per_step(conf->min_lux, conf->max_lux, conf->max_brightness_step);
+}
+
 struct libbacklight_ctrl* create_libbacklight(const struct timespec* ts, const struct libbacklight_conf* conf)
 {
 	struct libbacklight_ctrl *bctl = (struct libbacklight_ctrl*) malloc(sizeof(struct libbacklight_ctrl));
@@ -49,27 +270,27 @@ struct libbacklight_ctrl* create_libbacklight(const struct timespec* ts, const s
 
 	memset(bctl, 0, sizeof(struct libbacklight_ctrl));
 
-	if (conf->max_brightness_step == 0 || conf->initial_brightness_step == 0)
+	if (validate(conf))
 		goto error_exit;
 
-	if (conf->enable_trigger) {
-		if (conf->trigger_timeout.tv_sec == 0 && conf->trigger_timeout.tv_nsec == 0)
-			goto error_exit;
+	if (conf->enable_trigger)
 		memcpy(&bctl->last_trigger, ts, sizeof(struct timespec));
-	}
 
 	if (conf->enable_sensor) {
-		if (conf->max_lux < 1 || conf->min_lux > conf->max_lux)
-			goto error_exit;
-		bctl->sensor_ring = create_ringbuf(10);
-		if (!bctl->sensor_ring)
+		bctl->sensors = conf->sensors ? conf->sensors : 1;
+		bctl->window = conf->sensor_window ? conf->sensor_window : LIBBACKLIGHT_DEFAULT_WINDOW;
+		bctl->samples = calloc(bctl->window * bctl->sensors, sizeof(uint32_t));
+		bctl->sums = calloc(bctl->sensors, sizeof(uint64_t));
+		bctl->failures = calloc(bctl->sensors, sizeof(uint32_t));
+		bctl->weights = calloc(bctl->sensors, sizeof(uint32_t));
+		bctl->beyond = calloc(bctl->sensors, sizeof(int32_t));
+		if (!bctl->samples || !bctl->sums || !bctl->failures || !bctl->weights || !bctl->beyond)
 			goto error_exit;
-		bctl->lux_per_step = lux_per_step(conf->min_lux, conf->max_lux, conf->max_brightness_step);
+		for (uint32_t s = 0; s < bctl->sensors; ++s)
+			bctl->weights[s] = conf->sensor_weight[s] ? conf->sensor_weight[s] : 1;
+		set_range(bctl, conf);
 		const uint32_t initial_lux = step_to_lux(conf->min_lux, conf->max_lux, bctl->lux_per_step, conf->initial_brightness_step);
-		for (size_t i = 0; i < ringbuf_capacity(bctl->sensor_ring); ++i) {
-			ringbuf_push(bctl->sensor_ring, initial_lux);
-			bctl->sensor_sum += initial_lux;
-		}
+		fill(bctl, initial_lux);
 	}
 
 	memcpy(&bctl->conf, conf, sizeof(struct libbacklight_conf));
@@ -86,8 +307,11 @@ error_exit:
 void destroy_libbacklight(struct libbacklight_ctrl** bctl)
 {
 	if (*bctl) {
-		if ((*bctl)->sensor_ring)
-			destroy_ringbuf(&(*bctl)->sensor_ring);
+		free((*bctl)->samples);
+		free((*bctl)->sums);
+		free((*bctl)->failures);
+		free((*bctl)->weights);
+		free((*bctl)->beyond);
 		free(*bctl);
 		*bctl = NULL;
 	}
@@ -114,20 +338,55 @@ static int timespec_cmp(const struct timespec* ts1, const struct timespec* ts2)
 	return ts1->tv_sec > ts2->tv_sec ? 1 : -1;
 }
 
-enum libbacklight_action libbacklight_operate(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered, uint32_t lux)
+static enum libbacklight_action trigger(struct libbacklight_ctrl* bctl, const struct timespec* ts)
+{
+	if (timespec_cmp(ts, &bctl->last_trigger) >= 0)
+		memcpy(&bctl->last_trigger, ts, sizeof(struct timespec));
+	if (bctl->brightness_step == 0) {
+		bctl->brightness_step = bctl->conf.initial_brightness_step;
+		return LIBBACKLIGHT_BRIGHTNESS;
+	}
+	return LIBBACKLIGHT_NONE;
+}
+
+enum libbacklight_action libbacklight_trigger(struct libbacklight_ctrl* bctl, const struct timespec* ts)
+{
+	if (!bctl->conf.enable_trigger)
+		return LIBBACKLIGHT_NONE;
+	const enum libbacklight_action ac = trigger(bctl, ts);
+	return bctl->overridden ? LIBBACKLIGHT_NONE : ac;
+}
+
+/* Remap lux range to current percentile estimates.
+ * Range is widened if needed so each step covers at least 1 lux. */
+static void auto_range(struct libbacklight_ctrl* bctl)
+{
+	const double low = quantile_get(&bctl->lux_low);
+	const double high = quantile_get(&bctl->lux_high);
+	const uint32_t span = bctl->conf.max_brightness_step > 1 ? bctl->conf.max_brightness_step - 1 : 1;
+	const uint32_t min_lux = low < UINT32_MAX - span ? (uint32_t) (low + 0.5) : UINT32_MAX - span;
+	uint32_t max_lux = high < UINT32_MAX ? (uint32_t) (high + 0.5) : UINT32_MAX;
+	if (max_lux < min_lux + span)
+		max_lux = min_lux + span;
+
+	bctl->min_lux = min_lux;
+	bctl->max_lux = max_lux;
+	bctl->lux_per_step = lux_per_step(min_lux, max_lux, bctl->conf.max_brightness_step);
+}
+
+/* lux is NULL if no new sensor reading, otherwise one reading per sensor */
+static enum libbacklight_action operate(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered, const uint32_t* lux)
 {
 	enum libbacklight_action ac = LIBBACKLIGHT_NONE;
 
+	TRACE3(libbacklight, operate_entry, triggered, lux != NULL, lux ? lux[0] : 0);
+
 	if (bctl->conf.enable_trigger) {
 		if (triggered) {
-			memcpy(&bctl->last_trigger, ts, sizeof(struct timespec));
-			if (bctl->brightness_step == 0) {
-				bctl->brightness_step = bctl->conf.initial_brightness_step;
-				ac = LIBBACKLIGHT_BRIGHTNESS;
-			}
+			ac = trigger(bctl, ts);
 		}
 		else
-		if (bctl->brightness_step > 0) {
+		if (bctl->brightness_step > 0 && timespec_cmp(ts, &bctl->inhibit_until) >= 0) {
 			const struct timespec since_last = timespec_sub(&bctl->last_trigger, ts);
 			if (timespec_cmp(&bctl->conf.trigger_timeout, &since_last) <= 0) {
 				bctl->brightness_step = 0;
@@ -137,16 +396,31 @@ enum libbacklight_action libbacklight_operate(struct libbacklight_ctrl* bctl, co
 	}
 
 	if (bctl->conf.enable_sensor) {
-		bctl->sensor_sum -= ringbuf_pop(bctl->sensor_ring);
-		bctl->sensor_sum += lux;
-		ringbuf_push(bctl->sensor_ring, lux);
+		if (lux) {
+			if (bctl->conf.step_ratio)
+				step(bctl, lux);
+			push(bctl, lux);
+			bctl->lux = fuse(bctl);
+			if (bctl->conf.enable_auto_range) {
+				for (uint32_t s = 0; s < bctl->sensors; ++s) {
+					if (lux[s] == LIBBACKLIGHT_LUX_INVALID)
+						continue;
+					quantile_add(&bctl->lux_low, lux[s]);
+					quantile_add(&bctl->lux_high, lux[s]);
+				}
+				if (--bctl->auto_range_left == 0) {
+					auto_range(bctl);
+					bctl->auto_range_left = bctl->conf.auto_range_interval ? bctl->conf.auto_range_interval
+											: LIBBACKLIGHT_DEFAULT_AUTO_RANGE_INTERVAL;
+				}
+			}
+		}
 		/*
 		 * Brightness will never be disabled (set to 0) by sensor.
 		 * If disabled it's due to trigger timeout and it should be kept disabled.
 		 */
 		if (bctl->brightness_step > 0) {
-			const uint32_t avg = bctl->sensor_sum / ringbuf_size(bctl->sensor_ring);
-			const uint32_t new_step = lux_to_step(bctl->conf.min_lux, bctl->conf.max_brightness_step, bctl->lux_per_step, avg);
+			const uint32_t new_step = lux_to_step(bctl->min_lux, bctl->conf.max_brightness_step, bctl->lux_per_step, bctl->lux);
 			if (new_step != bctl->brightness_step) {
 				bctl->brightness_step = new_step;
 				ac = LIBBACKLIGHT_BRIGHTNESS;
@@ -154,12 +428,251 @@ enum libbacklight_action libbacklight_operate(struct libbacklight_ctrl* bctl, co
 		}
 	}
 
+	/* Decisions are still made while overridden, they take effect on resume */
+	if (bctl->overridden)
+		ac = LIBBACKLIGHT_NONE;
+
+	TRACE3(libbacklight, operate_exit, bctl->conf.enable_sensor ? bctl->lux : 0, bctl->brightness_step, ac);
 	return ac;
 }
 
+enum libbacklight_action libbacklight_operate(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered, uint32_t lux)
+{
+	uint32_t readings[LIBBACKLIGHT_MAX_SENSORS];
+	readings[0] = lux;
+	for (uint32_t s = 1; s < LIBBACKLIGHT_MAX_SENSORS; ++s)
+		readings[s] = LIBBACKLIGHT_LUX_INVALID;
+	return operate(bctl, ts, triggered, readings);
+}
+
+enum libbacklight_action libbacklight_operate_multi(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered,
+													const uint32_t* lux)
+{
+	return operate(bctl, ts, triggered, lux);
+}
+
+enum libbacklight_action libbacklight_update(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered)
+{
+	return operate(bctl, ts, triggered, NULL);
+}
+
 uint32_t libbacklight_brightness(const struct libbacklight_ctrl* bctl)
 {
-	return bctl->brightness_step;
+	return bctl->overridden ? bctl->override_step : bctl->brightness_step;
+}
+
+int libbacklight_override(struct libbacklight_ctrl* bctl, uint32_t step)
+{
+	if (step > bctl->conf.max_brightness_step)
+		return -EINVAL;
+	bctl->overridden = 1;
+	bctl->override_step = step;
+	return 0;
+}
+
+int libbacklight_overridden(const struct libbacklight_ctrl* bctl)
+{
+	return bctl->overridden;
+}
+
+enum libbacklight_action libbacklight_inhibit(struct libbacklight_ctrl* bctl, const struct timespec* ts,
+												const struct timespec* duration)
+{
+	if (!bctl->conf.enable_trigger)
+		return LIBBACKLIGHT_NONE;
+	bctl->inhibit_until.tv_sec = ts->tv_sec + duration->tv_sec;
+	bctl->inhibit_until.tv_nsec = ts->tv_nsec + duration->tv_nsec;
+	if (bctl->inhibit_until.tv_nsec >= 1000000000L) {
+		bctl->inhibit_until.tv_sec++;
+		bctl->inhibit_until.tv_nsec -= 1000000000L;
+	}
+	/* Wake up like a trigger would, brightness then follows sensor as usual */
+	return operate(bctl, ts, 1, NULL);
+}
+
+enum libbacklight_action libbacklight_resume(struct libbacklight_ctrl* bctl, const struct timespec* ts)
+{
+	const uint32_t shown = libbacklight_brightness(bctl);
+	bctl->overridden = 0;
+	bctl->inhibit_until.tv_sec = 0;
+	bctl->inhibit_until.tv_nsec = 0;
+	operate(bctl, ts, 0, NULL);
+	return bctl->brightness_step != shown ? LIBBACKLIGHT_BRIGHTNESS : LIBBACKLIGHT_NONE;
+}
+
+uint32_t libbacklight_lux(const struct libbacklight_ctrl* bctl)
+{
+	if (!bctl->conf.enable_sensor)
+		return 0;
+	return bctl->lux;
+}
+
+uint32_t libbacklight_steps(const struct libbacklight_ctrl* bctl)
+{
+	return bctl->steps;
+}
+
+static int64_t timespec_to_ns(const struct timespec* ts)
+{
+	return (int64_t) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+struct timespec libbacklight_timeout_remaining(const struct libbacklight_ctrl* bctl, const struct timespec* ts)
+{
+	struct timespec remaining = {0, 0};
+	if (!bctl->conf.enable_trigger || bctl->brightness_step == 0)
+		return remaining;
+
+	int64_t left = timespec_to_ns(&bctl->last_trigger) + timespec_to_ns(&bctl->conf.trigger_timeout)
+							- timespec_to_ns(ts);
+	const int64_t inhibited = timespec_to_ns(&bctl->inhibit_until) - timespec_to_ns(ts);
+	if (inhibited > left)
+		left = inhibited;
+	if (left > 0) {
+		remaining.tv_sec = left / 1000000000LL;
+		remaining.tv_nsec = left % 1000000000LL;
+	}
+	return remaining;
+}
+
+void libbacklight_lux_range(const struct libbacklight_ctrl* bctl, uint32_t* min_lux, uint32_t* max_lux)
+{
+	*min_lux = bctl->min_lux;
+	*max_lux = bctl->max_lux;
+}
+
+void libbacklight_reseed(struct libbacklight_ctrl* bctl, const uint32_t* lux)
+{
+	if (!bctl->conf.enable_sensor)
+		return;
+	fill(bctl, 0);
+	for (uint32_t r = 0; r < bctl->window; ++r) {
+		for (uint32_t s = 0; s < bctl->sensors; ++s) {
+			const uint32_t value = lux[s] != LIBBACKLIGHT_LUX_INVALID ? lux[s] : 0;
+			bctl->samples[r * bctl->sensors + s] = value;
+			bctl->sums[s] += value;
+			bctl->failures[s] = lux[s] != LIBBACKLIGHT_LUX_INVALID ? 0 : bctl->window;
+		}
+	}
+	bctl->lux = fuse(bctl);
+	/* Nothing known about ambient light, fall back to lux of initial step */
+	uint32_t valid = 0;
+	for (uint32_t s = 0; s < bctl->sensors; ++s)
+		valid += lux[s] != LIBBACKLIGHT_LUX_INVALID;
+	if (!valid && bctl->conf.initial_brightness_step > 0)
+		bctl->lux = step_to_lux(bctl->min_lux, bctl->max_lux, bctl->lux_per_step, bctl->conf.initial_brightness_step);
+}
+
+void libbacklight_save(const struct libbacklight_ctrl* bctl, struct libbacklight_state* state)
+{
+	memset(state, 0, sizeof(struct libbacklight_state));
+	state->brightness_step = bctl->brightness_step;
+	memcpy(&state->last_trigger, &bctl->last_trigger, sizeof(struct timespec));
+	if (bctl->conf.enable_sensor) {
+		state->samples = bctl->window;
+		state->sensors = bctl->sensors;
+		for (uint32_t r = 0; r < bctl->window; ++r) {
+			const uint32_t *row = &bctl->samples[((bctl->oldest + r) % bctl->window) * bctl->sensors];
+			memcpy(&state->sensor[r * bctl->sensors], row, bctl->sensors * sizeof(uint32_t));
+		}
+		for (uint32_t s = 0; s < bctl->sensors; ++s)
+			state->sensor_sum += bctl->sums[s];
+	}
+}
+
+int libbacklight_restore(struct libbacklight_ctrl* bctl, const struct libbacklight_state* state)
+{
+	if (state->brightness_step > bctl->conf.max_brightness_step)
+		return -EINVAL;
+	if (state->brightness_step == 0 && !bctl->conf.enable_trigger)
+		return -EINVAL;
+
+	if (bctl->conf.enable_sensor) {
+		if (state->samples != bctl->window || state->sensors != bctl->sensors)
+			return -EINVAL;
+		const uint32_t count = bctl->window * bctl->sensors;
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			sum += state->sensor[i];
+		if (sum != state->sensor_sum)
+			return -EINVAL;
+
+		fill(bctl, 0);
+		memcpy(bctl->samples, state->sensor, count * sizeof(uint32_t));
+		for (uint32_t i = 0; i < count; ++i)
+			bctl->sums[i % bctl->sensors] += state->sensor[i];
+		bctl->lux = fuse(bctl);
+	}
+
+	if (bctl->conf.enable_trigger)
+		memcpy(&bctl->last_trigger, &state->last_trigger, sizeof(struct timespec));
+	bctl->brightness_step = state->brightness_step;
+	return 0;
+}
+
+/* Copy newest readings into window rows oldest first, padding with oldest reading kept */
+static void resize(const struct libbacklight_ctrl* bctl, uint32_t* samples, uint32_t window, uint64_t* sums)
+{
+	const uint32_t n = bctl->sensors;
+	const uint32_t kept = window < bctl->window ? window : bctl->window;
+	memset(sums, 0, n * sizeof(uint64_t));
+	for (uint32_t r = 0; r < window; ++r) {
+		const uint32_t age = window - 1 - r < kept ? window - 1 - r : kept - 1;	// 0 is newest
+		const uint32_t src = (bctl->oldest + bctl->window - 1 - age) % bctl->window;
+		for (uint32_t s = 0; s < n; ++s) {
+			samples[r * n + s] = bctl->samples[src * n + s];
+			sums[s] += samples[r * n + s];
+		}
+	}
+}
+
+int libbacklight_reconfigure(struct libbacklight_ctrl* bctl, const struct libbacklight_conf* conf)
+{
+	const struct libbacklight_conf *old = &bctl->conf;
+	if (validate(conf))
+		return -EINVAL;
+	if (conf->max_brightness_step != old->max_brightness_step || !conf->enable_sensor != !old->enable_sensor
+		|| !conf->enable_trigger != !old->enable_trigger)
+		return -EINVAL;
+	if (conf->enable_sensor && (conf->sensors ? conf->sensors : 1) != bctl->sensors)
+		return -EINVAL;
+
+	/* Everything which may fail is prepared before anything is replaced */
+	const uint32_t window = conf->sensor_window ? conf->sensor_window : LIBBACKLIGHT_DEFAULT_WINDOW;
+	uint32_t *samples = NULL;
+	uint64_t sums[LIBBACKLIGHT_MAX_SENSORS];
+	if (conf->enable_sensor && window != bctl->window) {
+		samples = malloc(window * bctl->sensors * sizeof(uint32_t));
+		if (!samples)
+			return -ENOMEM;
+		resize(bctl, samples, window, sums);
+	}
+
+	const int range_changed = conf->min_lux != old->min_lux || conf->max_lux != old->max_lux
+		|| !conf->enable_auto_range != !old->enable_auto_range
+		|| conf->auto_min_percentile != old->auto_min_percentile || conf->auto_max_percentile != old->auto_max_percentile
+		|| conf->auto_range_interval != old->auto_range_interval;
+	memcpy(&bctl->conf, conf, sizeof(struct libbacklight_conf));
+	if (!conf->enable_sensor)
+		return 0;
+
+	if (samples) {
+		free(bctl->samples);
+		bctl->samples = samples;
+		memcpy(bctl->sums, sums, bctl->sensors * sizeof(uint64_t));
+		bctl->window = window;
+		bctl->oldest = 0;
+	}
+	for (uint32_t s = 0; s < bctl->sensors; ++s) {
+		bctl->weights[s] = conf->sensor_weight[s] ? conf->sensor_weight[s] : 1;
+		bctl->failures[s] = bctl->failures[s] < bctl->window ? bctl->failures[s] : bctl->window;
+		bctl->beyond[s] = 0;
+	}
+	/* Adapted range and percentile estimates are kept unless their configuration changed */
+	if (range_changed)
+		set_range(bctl, conf);
+	bctl->lux = fuse(bctl);
+	return 0;
 }
 
 const struct libbacklight_conf* libbacklight_get_conf(const struct libbacklight_ctrl* bctl)
@@ -8,12 +8,42 @@
 extern "C" {
 #endif
 
+#define LIBBACKLIGHT_DEFAULT_WINDOW 10
+#define LIBBACKLIGHT_STATE_MAX_SAMPLES 64
+#define LIBBACKLIGHT_DEFAULT_AUTO_RANGE_INTERVAL 600
+#define LIBBACKLIGHT_MAX_SENSORS 8
+#define LIBBACKLIGHT_LUX_INVALID UINT32_MAX	// Failed reading, sensor holds its last value
+
+/* How sensor window averages are combined into one lux */
+enum libbacklight_fusion {
+	LIBBACKLIGHT_FUSION_MEAN,			// Weighted mean
+	LIBBACKLIGHT_FUSION_MAX,
+	LIBBACKLIGHT_FUSION_MEDIAN,
+};
+
 struct libbacklight_conf {
 	uint32_t max_brightness_step;		// Total number of steps available.
 	uint32_t initial_brightness_step;	// Step we're starting from. Value between 1 and max_brightness_step.
 	int enable_sensor;					// Calculate brightness based on min/max_lux.
 	uint32_t min_lux;					// This value corresponds to brightness step 1.
 	uint32_t max_lux;					// This value corresponds to max_brightness_step.
+	uint32_t sensor_window;				// Number of sensor readings averaged, max LIBBACKLIGHT_STATE_MAX_SAMPLES.
+										// 0 means LIBBACKLIGHT_DEFAULT_WINDOW.
+	uint32_t sensors;					// Number of sensors, max LIBBACKLIGHT_MAX_SENSORS. 0 means 1.
+	enum libbacklight_fusion fusion;	// Combining of sensors.
+	uint32_t sensor_weight[LIBBACKLIGHT_MAX_SENSORS];	// Weight for LIBBACKLIGHT_FUSION_MEAN, 0 means 1.
+	uint32_t fault_ratio;				// With 3 or more sensors, ignore sensors off from median by more than
+										// this factor. 0 disables, otherwise at least 2.
+	uint32_t step_ratio;				// Reset a sensor's window to its reading when lux + 1 differs from
+										// window average + 1 by more than this factor. 0 disables, otherwise at least 2.
+	uint32_t step_samples;				// Consecutive readings beyond step_ratio required for reset.
+										// 0 means 1.
+	int enable_auto_range;				// Adapt min/max_lux to percentiles of observed lux, requires enable_sensor.
+										// min/max_lux are used until first adaption.
+	uint32_t auto_min_percentile;		// Percentile of observed lux mapped to brightness step 1.
+	uint32_t auto_max_percentile;		// Percentile of observed lux mapped to max_brightness_step, max 100.
+	uint32_t auto_range_interval;		// Sensor readings between adaptions.
+										// 0 means LIBBACKLIGHT_DEFAULT_AUTO_RANGE_INTERVAL.
 	int enable_trigger;					// Enable backlight after trigger received.
 										// Will set backlight to initial_brightness_step,
 										// unless enable_sensor is set, then the value is adjusted
@@ -23,6 +53,18 @@ struct libbacklight_conf {
 
 struct libbacklight_ctrl;
 
+/* Controller state which may be saved and restored across restarts */
+struct libbacklight_state {
+	uint32_t brightness_step;
+	uint32_t samples;					// Readings in each sensor window, 0 if sensor disabled
+	uint64_t sensor_sum;				// Sum of sensor entries
+	struct timespec last_trigger;
+	uint32_t sensors;					// Number of sensors
+	uint32_t reserved;
+	uint32_t sensor[LIBBACKLIGHT_STATE_MAX_SAMPLES * LIBBACKLIGHT_MAX_SENSORS];	// Rows of one reading per sensor,
+																				// oldest first
+};
+
 struct libbacklight_ctrl* create_libbacklight(const struct timespec* ts, const struct libbacklight_conf* conf);
 void destroy_libbacklight(struct libbacklight_ctrl** bctl);
 
@@ -40,10 +82,102 @@ enum libbacklight_action {
 
 enum libbacklight_action libbacklight_operate(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered, uint32_t lux);
 
-/* Return current brightness step
+/* Same as libbacklight_operate() with one reading per configured sensor.
+ * Failed readings are given as LIBBACKLIGHT_LUX_INVALID, a sensor failing a whole window is ignored.
+ * libbacklight_operate() is the same as this with only first sensor read.
+ */
+enum libbacklight_action libbacklight_operate_multi(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered,
+													const uint32_t* lux);
+
+/* Same as libbacklight_operate() but without a new sensor reading.
+ * Brightness is decided from lux already averaged.
+ */
+enum libbacklight_action libbacklight_update(struct libbacklight_ctrl* bctl, const struct timespec* ts, int triggered);
+
+/* Register trigger which happened at ts, for example time stamped by kernel.
+ * Trigger times older than the last registered trigger are ignored.
+ * If trigger is disabled, call is ignored.
+ *
+ * Returns what action caller is expected to take.
+ */
+enum libbacklight_action libbacklight_trigger(struct libbacklight_ctrl* bctl, const struct timespec* ts);
+
+/* Return current brightness step, the override step while overridden
  */
 uint32_t libbacklight_brightness(const struct libbacklight_ctrl* bctl);
 
+/* Hold brightness at step, 0 to max_brightness_step, until libbacklight_resume().
+ * Sensor readings, triggers and timeouts are still processed, only brightness is held.
+ * Caller sets brightness to libbacklight_brightness() afterwards.
+ * Returns 0 on success or -EINVAL if step is out of range.
+ */
+int libbacklight_override(struct libbacklight_ctrl* bctl, uint32_t step);
+
+/* Return 1 if brightness is held by libbacklight_override()
+ */
+int libbacklight_overridden(const struct libbacklight_ctrl* bctl);
+
+/* Keep trigger timeout from turning backlight off until ts + duration, waking backlight as a trigger if off.
+ * If trigger is disabled, call is ignored.
+ *
+ * Returns what action caller is expected to take.
+ */
+enum libbacklight_action libbacklight_inhibit(struct libbacklight_ctrl* bctl, const struct timespec* ts,
+												const struct timespec* duration);
+
+/* End override and inhibit, brightness is decided at ts as if they never happened.
+ *
+ * Returns what action caller is expected to take.
+ */
+enum libbacklight_action libbacklight_resume(struct libbacklight_ctrl* bctl, const struct timespec* ts);
+
+/* Return averaged lux used for brightness decision.
+ * Returns 0 if sensor is disabled.
+ */
+uint32_t libbacklight_lux(const struct libbacklight_ctrl* bctl);
+
+/* Return time left at ts until trigger timeout turns backlight off, at least until end of inhibit.
+ * Returns {0,0} if trigger is disabled or backlight already is off.
+ * While overridden the timeout only decides brightness after resume.
+ */
+struct timespec libbacklight_timeout_remaining(const struct libbacklight_ctrl* bctl, const struct timespec* ts);
+
+/* Lux range currently mapped to brightness steps.
+ * Same as configured min/max_lux unless auto range has adapted it.
+ */
+void libbacklight_lux_range(const struct libbacklight_ctrl* bctl, uint32_t* min_lux, uint32_t* max_lux);
+
+/* Fill whole sensor windows with lux, one per configured sensor, discarding older readings.
+ * For use when sensor sampling was suspended and the windows are stale.
+ * If every reading is LIBBACKLIGHT_LUX_INVALID, lux falls back to what maps to initial_brightness_step,
+ * for use when sensors have been failing too long for their last readings to be trusted.
+ * Does nothing if sensor is disabled.
+ */
+void libbacklight_reseed(struct libbacklight_ctrl* bctl, const uint32_t* lux);
+
+/* Number of sensor window resets by step_ratio since create.
+ */
+uint32_t libbacklight_steps(const struct libbacklight_ctrl* bctl);
+
+/* Save state for later restore.
+ */
+void libbacklight_save(const struct libbacklight_ctrl* bctl, struct libbacklight_state* state);
+
+/* Restore state from libbacklight_save().
+ * Sensor window must be of same size as configured.
+ * Returns 0 on success or -EINVAL if state doesn't match configuration, then nothing is restored.
+ */
+int libbacklight_restore(struct libbacklight_ctrl* bctl, const struct libbacklight_state* state);
+
+/* Replace configuration of running controller.
+ * Brightness step, last trigger and sensor readings are kept. A changed window keeps newest readings.
+ * max_brightness_step, enable_sensor, enable_trigger and sensors can't be changed.
+ * Everything is validated and allocated before anything is replaced, on failure nothing changes.
+ * Returns 0 on success, -EINVAL if conf is invalid or changes a fixed field, or -ENOMEM.
+ * New mapping is applied by next libbacklight_operate() or libbacklight_update().
+ */
+int libbacklight_reconfigure(struct libbacklight_ctrl* bctl, const struct libbacklight_conf* conf);
+
 /* Return current configuration
  */
 const struct libbacklight_conf* libbacklight_get_conf(const struct libbacklight_ctrl* bctl);
@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "libbacklight_bank.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BANK_X86 1
+#endif
+
+#define LANES LIBBACKLIGHT_BANK_LANES
+
+struct libbacklight_bank;
+typedef uint32_t (*bank_run_fn)(struct libbacklight_bank* bank, int64_t now);
+
+struct libbacklight_bank {
+	struct libbacklight_conf conf;
+	uint32_t count;
+	uint32_t stride;				// count rounded up to whole blocks
+	uint32_t window;
+	uint32_t oldest;				// Window row replaced by next reading, same for all controllers
+	int64_t timeout;				// trigger_timeout in ns
+	int32_t min_lux;
+	int32_t max_step;
+	uint32_t lux_per_step;
+	double inv_window;
+	double inv_lux_per_step;
+	int readings;					// Input lux given to current call
+	enum libbacklight_bank_impl impl;
+	bank_run_fn run;
+	uint32_t *steps;				// Padding lanes are kept off
+	int64_t *last_trigger;			// ns
+	int32_t *sums;
+	int32_t *samples;				// window rows of stride readings
+	int32_t *latest;				// Newest reading, held by failed readings
+	uint8_t *changed;
+	uint32_t *triggered;			// Input copied to padded arrays, so blocks never read past caller's arrays
+	uint32_t *lux;
+};
+
+static void* alloc(size_t size)
+{
+	size = (size + 63) & ~(size_t) 63;
+	void *p = aligned_alloc(64, size);
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+/* Divisions by loop invariants as multiplications, vector units have no integer division.
+ * Adding 0.5 keeps the product off integers, so truncation gives the exact quotient for
+ * dividends and divisors below 2^31. */
+static inline int32_t quotient(int32_t a, double inv)
+{
+	return (int32_t) (((double) a + 0.5) * inv);
+}
+
+/* Steps of one block of lanes, free of dependencies between lanes so the compiler turns them into vector
+ * code for whatever instruction set the caller is built for. Selects are written as masks and signs of
+ * differences, which vectorize without branches or 64 bit compares. */
+#define BLOCK static inline __attribute__((always_inline)) void
+
+BLOCK trigger_block(uint32_t* restrict steps, int64_t* restrict last, const uint32_t* restrict triggered,
+					int64_t now, int64_t timeout, uint32_t initial)
+{
+	for (uint32_t l = 0; l < LANES; ++l) {
+		const uint64_t trig = -(uint64_t) triggered[l];
+		const uint64_t newer = ((uint64_t) (now - last[l]) >> 63) - 1;	// Older triggers are ignored
+		last[l] = (now & (trig & newer)) | (last[l] & ~(trig & newer));
+		const uint32_t waiting = (uint64_t) (now - last[l] - timeout) >> 63;
+		const uint32_t on = steps[l] | (initial & -(uint32_t) (steps[l] == 0));
+		const uint32_t off = steps[l] & -waiting;
+		steps[l] = (on & (uint32_t) trig) | (off & ~(uint32_t) trig);
+	}
+}
+
+BLOCK push_block(int32_t* restrict sums, int32_t* restrict row, int32_t* restrict latest, const uint32_t* restrict lux)
+{
+	for (uint32_t l = 0; l < LANES; ++l) {
+		const int32_t clamped = lux[l] > LIBBACKLIGHT_BANK_MAX_LUX ? LIBBACKLIGHT_BANK_MAX_LUX : lux[l];
+		const int32_t value = lux[l] == LIBBACKLIGHT_LUX_INVALID ? latest[l] : clamped;
+		sums[l] += value - row[l];
+		row[l] = value;
+		latest[l] = value;
+	}
+}
+
+/* Brightness is never turned off by sensor, as in libbacklight_operate() */
+BLOCK sensor_block(uint32_t* restrict steps, const int32_t* restrict sums, double inv_window, int32_t min_lux,
+					double inv_lux_per_step, int32_t max_step)
+{
+	for (uint32_t l = 0; l < LANES; ++l) {
+		const int32_t avg = quotient(sums[l], inv_window);
+		const int32_t distance = abs(avg - min_lux);
+		const int32_t step = quotient(distance, inv_lux_per_step) + 1;
+		const uint32_t clamped = step > max_step ? max_step : step;
+		steps[l] = clamped & -(uint32_t) (steps[l] != 0);
+	}
+}
+
+/* Counts kept per lane, summed once after all blocks */
+BLOCK changed_block(uint8_t* restrict flags, uint32_t* restrict counts, const uint32_t* restrict steps,
+					const uint32_t* restrict before)
+{
+	for (uint32_t l = 0; l < LANES; ++l) {
+		flags[l] = steps[l] != before[l];
+		counts[l] += flags[l];
+	}
+}
+
+static inline __attribute__((always_inline)) uint32_t run(struct libbacklight_bank* bank, int64_t now)
+{
+	const int trigger = bank->conf.enable_trigger;
+	const int sensor = bank->conf.enable_sensor;
+	const int readings = sensor && bank->readings;
+	int32_t *row = &bank->samples[(size_t) bank->oldest * bank->stride];
+	uint32_t counts[LANES] = {0};
+
+	for (uint32_t b = 0; b < bank->stride; b += LANES) {
+		uint32_t before[LANES];
+		for (uint32_t l = 0; l < LANES; ++l)
+			before[l] = bank->steps[b + l];
+		if (trigger)
+			trigger_block(&bank->steps[b], &bank->last_trigger[b], &bank->triggered[b], now, bank->timeout,
+							bank->conf.initial_brightness_step);
+		if (readings)
+			push_block(&bank->sums[b], &row[b], &bank->latest[b], &bank->lux[b]);
+		if (sensor)
+			sensor_block(&bank->steps[b], &bank->sums[b], bank->inv_window, bank->min_lux, bank->inv_lux_per_step,
+							bank->max_step);
+		changed_block(&bank->changed[b], counts, &bank->steps[b], before);
+	}
+
+	if (readings)
+		bank->oldest = (bank->oldest + 1) % bank->window;
+	uint32_t changed = 0;
+	for (uint32_t l = 0; l < LANES; ++l)
+		changed += counts[l];
+	return changed;
+}
+
+__attribute__((optimize("no-tree-vectorize", "no-tree-slp-vectorize")))
+static uint32_t run_scalar(struct libbacklight_bank* bank, int64_t now)
+{
+	return run(bank, now);
+}
+
+static uint32_t run_generic(struct libbacklight_bank* bank, int64_t now)
+{
+	return run(bank, now);
+}
+
+#ifdef BANK_X86
+__attribute__((target("sse4.1")))
+static uint32_t run_sse4(struct libbacklight_bank* bank, int64_t now)
+{
+	return run(bank, now);
+}
+
+__attribute__((target("avx2")))
+static uint32_t run_avx2(struct libbacklight_bank* bank, int64_t now)
+{
+	return run(bank, now);
+}
+#endif
+
+static enum libbacklight_bank_impl best_impl(void)
+{
+#ifdef BANK_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return LIBBACKLIGHT_BANK_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return LIBBACKLIGHT_BANK_SSE4;
+#endif
+	return LIBBACKLIGHT_BANK_GENERIC;
+}
+
+int libbacklight_bank_set_impl(struct libbacklight_bank* bank, enum libbacklight_bank_impl impl)
+{
+	if (impl == LIBBACKLIGHT_BANK_AUTO)
+		impl = best_impl();
+
+	switch (impl) {
+	case LIBBACKLIGHT_BANK_SCALAR:
+		bank->run = run_scalar;
+		break;
+	case LIBBACKLIGHT_BANK_GENERIC:
+		bank->run = run_generic;
+		break;
+#ifdef BANK_X86
+	case LIBBACKLIGHT_BANK_SSE4:
+		if (!__builtin_cpu_supports("sse4.1"))
+			return -ENOTSUP;
+		bank->run = run_sse4;
+		break;
+	case LIBBACKLIGHT_BANK_AVX2:
+		if (!__builtin_cpu_supports("avx2"))
+			return -ENOTSUP;
+		bank->run = run_avx2;
+		break;
+#endif
+	default:
+		return -ENOTSUP;
+	}
+	bank->impl = impl;
+	return 0;
+}
+
+enum libbacklight_bank_impl libbacklight_bank_get_impl(const struct libbacklight_bank* bank)
+{
+	return bank->impl;
+}
+
+const char* libbacklight_bank_impl_name(enum libbacklight_bank_impl impl)
+{
+	switch (impl) {
+	case LIBBACKLIGHT_BANK_AUTO:
+		return "auto";
+	case LIBBACKLIGHT_BANK_SCALAR:
+		return "scalar";
+	case LIBBACKLIGHT_BANK_GENERIC:
+		return "generic";
+	case LIBBACKLIGHT_BANK_SSE4:
+		return "sse4";
+	case LIBBACKLIGHT_BANK_AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+static int64_t timespec_ns(const struct timespec* ts)
+{
+	return (int64_t) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static int validate(const struct libbacklight_conf* conf, uint32_t count)
+{
+	if (count == 0 || conf->max_brightness_step == 0 || conf->initial_brightness_step == 0)
+		return -EINVAL;
+	if (conf->enable_trigger && conf->trigger_timeout.tv_sec == 0 && conf->trigger_timeout.tv_nsec == 0)
+		return -EINVAL;
+	if (!conf->enable_sensor)
+		return 0;
+	if (conf->max_lux < 1 || conf->min_lux > conf->max_lux || conf->max_lux > LIBBACKLIGHT_BANK_MAX_LUX)
+		return -EINVAL;
+	if (conf->sensor_window > LIBBACKLIGHT_STATE_MAX_SAMPLES || conf->sensors > 1)
+		return -EINVAL;
+	if (conf->enable_auto_range || conf->step_ratio)
+		return -EINVAL;
+	/* Every step must cover at least one lux */
+	if (conf->max_brightness_step > 1 && conf->max_lux - conf->min_lux < conf->max_brightness_step - 1)
+		return -EINVAL;
+	return 0;
+}
+
+struct libbacklight_bank* libbacklight_bank_create(const struct timespec* ts, const struct libbacklight_conf* conf,
+													uint32_t count)
+{
+	struct libbacklight_bank *bank = (struct libbacklight_bank*) calloc(1, sizeof(struct libbacklight_bank));
+	if (!bank)
+		goto error_exit;
+
+	if (validate(conf, count))
+		goto error_exit;
+
+	memcpy(&bank->conf, conf, sizeof(struct libbacklight_conf));
+	bank->count = count;
+	bank->stride = (count + LANES - 1) / LANES * LANES;
+	bank->window = conf->sensor_window ? conf->sensor_window : LIBBACKLIGHT_DEFAULT_WINDOW;
+	bank->timeout = timespec_ns(&conf->trigger_timeout);
+
+	bank->steps = alloc(bank->stride * sizeof(uint32_t));
+	bank->last_trigger = alloc(bank->stride * sizeof(int64_t));
+	bank->sums = alloc(bank->stride * sizeof(int32_t));
+	bank->samples = alloc((size_t) bank->window * bank->stride * sizeof(int32_t));
+	bank->latest = alloc(bank->stride * sizeof(int32_t));
+	bank->changed = alloc(bank->stride);
+	bank->triggered = alloc(bank->stride * sizeof(uint32_t));
+	bank->lux = alloc(bank->stride * sizeof(uint32_t));
+	if (!bank->steps || !bank->last_trigger || !bank->sums || !bank->samples || !bank->latest || !bank->changed || !bank->triggered
+		|| !bank->lux)
+		goto error_exit;
+
+	const int64_t now = timespec_ns(ts);
+	for (uint32_t i = 0; i < count; ++i) {
+		bank->steps[i] = conf->initial_brightness_step;
+		bank->last_trigger[i] = now;
+	}
+
+	if (conf->enable_sensor) {
+		const uint32_t max_step = conf->max_brightness_step;
+		bank->lux_per_step = max_step < 2 ? conf->max_lux - conf->min_lux : (conf->max_lux - conf->min_lux) / (max_step - 1);
+		if (bank->lux_per_step == 0)
+			bank->lux_per_step = 1;
+		bank->min_lux = conf->min_lux;
+		bank->max_step = max_step;
+		bank->inv_window = 1.0 / bank->window;
+		bank->inv_lux_per_step = 1.0 / bank->lux_per_step;
+
+		/* Windows start out as with create_libbacklight() */
+		uint32_t initial_lux = conf->min_lux + bank->lux_per_step * (conf->initial_brightness_step - 1);
+		if (initial_lux > conf->max_lux)
+			initial_lux = conf->max_lux;
+		for (uint32_t r = 0; r < bank->window; ++r) {
+			for (uint32_t i = 0; i < count; ++i)
+				bank->samples[(size_t) r * bank->stride + i] = initial_lux;
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			bank->sums[i] = initial_lux * bank->window;
+			bank->latest[i] = initial_lux;
+		}
+	}
+
+	libbacklight_bank_set_impl(bank, LIBBACKLIGHT_BANK_AUTO);
+	return bank;
+
+error_exit:
+	libbacklight_bank_destroy(&bank);
+	return NULL;
+}
+
+void libbacklight_bank_destroy(struct libbacklight_bank** bank)
+{
+	if (*bank) {
+		free((*bank)->steps);
+		free((*bank)->last_trigger);
+		free((*bank)->sums);
+		free((*bank)->samples);
+		free((*bank)->latest);
+		free((*bank)->changed);
+		free((*bank)->triggered);
+		free((*bank)->lux);
+		free(*bank);
+		*bank = NULL;
+	}
+}
+
+uint32_t libbacklight_bank_operate(struct libbacklight_bank* bank, const struct timespec* ts, const uint8_t* triggered,
+									const uint32_t* lux)
+{
+	if (triggered) {
+		for (uint32_t i = 0; i < bank->count; ++i)
+			bank->triggered[i] = triggered[i] != 0;
+	}
+	else
+		memset(bank->triggered, 0, bank->count * sizeof(uint32_t));
+	if (lux)
+		memcpy(bank->lux, lux, bank->count * sizeof(uint32_t));
+	bank->readings = lux != NULL;
+	return bank->run(bank, timespec_ns(ts));
+}
+
+uint32_t libbacklight_bank_count(const struct libbacklight_bank* bank)
+{
+	return bank->count;
+}
+
+const uint32_t* libbacklight_bank_brightness(const struct libbacklight_bank* bank)
+{
+	return bank->steps;
+}
+
+const uint8_t* libbacklight_bank_changed(const struct libbacklight_bank* bank)
+{
+	return bank->changed;
+}
+
+uint32_t libbacklight_bank_lux(const struct libbacklight_bank* bank, uint32_t index)
+{
+	if (!bank->conf.enable_sensor || index >= bank->count)
+		return 0;
+	return bank->sums[index] / bank->window;
+}
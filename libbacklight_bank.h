@@ -0,0 +1,73 @@
+#ifndef LIBBACKLIGHT_BANK__H__
+#define LIBBACKLIGHT_BANK__H__
+
+#include <stdint.h>
+#include <time.h>
+#include "libbacklight.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Many independent controllers sharing one configuration, updated together.
+ * Each controller behaves as a libbacklight_ctrl with a single sensor, driven by libbacklight_operate().
+ * State is kept as arrays over controllers, window rows hold one reading per controller, so one call
+ * streams through contiguous memory in blocks of LIBBACKLIGHT_BANK_LANES controllers.
+ * Override, inhibit, auto range and step_ratio are not supported.
+ */
+
+#define LIBBACKLIGHT_BANK_LANES 16		// Controllers per block, arrays are padded to a whole block
+/* Readings above are clamped, so a full window sum fits 32 bit lanes */
+#define LIBBACKLIGHT_BANK_MAX_LUX (INT32_MAX / LIBBACKLIGHT_STATE_MAX_SAMPLES)
+
+enum libbacklight_bank_impl {
+	LIBBACKLIGHT_BANK_AUTO,				// Best one supported by CPU
+	LIBBACKLIGHT_BANK_SCALAR,			// One controller at a time, reference for the others
+	LIBBACKLIGHT_BANK_GENERIC,			// Vectorized by compiler for baseline instruction set
+	LIBBACKLIGHT_BANK_SSE4,				// x86-64 with SSE4.1
+	LIBBACKLIGHT_BANK_AVX2,				// x86-64 with AVX2
+};
+
+struct libbacklight_bank;
+
+/* Create count controllers, all in the state create_libbacklight() would start them in.
+ * Returns NULL if conf is invalid, uses features not supported by banks, max_lux is above
+ * LIBBACKLIGHT_BANK_MAX_LUX, fewer lux than steps are configured, or count is 0.
+ */
+struct libbacklight_bank* libbacklight_bank_create(const struct timespec* ts, const struct libbacklight_conf* conf,
+													uint32_t count);
+void libbacklight_bank_destroy(struct libbacklight_bank** bank);
+
+/* Select implementation, all give the same result.
+ * Returns 0 on success or -ENOTSUP if not supported by CPU or build.
+ */
+int libbacklight_bank_set_impl(struct libbacklight_bank* bank, enum libbacklight_bank_impl impl);
+enum libbacklight_bank_impl libbacklight_bank_get_impl(const struct libbacklight_bank* bank);
+const char* libbacklight_bank_impl_name(enum libbacklight_bank_impl impl);
+
+/* Operate every controller at ts, same as libbacklight_operate() on each.
+ * triggered holds one flag per controller, NULL if none triggered.
+ * lux holds one reading per controller, NULL if no new readings. LIBBACKLIGHT_LUX_INVALID holds previous reading.
+ *
+ * Returns number of controllers whose brightness changed, see libbacklight_bank_changed().
+ */
+uint32_t libbacklight_bank_operate(struct libbacklight_bank* bank, const struct timespec* ts, const uint8_t* triggered,
+									const uint32_t* lux);
+
+/* Number of controllers */
+uint32_t libbacklight_bank_count(const struct libbacklight_bank* bank);
+
+/* Brightness step of every controller */
+const uint32_t* libbacklight_bank_brightness(const struct libbacklight_bank* bank);
+
+/* Flag per controller, set if brightness changed in last libbacklight_bank_operate() */
+const uint8_t* libbacklight_bank_changed(const struct libbacklight_bank* bank);
+
+/* Averaged lux of controller at index, 0 if sensor is disabled */
+uint32_t libbacklight_bank_lux(const struct libbacklight_bank* bank, uint32_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBBACKLIGHT_BANK__H__ */
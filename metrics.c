@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "metrics.h"
+
+static const double latency_quantiles[METRICS_LATENCY_QUANTILES] = {0.5, 0.9, 0.99};
+
+int metrics_init(struct metrics* metrics, const char* path)
+{
+	memset(metrics, 0, sizeof(struct metrics));
+	metrics->path = strdup(path);
+	const size_t size = strlen(path) + sizeof(".tmp");
+	metrics->tmp_path = malloc(size);
+	if (!metrics->path || !metrics->tmp_path) {
+		metrics_free(metrics);
+		return -ENOMEM;
+	}
+	snprintf(metrics->tmp_path, size, "%s.tmp", path);
+	for (int i = 0; i < METRICS_LATENCY_QUANTILES; ++i)
+		quantile_init(&metrics->latency[i], latency_quantiles[i]);
+	return 0;
+}
+
+void metrics_free(struct metrics* metrics)
+{
+	free(metrics->path);
+	metrics->path = NULL;
+	free(metrics->tmp_path);
+	metrics->tmp_path = NULL;
+}
+
+void metrics_latency(struct metrics* metrics, double seconds)
+{
+	for (int i = 0; i < METRICS_LATENCY_QUANTILES; ++i)
+		quantile_add(&metrics->latency[i], seconds);
+	metrics->latency_sum += seconds;
+	metrics->latency_count++;
+}
+
+static void counter(FILE* fp, const char* name, const char* help, unsigned long long value)
+{
+	fprintf(fp, "# HELP backlightctl_%s %s\n# TYPE backlightctl_%s counter\nbacklightctl_%s %llu\n",
+			name, help, name, name, value);
+}
+
+static void gauge(FILE* fp, const char* name, const char* help, unsigned long long value)
+{
+	fprintf(fp, "# HELP backlightctl_%s %s\n# TYPE backlightctl_%s gauge\nbacklightctl_%s %llu\n",
+			name, help, name, name, value);
+}
+
+static void gauge_seconds(FILE* fp, const char* name, const char* help, double value)
+{
+	fprintf(fp, "# HELP backlightctl_%s %s\n# TYPE backlightctl_%s gauge\nbacklightctl_%s %.6f\n",
+			name, help, name, name, value);
+}
+
+static void counter_seconds(FILE* fp, const char* name, const char* help, double value)
+{
+	fprintf(fp, "# HELP backlightctl_%s %s\n# TYPE backlightctl_%s counter\nbacklightctl_%s %.3f\n",
+			name, help, name, name, value);
+}
+
+static void energy(FILE* fp, const struct energy_counters* energy)
+{
+	counter_seconds(fp, "lit_seconds_total", "Time backlight was on, across restarts.", energy->lit_seconds);
+	counter_seconds(fp, "dark_seconds_total", "Time backlight was off, across restarts.", energy->dark_seconds);
+	counter_seconds(fp, "step_integral_total", "Brightness step integrated over time in step-seconds, across restarts.",
+					energy->step_seconds);
+	counter_seconds(fp, "energy_joules_total", "Estimated backlight energy, 0 without power model.", energy->joules);
+	counter_seconds(fp, "energy_saved_joules_total", "Estimated energy saved against backlight always at max step.",
+					energy->full_joules - energy->joules);
+	fprintf(fp, "# HELP backlightctl_step_seconds_total Time spent in brightness bucket across restarts, 0 is off, 1-10 are tenths of step range.\n");
+	fprintf(fp, "# TYPE backlightctl_step_seconds_total counter\n");
+	for (int i = 0; i < ENERGY_STEP_BUCKETS; ++i)
+		fprintf(fp, "backlightctl_step_seconds_total{bucket=\"%d\"} %.3f\n", i, energy->bucket_seconds[i]);
+}
+
+int metrics_write(struct metrics* metrics, const struct metrics_values* values)
+{
+	FILE *fp = fopen(metrics->tmp_path, "w");
+	if (!fp)
+		return -errno;
+
+	counter(fp, "wakeups_total", "Main loop wakeups.", values->wakeups);
+	counter(fp, "sensor_reads_total", "Ambient light sensor reads.", values->sensor_reads);
+	counter(fp, "sensor_failures_total", "Failed ambient light sensor reads.", values->sensor_failures);
+	counter(fp, "triggers_total", "Loop iterations with a trigger.", values->triggers);
+	counter(fp, "brightness_writes_total", "Brightness writes.", values->brightness_writes);
+	counter(fp, "brightness_failures_total", "Failed brightness writes.", values->brightness_failures);
+	counter(fp, "source_errors_total", "Failed source reads, retried with backoff.", values->source_errors);
+	counter(fp, "source_recoveries_total", "Sources reopened after failures.", values->source_recoveries);
+	gauge(fp, "brightness_step", "Current brightness step, 0 is off.", values->brightness_step);
+	gauge(fp, "max_brightness_step", "Maximum brightness step.", values->max_brightness_step);
+	gauge(fp, "filtered_lux", "Averaged lux used for brightness decision.", values->filtered_lux);
+	gauge(fp, "raw_lux", "Last ambient light sensor reading.", values->raw_lux);
+	if (values->first_decision_seconds > 0.0)
+		gauge_seconds(fp, "first_decision_seconds", "Time from start to first brightness decision.",
+					values->first_decision_seconds);
+
+	if (values->energy)
+		energy(fp, values->energy);
+
+	fprintf(fp, "# HELP backlightctl_loop_latency_seconds Processing time of a loop iteration after wakeup.\n");
+	fprintf(fp, "# TYPE backlightctl_loop_latency_seconds summary\n");
+	for (int i = 0; i < METRICS_LATENCY_QUANTILES; ++i)
+		fprintf(fp, "backlightctl_loop_latency_seconds{quantile=\"%g\"} %.9f\n",
+				latency_quantiles[i], quantile_get(&metrics->latency[i]));
+	fprintf(fp, "backlightctl_loop_latency_seconds_sum %.9f\n", metrics->latency_sum);
+	fprintf(fp, "backlightctl_loop_latency_seconds_count %llu\n", metrics->latency_count);
+
+	int r = 0;
+	if (ferror(fp))
+		r = -EIO;
+	if (fclose(fp) != 0 && !r)
+		r = -errno;
+	if (!r && rename(metrics->tmp_path, metrics->path) != 0)
+		r = -errno;
+	if (r)
+		unlink(metrics->tmp_path);
+	return r;
+}
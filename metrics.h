@@ -0,0 +1,59 @@
+#ifndef METRICS__H__
+#define METRICS__H__
+
+#include <stdint.h>
+#include <time.h>
+#include "quantile.h"
+#include "energy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Metrics written periodically in Prometheus text format for node-exporter textfile collector.
+ * File is written to a temporary file and renamed over path, so readers never see a partial file.
+ */
+
+#define METRICS_LATENCY_QUANTILES 3
+
+/* Counters and gauges owned by the caller, filled in before metrics_write() */
+struct metrics_values {
+	unsigned long long wakeups;
+	unsigned long long sensor_reads;
+	unsigned long long sensor_failures;
+	unsigned long long triggers;
+	unsigned long long brightness_writes;
+	unsigned long long brightness_failures;
+	uint32_t brightness_step;
+	uint32_t max_brightness_step;
+	uint32_t filtered_lux;
+	uint32_t raw_lux;
+	unsigned long long source_errors;		// Failed reads retried instead of exiting
+	unsigned long long source_recoveries;	// Sources reopened after failures
+	double first_decision_seconds;	// From start of main to first brightness decision, 0 if not made
+	const struct energy_counters *energy;	// Cumulative across restarts including time at step, NULL if not accounted
+};
+
+struct metrics {
+	char *path;
+	char *tmp_path;
+	struct quantile latency[METRICS_LATENCY_QUANTILES];	// Loop latency in seconds
+	double latency_sum;
+	unsigned long long latency_count;
+};
+
+/* Returns 0 on success or negative errno */
+int metrics_init(struct metrics* metrics, const char* path);
+void metrics_free(struct metrics* metrics);
+
+/* Add processing time of one loop iteration */
+void metrics_latency(struct metrics* metrics, double seconds);
+
+/* Returns 0 on success or negative errno, path is left untouched on failure */
+int metrics_write(struct metrics* metrics, const struct metrics_values* values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS__H__ */
@@ -0,0 +1,105 @@
+#include <string.h>
+#include "quantile.h"
+
+void quantile_init(struct quantile* q, double p)
+{
+	memset(q, 0, sizeof(struct quantile));
+	q->p = p;
+}
+
+static void sort(double* v, size_t n)
+{
+	for (size_t i = 1; i < n; ++i) {
+		const double x = v[i];
+		size_t j = i;
+		for (; j > 0 && v[j - 1] > x; --j)
+			v[j] = v[j - 1];
+		v[j] = x;
+	}
+}
+
+static double parabolic(const struct quantile* q, int i, double d)
+{
+	const double *h = q->height;
+	const double *n = q->pos;
+	return h[i] + d / (n[i + 1] - n[i - 1]) *
+		((n[i] - n[i - 1] + d) * (h[i + 1] - h[i]) / (n[i + 1] - n[i]) +
+		 (n[i + 1] - n[i] - d) * (h[i] - h[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static double linear(const struct quantile* q, int i, int d)
+{
+	return q->height[i] + d * (q->height[i + d] - q->height[i]) / (q->pos[i + d] - q->pos[i]);
+}
+
+void quantile_add(struct quantile* q, double x)
+{
+	if (q->count < QUANTILE_MARKERS) {
+		q->height[q->count++] = x;
+		if (q->count == QUANTILE_MARKERS) {
+			sort(q->height, QUANTILE_MARKERS);
+			for (int i = 0; i < QUANTILE_MARKERS; ++i)
+				q->pos[i] = i;
+			q->desired[0] = 0.0;
+			q->desired[1] = 2.0 * q->p;
+			q->desired[2] = 4.0 * q->p;
+			q->desired[3] = 2.0 + 2.0 * q->p;
+			q->desired[4] = 4.0;
+			q->inc[0] = 0.0;
+			q->inc[1] = q->p / 2.0;
+			q->inc[2] = q->p;
+			q->inc[3] = (1.0 + q->p) / 2.0;
+			q->inc[4] = 1.0;
+		}
+		return;
+	}
+
+	/* Cell k where height[k] <= x < height[k + 1], extending extremes */
+	int k = 0;
+	if (x < q->height[0]) {
+		q->height[0] = x;
+	}
+	else
+	if (x >= q->height[4]) {
+		q->height[4] = x;
+		k = 3;
+	}
+	else {
+		while (k < 3 && x >= q->height[k + 1])
+			k++;
+	}
+
+	for (int i = k + 1; i < QUANTILE_MARKERS; ++i)
+		q->pos[i] += 1.0;
+	for (int i = 0; i < QUANTILE_MARKERS; ++i)
+		q->desired[i] += q->inc[i];
+
+	/* Move inner markers towards desired position if off by one or more */
+	for (int i = 1; i < QUANTILE_MARKERS - 1; ++i) {
+		const double d = q->desired[i] - q->pos[i];
+		if ((d >= 1.0 && q->pos[i + 1] - q->pos[i] > 1.0) ||
+			(d <= -1.0 && q->pos[i - 1] - q->pos[i] < -1.0)) {
+			const int s = d > 0 ? 1 : -1;
+			double h = parabolic(q, i, s);
+			if (h <= q->height[i - 1] || h >= q->height[i + 1])
+				h = linear(q, i, s);
+			q->height[i] = h;
+			q->pos[i] += s;
+		}
+	}
+	q->count++;
+}
+
+double quantile_get(const struct quantile* q)
+{
+	if (q->count == 0)
+		return 0.0;
+	if (q->count < QUANTILE_MARKERS) {
+		double v[QUANTILE_MARKERS];
+		memcpy(v, q->height, sizeof(double) * q->count);
+		sort(v, q->count);
+		size_t i = (size_t) (q->p * (q->count - 1) + 0.5);
+		return v[i];
+	}
+	return q->height[2];
+}
@@ -0,0 +1,36 @@
+#ifndef QUANTILE__H__
+#define QUANTILE__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streaming quantile estimate using the P-square algorithm (Jain & Chlamtac).
+ * Constant memory, five markers, no allocation.
+ */
+
+#define QUANTILE_MARKERS 5
+
+struct quantile {
+	double p;							// Quantile estimated, 0.0 to 1.0
+	uint64_t count;						// Observations added
+	double height[QUANTILE_MARKERS];	// Marker heights, height[2] is the estimate
+	double pos[QUANTILE_MARKERS];		// Actual marker positions
+	double desired[QUANTILE_MARKERS];	// Desired marker positions
+	double inc[QUANTILE_MARKERS];		// Desired position increment per observation
+};
+
+void quantile_init(struct quantile* q, double p);
+void quantile_add(struct quantile* q, double x);
+/* Current estimate, exact while fewer than QUANTILE_MARKERS observations.
+ * Returns 0.0 if no observations. */
+double quantile_get(const struct quantile* q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUANTILE__H__ */
@@ -71,3 +71,8 @@ uint32_t ringbuf_pop(struct ringbuf* buf)
 	buf->size--;
 	return data;
 }
+
+uint32_t ringbuf_peek(const struct ringbuf* buf, size_t index)
+{
+	return buf->data[(buf->tail + index) % buf->max];
+}
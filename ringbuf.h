@@ -20,6 +20,9 @@ int ringbuf_full(const struct ringbuf* buf);
 void ringbuf_push(struct ringbuf* buf, uint32_t data);
 /* Callers responsibility to check buffer not empty */
 uint32_t ringbuf_pop(struct ringbuf* buf);
+/* Read entry index counted from tail (oldest) without removing it.
+ * Callers responsibility to check index < size */
+uint32_t ringbuf_peek(const struct ringbuf* buf, size_t index);
 
 #ifdef __cplusplus
 }
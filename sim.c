@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "sim.h"
+
+static int sim_push(struct sim* sim, size_t* capacity, uint64_t time_ms, enum sim_command command, long long value)
+{
+	if (sim->count == *capacity) {
+		const size_t n = *capacity ? *capacity * 2 : 256;
+		struct sim_event *events = realloc(sim->events, n * sizeof(struct sim_event));
+		if (!events)
+			return -ENOMEM;
+		sim->events = events;
+		*capacity = n;
+	}
+	sim->events[sim->count].time_ms = time_ms;
+	sim->events[sim->count].command = command;
+	sim->events[sim->count].value = value;
+	sim->count++;
+	return 0;
+}
+
+int sim_load(struct sim* sim, const char* path, FILE* out)
+{
+	memset(sim, 0, sizeof(struct sim));
+	sim->out = out;
+
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	int r = 0;
+	size_t capacity = 0;
+	char line[256];
+	uint64_t last_ms = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		uint64_t time_ms = 0;
+		char command[32];
+		long long value = 0;
+		const int n = sscanf(line, "%" SCNu64 " %31s %lld", &time_ms, command, &value);
+		if (n < 2 || time_ms < last_ms) {
+			r = -EINVAL;
+			break;
+		}
+		last_ms = time_ms;
+
+		if (!strcmp(command, "max_brightness") && n == 3 && time_ms == 0 && value > 0 && value <= UINT32_MAX)
+			sim->max_brightness = value;
+		else
+		if (!strcmp(command, "brightness") && n == 3 && time_ms == 0 && value >= 0 && value <= UINT32_MAX)
+			sim->brightness = value;
+		else
+		if (!strcmp(command, "lux") && n == 3 && value >= 0 && value <= UINT32_MAX) {
+			/* Readings at time 0 are in place before first advance, for startup seeding */
+			if (time_ms == 0)
+				sim->lux = value;
+			r = sim_push(sim, &capacity, time_ms, SIM_LUX, value);
+		}
+		else
+		if (!strcmp(command, "prox") && n == 3) {
+			if (time_ms == 0)
+				sim->proximity = value;
+			r = sim_push(sim, &capacity, time_ms, SIM_PROX, value);
+		}
+		else
+		if (!strcmp(command, "trigger") && n == 2)
+			r = sim_push(sim, &capacity, time_ms, SIM_TRIGGER, 0);
+		else
+		if (!strcmp(command, "end") && n == 2)
+			r = sim_push(sim, &capacity, time_ms, SIM_END, 0);
+		else
+			r = -EINVAL;
+		if (r)
+			break;
+	}
+	if (!r && ferror(fp))
+		r = -EIO;
+	if (!r && (sim->max_brightness == 0 || sim->brightness > sim->max_brightness))
+		r = -EINVAL;
+	fclose(fp);
+	if (r)
+		sim_free(sim);
+	return r;
+}
+
+void sim_free(struct sim* sim)
+{
+	free(sim->events);
+	sim->events = NULL;
+	sim->count = 0;
+	sim->next = 0;
+}
+
+void sim_now(const struct sim* sim, struct timespec* ts)
+{
+	ts->tv_sec = sim->now_ms / 1000;
+	ts->tv_nsec = (sim->now_ms % 1000) * 1000000L;
+}
+
+int sim_advance(struct sim* sim, int timeout_ms)
+{
+	if (sim->next >= sim->count)
+		return -ECANCELED;
+
+	const uint64_t target = timeout_ms < 0 ? UINT64_MAX : sim->now_ms + timeout_ms;
+	int triggers = 0;
+	while (sim->next < sim->count) {
+		const struct sim_event *ev = &sim->events[sim->next];
+		if (ev->time_ms > target)
+			break;
+		/* Stop at first trigger, but apply everything else happening at the same time */
+		if (triggers && ev->time_ms > sim->now_ms)
+			return triggers;
+		sim->now_ms = ev->time_ms > sim->now_ms ? ev->time_ms : sim->now_ms;
+		sim->next++;
+		switch (ev->command) {
+		case SIM_LUX:
+			sim->lux = ev->value;
+			break;
+		case SIM_PROX:
+			sim->proximity = ev->value;
+			break;
+		case SIM_TRIGGER:
+			triggers++;
+			break;
+		case SIM_END:
+			return -ECANCELED;
+		}
+	}
+	if (triggers)
+		return triggers;
+	if (target == UINT64_MAX)
+		return -ECANCELED;
+	sim->now_ms = target;
+	return 0;
+}
+
+void sim_write(struct sim* sim, uint32_t value)
+{
+	sim->brightness = value;
+	sim->writes++;
+	if (sim->out)
+		fprintf(sim->out, "%" PRIu64 " %" PRIu32 "\n", sim->now_ms, value);
+}
@@ -0,0 +1,72 @@
+#ifndef SIM__H__
+#define SIM__H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Scripted inputs under a virtual clock, for running backlightctl faster than real time.
+ *
+ * Script has one event per line: "time_ms command [value]", times increasing.
+ * Commands:
+ *   max_brightness N  Max brightness step, time must be 0
+ *   brightness N      Initial brightness step, time must be 0
+ *   lux N             Ambient light from now on
+ *   prox N            Proximity raw value from now on
+ *   trigger           Interrupt/input trigger
+ *   end               End simulation
+ * Lines starting with # are ignored.
+ * Simulation ends when all events are applied, add end to keep running after last change.
+ */
+
+enum sim_command {
+	SIM_LUX,
+	SIM_PROX,
+	SIM_TRIGGER,
+	SIM_END,
+};
+
+struct sim_event {
+	uint64_t time_ms;
+	enum sim_command command;
+	long long value;
+};
+
+struct sim {
+	struct sim_event *events;
+	size_t count;
+	size_t next;				// Next event to apply
+	uint64_t now_ms;			// Virtual CLOCK_MONOTONIC
+	uint32_t max_brightness;
+	uint32_t brightness;		// Last written brightness
+	uint32_t lux;
+	long long proximity;
+	FILE *out;					// Brightness writes are logged here
+	unsigned long long writes;
+};
+
+/* Returns 0 on success or negative errno */
+int sim_load(struct sim* sim, const char* path, FILE* out);
+void sim_free(struct sim* sim);
+
+void sim_now(const struct sim* sim, struct timespec* ts);
+
+/* Advance virtual clock timeout_ms, or to next trigger if sooner.
+ * timeout_ms -1 means no timeout.
+ * Events passed are applied.
+ * Returns number of triggers at new time, or -ECANCELED when simulation ended. */
+int sim_advance(struct sim* sim, int timeout_ms);
+
+/* Record brightness write as "time_ms value" */
+void sim_write(struct sim* sim, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM__H__ */
@@ -0,0 +1,254 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "source.h"
+
+static int64_t timespec_to_ns(const struct timespec* ts)
+{
+	return (int64_t) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void timespec_add_ms(struct timespec* ts, const struct timespec* base, int ms)
+{
+	const int64_t ns = timespec_to_ns(base) + (int64_t) ms * 1000000LL;
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static int poll_fd(struct source_registry* reg, struct source* source)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = source->events;
+	ev.data.ptr = source;
+	if (epoll_ctl(reg->epfd, EPOLL_CTL_ADD, source->fd, &ev) != 0)
+		return -errno;
+	return 0;
+}
+
+int source_registry_init(struct source_registry* reg)
+{
+	memset(reg, 0, sizeof(struct source_registry));
+	reg->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (reg->epfd < 0)
+		return -errno;
+	return 0;
+}
+
+void source_registry_free(struct source_registry* reg)
+{
+	for (size_t i = 0; i < reg->count; ++i)
+		reg->sources[i]->registered = 0;
+	reg->count = 0;
+	if (reg->epfd >= 0) {
+		close(reg->epfd);
+		reg->epfd = -1;
+	}
+}
+
+int source_add(struct source_registry* reg, struct source* source, const struct timespec* now)
+{
+	if (source->registered)
+		return -EEXIST;
+	if (reg->count >= SOURCE_MAX)
+		return -ENOSPC;
+	if ((source->fd >= 0 && !source->ready) || (source->interval_ms > 0 && !source->sample))
+		return -EINVAL;
+
+	source->masked = 0;
+	if (source->fd >= 0) {
+		const int r = poll_fd(reg, source);
+		if (r)
+			return r;
+	}
+	if (source->interval_ms > 0)
+		timespec_add_ms(&source->next, now, source->interval_ms);
+
+	reg->sources[reg->count++] = source;
+	source->reg = reg;
+	source->registered = 1;
+	return 0;
+}
+
+int source_remove(struct source_registry* reg, struct source* source)
+{
+	for (size_t i = 0; i < reg->count; ++i) {
+		if (reg->sources[i] != source)
+			continue;
+		if (source->fd >= 0 && !source->masked && epoll_ctl(reg->epfd, EPOLL_CTL_DEL, source->fd, NULL) != 0)
+			return -errno;
+		reg->sources[i] = reg->sources[--reg->count];
+		source->registered = 0;
+		source->reg = NULL;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+int source_set_interval(struct source_registry* reg, struct source* source, int interval_ms, const struct timespec* now)
+{
+	(void) reg;
+	if (interval_ms > 0 && !source->sample)
+		return -EINVAL;
+	source->interval_ms = interval_ms;
+	if (interval_ms > 0)
+		timespec_add_ms(&source->next, now, interval_ms);
+	return 0;
+}
+
+int source_set_masked(struct source_registry* reg, struct source* source, int masked)
+{
+	if (!source->registered || source->fd < 0)
+		return -EINVAL;
+	if (!!masked == source->masked)
+		return 0;
+	if (masked) {
+		if (epoll_ctl(reg->epfd, EPOLL_CTL_DEL, source->fd, NULL) != 0)
+			return -errno;
+	}
+	else {
+		const int r = poll_fd(reg, source);
+		if (r)
+			return r;
+	}
+	source->masked = !!masked;
+	return 0;
+}
+
+int source_timeout_ms(const struct source_registry* reg, const struct timespec* now)
+{
+	int64_t min_ns = -1;
+	const int64_t now_ns = timespec_to_ns(now);
+	for (size_t i = 0; i < reg->count; ++i) {
+		const struct source *source = reg->sources[i];
+		if (source->interval_ms <= 0 && !source->faulted)
+			continue;
+		int64_t left = timespec_to_ns(&source->next) - now_ns;
+		if (left < 0)
+			left = 0;
+		if (min_ns < 0 || left < min_ns)
+			min_ns = left;
+	}
+	if (min_ns < 0)
+		return -1;
+	/* Round up, waking early would only spin */
+	return (int) ((min_ns + 999999LL) / 1000000LL);
+}
+
+int source_wait(struct source_registry* reg, int timeout_ms, struct source_sample* sample)
+{
+	struct epoll_event events[SOURCE_MAX];
+	const int ready = epoll_wait(reg->epfd, events, SOURCE_MAX, timeout_ms);
+	if (ready < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	for (int i = 0; i < ready; ++i) {
+		struct source *source = events[i].data.ptr;
+		const int r = source->ready(source, events[i].events, sample);
+		if (source->faulted)
+			continue;
+		if (r) {
+			if (!source->retry)
+				return r;
+			/* Due at once, first retry only waits for the next loop iteration */
+			source->errors++;
+			source->failures++;
+			source->faulted = 1;
+			source->next.tv_sec = 0;
+			source->next.tv_nsec = 0;
+			const int err = source_set_masked(reg, source, 1);
+			if (err)
+				return err;
+			continue;
+		}
+		source->failures = 0;
+	}
+	return ready;
+}
+
+int source_due(const struct source* source, const struct timespec* now)
+{
+	return source->interval_ms > 0 && timespec_to_ns(&source->next) <= timespec_to_ns(now);
+}
+
+/* Delay after failures, doubling from period */
+static void backoff(struct source* source, const struct timespec* now)
+{
+	int64_t ms = source->interval_ms > 0 ? source->interval_ms : SOURCE_RETRY_MS;
+	for (unsigned int n = 1; n < source->failures && ms < SOURCE_MAX_BACKOFF_MS; ++n)
+		ms *= 2;
+	timespec_add_ms(&source->next, now, ms < SOURCE_MAX_BACKOFF_MS ? ms : SOURCE_MAX_BACKOFF_MS);
+}
+
+int source_fault(struct source_registry* reg, struct source* source, const struct timespec* now)
+{
+	const int r = source_set_masked(reg, source, 1);
+	if (r)
+		return r;
+	source->errors++;
+	source->failures++;
+	source->faulted = 1;
+	backoff(source, now);
+	return 0;
+}
+
+/* Reopen faulted source and poll it again */
+static void retry_faulted(struct source_registry* reg, struct source* source, const struct timespec* now)
+{
+	int r = source->recover ? source->recover(source) : 0;
+	if (r == 0)
+		r = source_set_masked(reg, source, 0);
+	if (r) {
+		source->errors++;
+		source->failures++;
+		backoff(source, now);
+		return;
+	}
+	source->faulted = 0;
+	if (source->recover)
+		source->recoveries++;
+	if (source->interval_ms > 0)
+		timespec_add_ms(&source->next, now, source->interval_ms);
+}
+
+int source_sample_due(struct source_registry* reg, const struct timespec* now, int all, struct source_sample* sample)
+{
+	int count = 0;
+	const int64_t now_ns = timespec_to_ns(now);
+	for (size_t i = 0; i < reg->count; ++i) {
+		struct source *source = reg->sources[i];
+		if (source->faulted) {
+			if (timespec_to_ns(&source->next) <= now_ns)
+				retry_faulted(reg, source, now);
+			continue;
+		}
+		if (source->interval_ms <= 0)
+			continue;
+		if ((!all || source->failures) && !source_due(source, now))
+			continue;
+		const int r = source->sample(source, sample);
+		if (source->faulted)
+			continue;
+		if (r) {
+			if (!source->retry)
+				return r;
+			source->errors++;
+			source->failures++;
+			if (source->recover && source->failures % SOURCE_RECOVER_FAILURES == 0) {
+				if (source->recover(source) == 0)
+					source->recoveries++;
+			}
+			backoff(source, now);
+			continue;
+		}
+		source->failures = 0;
+		count++;
+		/* Keep period, but never try to catch up on missed samples */
+		timespec_add_ms(&source->next, &source->next, source->interval_ms);
+		if (timespec_to_ns(&source->next) <= now_ns)
+			timespec_add_ms(&source->next, now, source->interval_ms);
+	}
+	return count;
+}
@@ -0,0 +1,116 @@
+#ifndef SOURCE__H__
+#define SOURCE__H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "libbacklight.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOURCE_MAX 32
+#define SOURCE_RETRY_MS 100				// First retry of a source without period
+#define SOURCE_MAX_BACKOFF_MS 2000		// Longest delay between retries
+#define SOURCE_RECOVER_FAILURES 3		// Consecutive failed samples before recover()
+
+enum source_caps {
+	SOURCE_TRIGGER = 1 << 0,	// Contributes trigger
+	SOURCE_LUX = 1 << 1,		// Contributes lux
+};
+
+/* Collected from all sources handled during one wakeup */
+struct source_sample {
+	int trigger;				// Any source triggered
+	int trigger_ts_set;			// trigger_ts holds time of latest trigger, otherwise trigger happened now
+	struct timespec trigger_ts;
+	int lux_set;				// lux holds new sensor readings
+	uint32_t lux[LIBBACKLIGHT_MAX_SENSORS];	// One per sensor, LIBBACKLIGHT_LUX_INVALID if failed
+	int quit;					// Source requests exit
+	int reload;					// Source requests configuration reload
+	int brightness_changed;		// Source changed controller brightness, caller writes it
+};
+
+struct source;
+struct source_registry;
+
+/* Called when fd is ready, events is the epoll event mask.
+ * Returns 0 on success or negative errno. */
+typedef int (*source_ready_fn)(struct source* source, uint32_t events, struct source_sample* sample);
+/* Called every interval_ms.
+ * Returns 0 on success or negative errno. */
+typedef int (*source_sample_fn)(struct source* source, struct source_sample* sample);
+/* Reopen source after failures, fd may be replaced.
+ * Returns 0 on success or negative errno. */
+typedef int (*source_recover_fn)(struct source* source);
+
+struct source {
+	const char *name;
+	int fd;						// Polled fd, -1 if none
+	uint32_t events;			// epoll events to wait for on fd
+	int interval_ms;			// Sample period, 0 if not periodically sampled
+	unsigned int caps;			// enum source_caps
+	source_ready_fn ready;
+	source_sample_fn sample;
+	int retry;					// Failures are retried with backoff instead of returned
+	source_recover_fn recover;	// Called on retry after failures if set
+	void *priv;					// Owned by caller
+	/* Managed by registry */
+	struct source_registry *reg;	// Registry source is added to, for use in callbacks
+	struct timespec next;		// Next time sample or retry is due
+	int registered;
+	int masked;					// fd temporarily not polled
+	int faulted;				// ready() failed, fd masked until recovered
+	unsigned int failures;		// Consecutive failures, 0 while healthy
+	unsigned long long errors;	// All failures
+	unsigned long long recoveries;	// Successful recover() calls
+};
+
+/* Fixed size registry, sources are owned by caller and must outlive registration. */
+struct source_registry {
+	int epfd;
+	size_t count;
+	struct source *sources[SOURCE_MAX];
+};
+
+int source_registry_init(struct source_registry* reg);
+void source_registry_free(struct source_registry* reg);
+
+/* First periodic sample is due interval_ms after now */
+int source_add(struct source_registry* reg, struct source* source, const struct timespec* now);
+int source_remove(struct source_registry* reg, struct source* source);
+/* Change sample period, interval_ms 0 stops periodic sampling */
+int source_set_interval(struct source_registry* reg, struct source* source, int interval_ms, const struct timespec* now);
+
+/* Temporarily stop/resume polling fd, periodic sampling is not affected.
+ * May be called from callbacks. */
+int source_set_masked(struct source_registry* reg, struct source* source, int masked);
+
+/* Mask fd and mark source faulted, source_sample_due() recovers it after backoff.
+ * For callbacks failing to restore polling themselves. */
+int source_fault(struct source_registry* reg, struct source* source, const struct timespec* now);
+
+/* Return time in ms until next periodic sample is due, -1 if no periodic source */
+int source_timeout_ms(const struct source_registry* reg, const struct timespec* now);
+
+/* Wait up to timeout_ms for fd sources and call ready() for each ready source.
+ * A retried source failing ready() is masked and faulted, source_sample_due() recovers it.
+ * Returns number of ready sources or negative errno. */
+int source_wait(struct source_registry* reg, int timeout_ms, struct source_sample* sample);
+
+/* Returns 1 if source is periodic and its next sample is due at now */
+int source_due(const struct source* source, const struct timespec* now);
+
+/* Call sample() for each periodic source due at now, or every periodic source if all is set.
+ * A retried source failing sample() is next sampled after a backoff doubling up to SOURCE_MAX_BACKOFF_MS,
+ * recover() is called every SOURCE_RECOVER_FAILURES failures. Sources backing off are only sampled when due.
+ * Faulted sources due are recovered and polled again, on failure retried after backoff.
+ * Returns number of sampled sources or negative errno. */
+int source_sample_due(struct source_registry* reg, const struct timespec* now, int all, struct source_sample* sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SOURCE__H__ */
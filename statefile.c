@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "statefile.h"
+
+struct statefile* statefile_open(const char* path)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+
+	struct statefile *file = NULL;
+	uint32_t magic = 0;
+	const ssize_t n = pread(fd, &magic, sizeof(magic), 0);
+	struct stat st;
+	if (n < 0 || fstat(fd, &st) != 0)
+		goto exit;
+	/* Anything but an empty file or one of ours is left alone */
+	if (st.st_size > 0 && ((size_t) n < sizeof(magic) || magic != STATEFILE_MAGIC)) {
+		errno = EEXIST;
+		goto exit;
+	}
+	if (ftruncate(fd, sizeof(struct statefile)) != 0)
+		goto exit;
+	file = mmap(NULL, sizeof(struct statefile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (file == MAP_FAILED)
+		file = NULL;
+	else
+	if (st.st_size == 0) {
+		/* Claim the file before anything is stored, seq stays 0 until then */
+		file->version = STATEFILE_VERSION;
+		file->magic = STATEFILE_MAGIC;
+	}
+exit:
+	if (!file) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	close(fd);
+	return file;
+}
+
+void statefile_close(struct statefile** file)
+{
+	if (*file) {
+		munmap(*file, sizeof(struct statefile));
+		*file = NULL;
+	}
+}
+
+static int check(const struct statefile* file)
+{
+	if (file->seq == 0)
+		return -ENOENT;
+	if (file->magic != STATEFILE_MAGIC || file->version != STATEFILE_VERSION)
+		return -EINVAL;
+	/* Odd means process died in the middle of an update */
+	if (file->seq & 1)
+		return -EINVAL;
+	return 0;
+}
+
+/* Forced odd rather than incremented, an update interrupted by a crash is not left odd forever */
+static void begin_update(struct statefile* file)
+{
+	file->seq |= 1;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	file->magic = STATEFILE_MAGIC;
+	file->version = STATEFILE_VERSION;
+}
+
+static void end_update(struct statefile* file)
+{
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	file->seq++;
+}
+
+int statefile_load(const struct statefile* file, struct libbacklight_state* state)
+{
+	const int r = check(file);
+	if (r)
+		return r;
+	if (file->state.samples > LIBBACKLIGHT_STATE_MAX_SAMPLES)
+		return -EINVAL;
+	memcpy(state, &file->state, sizeof(struct libbacklight_state));
+	return 0;
+}
+
+void statefile_store(struct statefile* file, const struct libbacklight_state* state)
+{
+	if (check(file) == 0 && memcmp(&file->state, state, sizeof(struct libbacklight_state)) == 0)
+		return;
+	begin_update(file);
+	memcpy(&file->state, state, sizeof(struct libbacklight_state));
+	end_update(file);
+}
+
+int statefile_load_energy(const struct statefile* file, struct energy_counters* energy)
+{
+	const int r = check(file);
+	if (r)
+		return r;
+	memcpy(energy, &file->energy, sizeof(struct energy_counters));
+	return 0;
+}
+
+void statefile_store_energy(struct statefile* file, const struct energy_counters* energy)
+{
+	begin_update(file);
+	memcpy(&file->energy, energy, sizeof(struct energy_counters));
+	end_update(file);
+}
@@ -0,0 +1,45 @@
+#ifndef STATEFILE__H__
+#define STATEFILE__H__
+
+#include <stdint.h>
+#include "libbacklight.h"
+#include "energy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Memory mapped file holding controller state across restarts.
+ * Meant to live on tmpfs, for example /run, and is never synced. */
+
+#define STATEFILE_MAGIC 0x424c5354 // "BLST"
+#define STATEFILE_VERSION 3
+
+struct statefile {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;					// Odd while update in progress
+	uint32_t reserved;
+	struct libbacklight_state state;
+	struct energy_counters energy;
+};
+
+/* Open or create path.
+ * Returns NULL on failure with errno set, EEXIST if path is a non-empty file that is not a state file. */
+struct statefile* statefile_open(const char* path);
+void statefile_close(struct statefile** file);
+
+/* Returns 0 on success, -ENOENT if nothing stored or -EINVAL if content is incomplete or incompatible. */
+int statefile_load(const struct statefile* file, struct libbacklight_state* state);
+/* Only touches mapping if state changed */
+void statefile_store(struct statefile* file, const struct libbacklight_state* state);
+
+/* Cumulative energy counters, same return values as statefile_load() */
+int statefile_load_energy(const struct statefile* file, struct energy_counters* energy);
+void statefile_store_energy(struct statefile* file, const struct energy_counters* energy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATEFILE__H__ */
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "status.h"
+
+struct status_page* status_create(const char* name)
+{
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return NULL;
+
+	struct status_page *page = NULL;
+	if (ftruncate(fd, sizeof(struct status_page)) != 0)
+		goto exit;
+	page = mmap(NULL, sizeof(struct status_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED)
+		page = NULL;
+exit:
+	if (!page) {
+		const int err = errno;
+		shm_unlink(name);
+		errno = err;
+	}
+	close(fd);
+	if (page)
+		status_init(page);
+	return page;
+}
+
+void status_destroy(struct status_page** page, const char* name)
+{
+	if (*page) {
+		munmap(*page, sizeof(struct status_page));
+		*page = NULL;
+		shm_unlink(name);
+	}
+}
+
+void status_init(struct status_page* page)
+{
+	memset(page, 0, sizeof(struct status_page));
+	page->magic = STATUS_MAGIC;
+	page->version = STATUS_VERSION;
+	__atomic_store_n(&page->seq, 0, __ATOMIC_RELEASE);
+}
+
+void status_publish(struct status_page* page, const struct status_values* values)
+{
+	const uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&page->values, values, sizeof(struct status_values));
+	__atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int status_read(const struct status_page* page, struct status_values* values)
+{
+	if (page->magic != STATUS_MAGIC || page->version != STATUS_VERSION)
+		return -EINVAL;
+
+	uint32_t begin = 0;
+	uint32_t end = 0;
+	do {
+		begin = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (begin & 1)
+			continue;
+		memcpy(values, &page->values, sizeof(struct status_values));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		end = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	} while ((begin & 1) || begin != end);
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef STATUS__H__
+#define STATUS__H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Layout of POSIX shared memory status segment published by backlightctl.
+ * Readers map the segment read-only and take snapshots with status_read(),
+ * writer is never blocked by readers. */
+
+#define STATUS_MAGIC 0x424c4354 // "BLCT"
+#define STATUS_VERSION 1
+
+struct status_values {
+	uint32_t brightness_step;		// Current brightness step, 0 means off
+	uint32_t max_brightness_step;
+	uint32_t filtered_lux;			// Averaged lux used for decision, 0 if sensor disabled
+	uint32_t raw_lux;				// Last sensor reading, 0 if sensor disabled
+	int32_t triggered;				// Trigger active during last iteration
+	int32_t reserved;
+	int64_t timeout_ms;				// Time until trigger timeout, -1 if trigger disabled
+	int64_t updated_ms;				// CLOCK_MONOTONIC of last update
+};
+
+struct status_page {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;					// Odd while update in progress
+	uint32_t reserved;
+	struct status_values values;
+};
+
+/* Create and map shared memory segment name, for example "/backlightctl".
+ * Returns NULL on failure with errno set. */
+struct status_page* status_create(const char* name);
+/* Unmap and remove segment */
+void status_destroy(struct status_page** page, const char* name);
+
+/* Writer side, single writer only */
+void status_init(struct status_page* page);
+void status_publish(struct status_page* page, const struct status_values* values);
+
+/* Reader side, retries until consistent snapshot is read.
+ * Returns 0 on success, -EINVAL if page isn't a compatible status segment. */
+int status_read(const struct status_page* page, struct status_values* values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATUS__H__ */
@@ -0,0 +1,80 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include "config.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static void write_config(const char* path, const char* text)
+{
+	FILE *fp = fopen(path, "w");
+	REQUIRE(fp);
+	fputs(text, fp);
+	fclose(fp);
+}
+
+TEST_CASE("Test config") {
+	char path[] = "/tmp/test-config-XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.min_lux = 10;
+	conf.max_lux = 500;
+	conf.trigger_timeout.tv_sec = 30;
+	unsigned int line = 0;
+
+	SECTION("Load") {
+		write_config(path,
+			"# comment\n"
+			"lmax 1000\n"
+			"\n"
+			"time 60\n"
+			"window 20\n"
+			"auto-range 5:95\n"
+			"step-ratio 4\n"
+			"fusion median\n"
+			"weights 2,1\n");
+		REQUIRE(config_load(path, &conf, &line) == 0);
+		REQUIRE(conf.min_lux == 10);
+		REQUIRE(conf.max_lux == 1000);
+		REQUIRE(conf.trigger_timeout.tv_sec == 60);
+		REQUIRE(conf.sensor_window == 20);
+		REQUIRE(conf.enable_auto_range == 1);
+		REQUIRE(conf.auto_min_percentile == 5);
+		REQUIRE(conf.auto_max_percentile == 95);
+		REQUIRE(conf.step_ratio == 4);
+		REQUIRE(conf.fusion == LIBBACKLIGHT_FUSION_MEDIAN);
+		REQUIRE(conf.sensor_weight[0] == 2);
+		REQUIRE(conf.sensor_weight[1] == 1);
+		REQUIRE(conf.sensor_weight[2] == 0);
+	}
+
+	SECTION("Invalid leaves conf unchanged") {
+		write_config(path, "lmax 1000\nlmin -1\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		REQUIRE(line == 2);
+		REQUIRE(conf.max_lux == 500);
+
+		write_config(path, "brightness 5\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		write_config(path, "lmax 1000 2000\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		write_config(path, "lmax\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		write_config(path, "fusion min\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		write_config(path, "weights 1,2,3,4,5,6,7,8,9\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		write_config(path, "fault-ratio 1\n");
+		REQUIRE(config_load(path, &conf, &line) == -EINVAL);
+		REQUIRE(config_load("/nonexistent/config", &conf, &line) == -ENOENT);
+	}
+
+	unlink(path);
+}
@@ -0,0 +1,176 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "control.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static int handle(void* priv, const struct control_request* request, char* reply, size_t len)
+{
+	uint32_t *step = (uint32_t*) priv;
+	if (request->command == CONTROL_OVERRIDE) {
+		if (request->value > 10)
+			return -EINVAL;
+		*step = request->value;
+	}
+	snprintf(reply, len, "ok brightness %u", *step);
+	return 0;
+}
+
+static int client(const char* path)
+{
+	const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	REQUIRE(fd >= 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	REQUIRE(connect(fd, (const struct sockaddr*) &addr, sizeof(addr)) == 0);
+	return fd;
+}
+
+static std::string request(int fd, struct control* control, uint32_t* step, const char* text)
+{
+	REQUIRE(send(fd, text, strlen(text), 0) == (ssize_t) strlen(text));
+	// First dispatch may only accept the client
+	for (int i = 0; i < 2; ++i)
+		REQUIRE(control_dispatch(control, handle, step) >= 0);
+	char reply[CONTROL_MESSAGE_MAX];
+	const ssize_t n = recv(fd, reply, sizeof(reply), MSG_DONTWAIT);
+	REQUIRE(n > 0);
+	return std::string(reply, n);
+}
+
+TEST_CASE("Test control parse") {
+	struct control_request req;
+	REQUIRE(control_parse("query", 5, &req) == 0);
+	REQUIRE(req.command == CONTROL_QUERY);
+	REQUIRE(control_parse("resume\n", 7, &req) == 0);
+	REQUIRE(req.command == CONTROL_RESUME);
+	REQUIRE(control_parse("override 7", 10, &req) == 0);
+	REQUIRE(req.command == CONTROL_OVERRIDE);
+	REQUIRE(req.value == 7);
+	REQUIRE(control_parse("inhibit 300", 11, &req) == 0);
+	REQUIRE(req.command == CONTROL_INHIBIT);
+	REQUIRE(req.value == 300);
+
+	// Only len bytes are parsed
+	REQUIRE(control_parse("override 12", 10, &req) == 0);
+	REQUIRE(req.value == 1);
+
+	REQUIRE(control_parse("", 0, &req) == -EINVAL);
+	REQUIRE(control_parse("override", 8, &req) == -EINVAL);
+	REQUIRE(control_parse("override -1", 11, &req) == -EINVAL);
+	REQUIRE(control_parse("override 1x", 11, &req) == -EINVAL);
+	REQUIRE(control_parse("inhibit 99999999999", 19, &req) == -EINVAL);
+	REQUIRE(control_parse("query 1", 7, &req) == -EINVAL);
+	REQUIRE(control_parse("override 1 2", 12, &req) == -EINVAL);
+	REQUIRE(control_parse("dim 1", 5, &req) == -EINVAL);
+}
+
+TEST_CASE("Test control socket") {
+	char dir[] = "/tmp/test-control-XXXXXX";
+	REQUIRE(mkdtemp(dir));
+	const std::string path = std::string(dir) + "/ctl";
+
+	struct control control;
+	uint32_t step = 3;
+	REQUIRE(control_init(&control, path.c_str()) == 0);
+	REQUIRE(control_fd(&control) >= 0);
+
+	SECTION("Requests") {
+		const int fd = client(path.c_str());
+		REQUIRE(request(fd, &control, &step, "query") == "ok brightness 3");
+		REQUIRE(request(fd, &control, &step, "override 8") == "ok brightness 8");
+		REQUIRE(step == 8);
+		REQUIRE(request(fd, &control, &step, "override 11") == "error Invalid argument");
+		REQUIRE(request(fd, &control, &step, "bogus") == "error Invalid argument");
+		REQUIRE(step == 8);
+		REQUIRE(control.requests == 4);
+		REQUIRE(control.errors == 2);
+		close(fd);
+	}
+
+	SECTION("Several clients") {
+		int fds[4];
+		for (int i = 0; i < 4; ++i) {
+			fds[i] = client(path.c_str());
+			REQUIRE(send(fds[i], "query", 5, 0) == 5);
+		}
+		int served = 0;
+		for (int i = 0; i < 3; ++i)
+			served += control_dispatch(&control, handle, &step);
+		REQUIRE(served == 4);
+		for (int i = 0; i < 4; ++i) {
+			char reply[CONTROL_MESSAGE_MAX];
+			REQUIRE(recv(fds[i], reply, sizeof(reply), MSG_DONTWAIT) > 0);
+			close(fds[i]);
+		}
+		// Closed clients are dropped
+		REQUIRE(control_dispatch(&control, handle, &step) == 0);
+		for (int i = 0; i < CONTROL_MAX_CLIENTS; ++i)
+			REQUIRE(control.clients[i] == -1);
+	}
+
+	SECTION("Too many clients") {
+		int fds[CONTROL_MAX_CLIENTS + 1];
+		for (int i = 0; i <= CONTROL_MAX_CLIENTS; ++i) {
+			fds[i] = client(path.c_str());
+			REQUIRE(control_dispatch(&control, handle, &step) == 0);
+		}
+		REQUIRE(control.rejected == 1);
+		char reply[CONTROL_MESSAGE_MAX];
+		REQUIRE(recv(fds[CONTROL_MAX_CLIENTS], reply, sizeof(reply), 0) == 0);
+		for (int i = 0; i <= CONTROL_MAX_CLIENTS; ++i)
+			close(fds[i]);
+	}
+
+	SECTION("Running instance kept") {
+		struct control again;
+		REQUIRE(control_init(&again, path.c_str()) == -EADDRINUSE);
+		const int fd = client(path.c_str());
+		REQUIRE(request(fd, &control, &step, "query") == "ok brightness 3");
+		close(fd);
+	}
+
+	SECTION("Stale socket replaced") {
+		// Bound but closed without unlink, as after a crash
+		const std::string stale = std::string(dir) + "/stale";
+		const int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+		REQUIRE(sock >= 0);
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, stale.c_str());
+		REQUIRE(bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) == 0);
+		close(sock);
+
+		struct control again;
+		REQUIRE(control_init(&again, stale.c_str()) == 0);
+		const int fd = client(stale.c_str());
+		REQUIRE(request(fd, &again, &step, "query") == "ok brightness 3");
+		close(fd);
+		control_free(&again);
+		REQUIRE(access(stale.c_str(), F_OK) != 0);
+	}
+
+	SECTION("Other file kept") {
+		const std::string other = std::string(dir) + "/other";
+		FILE *fp = fopen(other.c_str(), "w");
+		REQUIRE(fp);
+		fclose(fp);
+		struct control again;
+		REQUIRE(control_init(&again, other.c_str()) == -EADDRINUSE);
+		REQUIRE(access(other.c_str(), F_OK) == 0);
+		unlink(other.c_str());
+	}
+
+	control_free(&control);
+	REQUIRE(access(path.c_str(), F_OK) != 0);
+	rmdir(dir);
+}
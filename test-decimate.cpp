@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include "decimate.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+/* Light level with mains flicker, sampled at rate_hz */
+static std::vector<int32_t> flicker(double rate_hz, double flicker_hz, double level, double depth, size_t n)
+{
+	std::vector<int32_t> v(n);
+	for (size_t i = 0; i < n; ++i)
+		v[i] = (int32_t) lround(level + depth * sin(2.0 * M_PI * flicker_hz * i / rate_hz + 0.3));
+	return v;
+}
+
+TEST_CASE("Test decimate init") {
+	struct decimate dec;
+	REQUIRE(decimate_init(&dec, 1000.0, 100) == 0);
+	REQUIRE(dec.factor == 100);
+	REQUIRE(decimate_init(&dec, 1000.0, 0) == -EINVAL);
+	REQUIRE(decimate_init(&dec, 1000.0, 75) == -EINVAL);
+	REQUIRE(decimate_init(&dec, 5.0, 50) == -EINVAL);
+	REQUIRE(decimate_init(&dec, 20.0, 50) == 0);
+	REQUIRE(dec.factor == 1);
+}
+
+TEST_CASE("Test decimate blocks") {
+	struct decimate dec;
+	REQUIRE(decimate_init(&dec, 200.0, 50) == 0);
+	REQUIRE(dec.factor == 10);
+
+	std::vector<int32_t> in(25);
+	for (size_t i = 0; i < in.size(); ++i)
+		in[i] = i;
+	double out[4];
+
+	SECTION("Whole") {
+		REQUIRE(decimate_run(&dec, in.data(), in.size(), out, 4) == 2);
+		REQUIRE(out[0] == 4.5);
+		REQUIRE(out[1] == 14.5);
+		REQUIRE(dec.count == 5);
+	}
+
+	SECTION("Split across calls") {
+		REQUIRE(decimate_run(&dec, in.data(), 7, out, 4) == 0);
+		REQUIRE(decimate_run(&dec, &in[7], 18, out, 4) == 2);
+		REQUIRE(out[0] == 4.5);
+		REQUIRE(out[1] == 14.5);
+	}
+
+	SECTION("Latest kept") {
+		REQUIRE(decimate_run(&dec, in.data(), 20, out, 1) == 1);
+		REQUIRE(out[0] == 14.5);
+		REQUIRE(decimate_run(&dec, in.data(), 0, out, 1) == 0);
+	}
+}
+
+TEST_CASE("Test decimate flicker rejection") {
+	const double rate = 1000.0;
+	const double hz[] = {100.0, 120.0, 200.0, 240.0};
+	for (double f : hz) {
+		struct decimate dec;
+		REQUIRE(decimate_init(&dec, rate, 100) == 0);
+		const std::vector<int32_t> in = flicker(rate, f, 500.0, 300.0, 2000);
+		double out[20];
+		REQUIRE(decimate_run(&dec, in.data(), in.size(), out, 20) == 20);
+		for (double lux : out)
+			REQUIRE(std::fabs(lux - 500.0) < 1.0);
+	}
+
+	/* Mains drifting off nominal, single reads every 100 ms alias it into a slow beat */
+	const std::vector<int32_t> in = flicker(rate, 100.5, 500.0, 300.0, 20000);
+	double worst = 0.0;
+	for (size_t i = 0; i < in.size(); i += 100)
+		worst = std::fmax(worst, std::fabs(in[i] - 500.0));
+	REQUIRE(worst > 200.0);
+
+	struct decimate dec;
+	REQUIRE(decimate_init(&dec, rate, 100) == 0);
+	double out[200];
+	REQUIRE(decimate_run(&dec, in.data(), in.size(), out, 200) == 200);
+	for (double lux : out)
+		REQUIRE(std::fabs(lux - 500.0) < 5.0);
+}
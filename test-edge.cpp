@@ -0,0 +1,146 @@
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include "edge.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static struct timespec at_ms(long long ms)
+{
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	return ts;
+}
+
+TEST_CASE("Test edge filter init") {
+	struct edge_filter filter;
+	REQUIRE(edge_filter_init(&filter, -1, 0, 0) == -EINVAL);
+	REQUIRE(edge_filter_init(&filter, 0, -1, 0) == -EINVAL);
+	REQUIRE(edge_filter_init(&filter, 0, 0, -1) == -EINVAL);
+	REQUIRE(edge_filter_init(&filter, 0, 0, 0) == 0);
+	REQUIRE(edge_filter_timed(&filter) == 0);
+	REQUIRE(edge_filter_init(&filter, 10, 0, 0) == 0);
+	REQUIRE(edge_filter_timed(&filter) == 1);
+	REQUIRE(edge_filter_init(&filter, 0, 10, 0) == 0);
+	REQUIRE(edge_filter_timed(&filter) == 1);
+}
+
+TEST_CASE("Test edge filter disabled") {
+	struct edge_filter filter;
+	REQUIRE(edge_filter_init(&filter, 0, 0, 1000) == 0);
+	// Every edge triggers, time isn't needed
+	for (int i = 0; i < 100; ++i)
+		REQUIRE(edge_filter_add(&filter, NULL) == EDGE_ACCEPTED);
+	REQUIRE(filter.edges == 100);
+	REQUIRE(filter.coalesced == 0);
+	REQUIRE(filter.storms == 0);
+}
+
+TEST_CASE("Test edge coalescing") {
+	struct edge_filter filter;
+	REQUIRE(edge_filter_init(&filter, 50, 0, 1000) == 0);
+
+	struct timespec now = at_ms(10000);
+	REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+
+	SECTION("Within window") {
+		now = at_ms(10001);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+		now = at_ms(10049);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+		REQUIRE(filter.coalesced == 2);
+	}
+
+	SECTION("After window") {
+		now = at_ms(10050);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+		REQUIRE(filter.coalesced == 0);
+	}
+
+	SECTION("Window follows accepted edge only") {
+		// Coalesced edges don't extend the window
+		for (long long ms = 10010; ms < 10050; ms += 10) {
+			now = at_ms(ms);
+			REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+		}
+		now = at_ms(10050);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+		now = at_ms(10060);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+		REQUIRE(filter.coalesced == 5);
+	}
+	REQUIRE(filter.storms == 0);
+}
+
+TEST_CASE("Test edge storm") {
+	struct edge_filter filter;
+	REQUIRE(edge_filter_init(&filter, 0, 5, 1000) == 0);
+
+	struct timespec now;
+	SECTION("Below threshold") {
+		// 5 edges per window, over several windows
+		for (int window = 0; window < 3; ++window) {
+			for (int i = 0; i < 5; ++i) {
+				now = at_ms(10000 + window * EDGE_STORM_WINDOW_MS + i * 100);
+				REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+			}
+		}
+		REQUIRE(filter.storms == 0);
+		REQUIRE(filter.storm == 0);
+	}
+
+	SECTION("Storm and hold") {
+		for (int i = 0; i < 5; ++i) {
+			now = at_ms(10000 + i);
+			REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+		}
+		now = at_ms(10005);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_STORM);
+		REQUIRE(filter.storms == 1);
+		REQUIRE(filter.storm == 1);
+
+		// Held until hold_ms after storm started
+		now = at_ms(10500);
+		REQUIRE(edge_filter_storm_over(&filter, &now) == 0);
+		now = at_ms(11004);
+		REQUIRE(edge_filter_storm_over(&filter, &now) == 0);
+		now = at_ms(11005);
+		REQUIRE(edge_filter_storm_over(&filter, &now) == 1);
+		REQUIRE(filter.storm == 0);
+		REQUIRE(edge_filter_storm_over(&filter, &now) == 0);
+
+		// Detection window starts over when unmasked
+		for (int i = 0; i < 5; ++i) {
+			now = at_ms(11006 + i);
+			REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+		}
+		now = at_ms(11011);
+		REQUIRE(edge_filter_add(&filter, &now) == EDGE_STORM);
+		REQUIRE(filter.storms == 2);
+	}
+
+	SECTION("No storm without edges") {
+		now = at_ms(20000);
+		REQUIRE(edge_filter_storm_over(&filter, &now) == 0);
+	}
+}
+
+TEST_CASE("Test edge storm and coalescing") {
+	struct edge_filter filter;
+	REQUIRE(edge_filter_init(&filter, 100, 3, 1000) == 0);
+
+	// Coalesced edges still count towards a storm
+	struct timespec now = at_ms(10000);
+	REQUIRE(edge_filter_add(&filter, &now) == EDGE_ACCEPTED);
+	now = at_ms(10010);
+	REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+	now = at_ms(10020);
+	REQUIRE(edge_filter_add(&filter, &now) == EDGE_COALESCED);
+	now = at_ms(10030);
+	REQUIRE(edge_filter_add(&filter, &now) == EDGE_STORM);
+	REQUIRE(filter.edges == 4);
+	REQUIRE(filter.coalesced == 2);
+	REQUIRE(filter.storms == 1);
+}
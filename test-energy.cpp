@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <cmath>
+#include "energy.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Test energy") {
+	struct energy energy;
+	energy_init(&energy, 100, 0.5, 0.02);
+	const struct timespec t0 = {10, 0};
+	const struct timespec t1 = {20, 0};
+	const struct timespec t2 = {25, 500000000};
+	const struct timespec t3 = {30, 0};
+
+	SECTION("Buckets") {
+		REQUIRE(energy_bucket(&energy, 0) == 0);
+		REQUIRE(energy_bucket(&energy, 1) == 1);
+		REQUIRE(energy_bucket(&energy, 100) == 10);
+		REQUIRE(energy_bucket(&energy, 200) == 10);
+	}
+
+	SECTION("Watts") {
+		REQUIRE(energy_watts(&energy, 0) == 0.0);
+		REQUIRE(std::fabs(energy_watts(&energy, 50) - 1.5) < 1e-9);
+	}
+
+	SECTION("Account") {
+		// Nothing accounted before first timestamp
+		energy_account(&energy, &t0, 50);
+		REQUIRE(energy.counters.lit_seconds == 0.0);
+
+		energy_account(&energy, &t1, 0);
+		energy_account(&energy, &t2, 100);
+		energy_account(&energy, &t3, 100);
+		const struct energy_counters *c = &energy.counters;
+		REQUIRE(std::fabs(c->lit_seconds - 14.5) < 1e-9);
+		REQUIRE(std::fabs(c->dark_seconds - 5.5) < 1e-9);
+		REQUIRE(std::fabs(c->step_seconds - (10 * 50 + 4.5 * 100)) < 1e-6);
+		REQUIRE(std::fabs(c->bucket_seconds[0] - 5.5) < 1e-9);
+		REQUIRE(std::fabs(c->bucket_seconds[5] - 10.0) < 1e-9);
+		REQUIRE(std::fabs(c->bucket_seconds[10] - 4.5) < 1e-9);
+		REQUIRE(std::fabs(c->joules - (10 * 1.5 + 4.5 * 2.5)) < 1e-6);
+		REQUIRE(std::fabs(c->full_joules - 20 * 2.5) < 1e-6);
+	}
+
+	SECTION("Clock going backwards ignored") {
+		energy_account(&energy, &t1, 10);
+		energy_account(&energy, &t0, 10);
+		REQUIRE(energy.counters.lit_seconds == 0.0);
+		energy_account(&energy, &t1, 10);
+		REQUIRE(energy.counters.lit_seconds == 10.0);
+	}
+
+	SECTION("Without power model") {
+		energy_init(&energy, 100, 0.0, 0.0);
+		energy_account(&energy, &t0, 50);
+		energy_account(&energy, &t1, 50);
+		REQUIRE(energy.counters.lit_seconds == 10.0);
+		REQUIRE(energy.counters.joules == 0.0);
+	}
+}
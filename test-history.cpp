@@ -0,0 +1,266 @@
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "libbacklight.h"
+#include "history.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static std::vector<struct history_record> read_all(const char* path)
+{
+	struct history_reader reader;
+	REQUIRE(history_reader_open(&reader, path) == 0);
+	std::vector<struct history_record> records;
+	struct history_record record;
+	int r;
+	while ((r = history_reader_next(&reader, &record)) == 1)
+		records.push_back(record);
+	REQUIRE(r == 0);
+	history_reader_close(&reader);
+	return records;
+}
+
+static void add(struct history* history, int64_t seconds, uint32_t lux, uint32_t step, int triggered)
+{
+	const struct timespec ts = {(time_t) seconds, 0};
+	history_add(history, &ts, lux, step, triggered);
+}
+
+TEST_CASE("Test history encoding") {
+	struct history_record last;
+	memset(&last, 0, sizeof(last));
+	last.minute = 1000;
+
+	struct history_record records[4];
+	memset(records, 0, sizeof(records));
+	records[0] = {1000, 5, 0, 1, 10, 20, 40};
+	records[1] = {1001, 4, 3, 0, 0, 0, 0};
+	records[2] = {999, UINT32_MAX, UINT32_MAX, 1, 0, 7, UINT32_MAX};
+	records[3] = {1002, 0, 1, 1, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+
+	uint8_t buf[4 * HISTORY_RECORD_MAX];
+	size_t len = 0;
+	struct history_record base = last;
+	for (const auto& record : records) {
+		const size_t n = history_encode(&buf[len], &record, &base);
+		REQUIRE(n > 0);
+		REQUIRE(n <= HISTORY_RECORD_MAX);
+		len += n;
+		const uint32_t avg = base.avg_lux;
+		base = record;
+		if (!record.has_lux)
+			base.avg_lux = avg;
+	}
+	// Same minute, unchanged step and small lux is a handful of bytes
+	REQUIRE(history_encode(buf + len, &records[0], &last) <= 6);
+
+	size_t offset = 0;
+	base = last;
+	for (const auto& expected : records) {
+		struct history_record record;
+		const size_t n = history_decode(&buf[offset], len - offset, &record, &base);
+		REQUIRE(n > 0);
+		offset += n;
+		REQUIRE(record.minute == expected.minute);
+		REQUIRE(record.step == expected.step);
+		REQUIRE(record.triggers == expected.triggers);
+		REQUIRE(record.has_lux == expected.has_lux);
+		REQUIRE(record.min_lux == expected.min_lux);
+		REQUIRE(record.avg_lux == expected.avg_lux);
+		REQUIRE(record.max_lux == expected.max_lux);
+		const uint32_t avg = base.avg_lux;
+		base = record;
+		if (!record.has_lux)
+			base.avg_lux = avg;
+	}
+	REQUIRE(offset == len);
+
+	// Truncated
+	struct history_record record;
+	REQUIRE(history_decode(buf, 2, &record, &last) == 0);
+	const uint8_t endless[12] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01};
+	REQUIRE(history_decode(endless, sizeof(endless), &record, &last) == 0);
+}
+
+TEST_CASE("Test history file") {
+	char path[] = "/tmp/test-history-XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	struct history history;
+
+	SECTION("Minutes") {
+		REQUIRE(history_open(&history, path, 4) == 0);
+		const int64_t t0 = 60 * 1000;
+		// Step 5 for 10 s, 7 for 40 s, 5 again until next minute
+		add(&history, t0, 100, 5, 1);
+		add(&history, t0 + 10, 300, 7, 0);
+		add(&history, t0 + 50, 200, 5, 1);
+		add(&history, t0 + 65, LIBBACKLIGHT_LUX_INVALID, 0, 0);
+		// Dark and not sampled for minutes
+		add(&history, t0 + 300, 50, 3, 1);
+		REQUIRE(history.records == 2);
+		history_close(&history);
+		REQUIRE(history.header == NULL);
+
+		const auto records = read_all(path);
+		REQUIRE(records.size() == 3);
+		REQUIRE(records[0].minute == 1000);
+		REQUIRE(records[0].step == 7);
+		REQUIRE(records[0].triggers == 2);
+		REQUIRE(records[0].has_lux);
+		REQUIRE(records[0].min_lux == 100);
+		REQUIRE(records[0].avg_lux == 200);
+		REQUIRE(records[0].max_lux == 300);
+		REQUIRE(records[1].minute == 1001);
+		REQUIRE(records[1].step == 0);
+		REQUIRE(!records[1].has_lux);
+		REQUIRE(records[2].minute == 1005);
+		REQUIRE(records[2].step == 3);
+		REQUIRE(records[2].avg_lux == 50);
+	}
+
+	SECTION("Ring keeps newest") {
+		REQUIRE(history_open(&history, path, 2) == 0);
+		const int minutes = 5000;
+		for (int i = 0; i < minutes; ++i)
+			add(&history, 60 * (1000 + i), 100 + i % 50, 1 + i % 10, i % 3 == 0);
+		history_close(&history);
+
+		const auto records = read_all(path);
+		REQUIRE(records.size() > 100);
+		REQUIRE(records.size() < minutes);
+		REQUIRE(records.back().minute == 1000 + minutes - 1);
+		for (size_t i = 1; i < records.size(); ++i)
+			REQUIRE(records[i].minute == records[i - 1].minute + 1);
+		const int i = records.back().minute - 1000;
+		REQUIRE(records.back().step == (uint32_t) (1 + i % 10));
+		REQUIRE(records.back().avg_lux == (uint32_t) (100 + i % 50));
+	}
+
+	SECTION("Reopen appends") {
+		REQUIRE(history_open(&history, path, 8) == 0);
+		for (int i = 0; i < 10; ++i)
+			add(&history, 60 * (1000 + i), 10 * i, 2, 0);
+		history_close(&history);
+
+		// Page count of existing file is kept
+		REQUIRE(history_open(&history, path, 16) == 0);
+		REQUIRE(history.header->pages == 8);
+		for (int i = 10; i < 20; ++i)
+			add(&history, 60 * (1000 + i), 10 * i, 2, 0);
+		history_close(&history);
+
+		const auto records = read_all(path);
+		REQUIRE(records.size() == 20);
+		for (int i = 0; i < 20; ++i) {
+			REQUIRE(records[i].minute == 1000 + i);
+			REQUIRE(records[i].avg_lux == (uint32_t) (10 * i));
+		}
+	}
+
+	SECTION("Damaged page") {
+		REQUIRE(history_open(&history, path, 4) == 0);
+		for (int i = 0; i < 10; ++i)
+			add(&history, 60 * (1000 + i), 100, 2, 0);
+		history_flush(&history);
+		// Count written but bytes not
+		history.pages[0].records += 5;
+		history_close(&history);
+
+		REQUIRE(read_all(path).size() == 10);
+		REQUIRE(history_open(&history, path, 4) == 0);
+		REQUIRE(history.pages[0].records == 10);
+		add(&history, 60 * 2000, 100, 2, 0);
+		history_close(&history);
+		REQUIRE(read_all(path).size() == 11);
+	}
+
+	SECTION("Not a history file") {
+		const int fd = open(path, O_WRONLY | O_TRUNC);
+		REQUIRE(fd >= 0);
+		REQUIRE(write(fd, "garbage", 7) == 7);
+		close(fd);
+
+		struct history_reader reader;
+		REQUIRE(history_reader_open(&reader, path) == -EINVAL);
+		// Someone else's file is left alone
+		REQUIRE(history_open(&history, path, 4) == -EEXIST);
+		struct stat st;
+		REQUIRE(stat(path, &st) == 0);
+		REQUIRE(st.st_size == 7);
+	}
+
+	SECTION("Empty file") {
+		REQUIRE(history_open(&history, path, 4) == 0);
+		REQUIRE(history.reset == 0);
+		history_close(&history);
+		struct stat st;
+		REQUIRE(stat(path, &st) == 0);
+		REQUIRE(st.st_size == 5 * HISTORY_PAGE_SIZE);
+	}
+
+	SECTION("Stale version") {
+		REQUIRE(history_open(&history, path, 8) == 0);
+		add(&history, 60 * 1000, 100, 2, 0);
+		history_close(&history);
+
+		const int fd = open(path, O_RDWR);
+		REQUIRE(fd >= 0);
+		const uint32_t version = HISTORY_VERSION + 1;
+		REQUIRE(pwrite(fd, &version, sizeof(version), offsetof(struct history_header, version)) == sizeof(version));
+		close(fd);
+
+		// Started over with pages given
+		REQUIRE(history_open(&history, path, 4) == 0);
+		REQUIRE(history.reset == 1);
+		REQUIRE(history.header->version == HISTORY_VERSION);
+		REQUIRE(history.header->pages == 4);
+		history_close(&history);
+		REQUIRE(read_all(path).empty());
+	}
+
+	SECTION("Energy counters") {
+		REQUIRE(history_open(&history, path, 4) == 0);
+		struct energy_counters energy;
+		REQUIRE(history_load_energy(&history, &energy) == 0);
+		REQUIRE(energy.lit_seconds == 0.0);
+		energy.lit_seconds = 120.0;
+		energy.bucket_seconds[3] = 60.0;
+		history_store_energy(&history, &energy);
+		add(&history, 60 * 1000, 100, 2, 0);
+		history_close(&history);
+
+		// Kept across reopen, records unaffected
+		REQUIRE(history_open(&history, path, 4) == 0);
+		memset(&energy, 0, sizeof(energy));
+		REQUIRE(history_load_energy(&history, &energy) == 0);
+		REQUIRE(energy.lit_seconds == 120.0);
+		REQUIRE(energy.bucket_seconds[3] == 60.0);
+		// Interrupted update
+		history.header->energy_seq++;
+		REQUIRE(history_load_energy(&history, &energy) == -EINVAL);
+		// Next store recovers
+		history_store_energy(&history, &energy);
+		REQUIRE((history.header->energy_seq & 1) == 0);
+		REQUIRE(history_load_energy(&history, &energy) == 0);
+		REQUIRE(energy.lit_seconds == 120.0);
+		history_close(&history);
+		REQUIRE(read_all(path).size() == 1);
+	}
+
+	SECTION("Page count") {
+		REQUIRE(history_open(&history, path, 0) == -EINVAL);
+		REQUIRE(history_open(&history, path, HISTORY_MAX_PAGES + 1) == -EINVAL);
+	}
+
+	unlink(path);
+}
@@ -0,0 +1,72 @@
+#include <cerrno>
+#include <pthread.h>
+#include <unistd.h>
+#include "iioscan.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static int context;
+static pthread_t creator;
+static int fail_errno;
+
+/* Stands in for iio_create_local_context, slow like a sysfs scan */
+static struct iio_context* create(void)
+{
+	creator = pthread_self();
+	usleep(20000);
+	if (fail_errno >= 0) {
+		errno = fail_errno;
+		return NULL;
+	}
+	return reinterpret_cast<struct iio_context*>(&context);
+}
+
+TEST_CASE("Test iioscan") {
+	struct iio_scan scan = {};
+	struct iio_context *ctx = NULL;
+	creator = pthread_self();
+	fail_errno = -1;
+
+	SECTION("Context from thread") {
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(scan.started == 1);
+		REQUIRE(iio_scan_join(&scan, &ctx) == 0);
+		REQUIRE(ctx == reinterpret_cast<struct iio_context*>(&context));
+		REQUIRE(!pthread_equal(creator, pthread_self()));
+		REQUIRE(scan.started == 0);
+		REQUIRE(scan.ctx == NULL);
+	}
+
+	SECTION("Failed scan") {
+		fail_errno = ENOENT;
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(iio_scan_join(&scan, &ctx) == -ENOENT);
+		REQUIRE(ctx == NULL);
+	}
+
+	SECTION("Failed without errno") {
+		fail_errno = 0;
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(iio_scan_join(&scan, &ctx) == -ENODEV);
+		REQUIRE(ctx == NULL);
+	}
+
+	SECTION("Join once") {
+		REQUIRE(iio_scan_join(&scan, &ctx) == -EINVAL);
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(iio_scan_start(&scan, create) == -EINVAL);
+		REQUIRE(iio_scan_join(&scan, &ctx) == 0);
+		REQUIRE(iio_scan_join(&scan, &ctx) == -EINVAL);
+	}
+
+	SECTION("Restart") {
+		fail_errno = EIO;
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(iio_scan_join(&scan, &ctx) == -EIO);
+		fail_errno = -1;
+		REQUIRE(iio_scan_start(&scan, create) == 0);
+		REQUIRE(iio_scan_join(&scan, &ctx) == 0);
+		REQUIRE(ctx != NULL);
+	}
+}
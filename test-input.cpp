@@ -0,0 +1,102 @@
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include "input.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static void send(int fd, uint16_t type, uint16_t code, int32_t value, long sec, long usec)
+{
+	struct input_event event;
+	memset(&event, 0, sizeof(event));
+	event.input_event_sec = sec;
+	event.input_event_usec = usec;
+	event.type = type;
+	event.code = code;
+	event.value = value;
+	REQUIRE(write(fd, &event, sizeof(event)) == sizeof(event));
+}
+
+TEST_CASE("Test input") {
+	// Pipe stands in for the evdev fd
+	int fds[2];
+	REQUIRE(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+	char path[32];
+	snprintf(path, sizeof(path), "/dev/fd/%d", fds[0]);
+
+	struct input input;
+	memset(&input, 0, sizeof(input));
+	REQUIRE(input_open(&input, path) == 0);
+	REQUIRE(input.kernel_time == 0);
+	int fd = -1;
+	REQUIRE(input_fd(&input, &fd) == 0);
+	REQUIRE(fd >= 0);
+
+	int trigger = -1;
+	struct timespec ts = {0,0};
+
+	SECTION("Nothing pending") {
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 0);
+	}
+
+	SECTION("Key press") {
+		send(fds[1], EV_KEY, BTN_TOUCH, 1, 12, 500);
+		send(fds[1], EV_SYN, SYN_REPORT, 0, 12, 500);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 1);
+		// Without kernel timestamps the event happened at read time
+		REQUIRE(ts.tv_sec == 0);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 0);
+	}
+
+	SECTION("Sync only") {
+		send(fds[1], EV_SYN, SYN_REPORT, 0, 1, 0);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 0);
+	}
+
+	SECTION("Latest event time") {
+		input.kernel_time = 1;
+		send(fds[1], EV_ABS, ABS_X, 10, 3, 250);
+		send(fds[1], EV_ABS, ABS_Y, 20, 4, 750);
+		send(fds[1], EV_SYN, SYN_REPORT, 0, 5, 0);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 1);
+		REQUIRE(ts.tv_sec == 4);
+		REQUIRE(ts.tv_nsec == 750000L);
+	}
+
+	SECTION("More than one read") {
+		for (int i = 0; i < 100; ++i)
+			send(fds[1], EV_SYN, SYN_REPORT, 0, i, 0);
+		send(fds[1], EV_KEY, KEY_A, 1, 100, 0);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 1);
+		REQUIRE(input_get(&input, &trigger, &ts) == 0);
+		REQUIRE(trigger == 0);
+	}
+
+	SECTION("Partial event") {
+		const char partial[3] = {1, 2, 3};
+		REQUIRE(write(fds[1], partial, sizeof(partial)) == sizeof(partial));
+		REQUIRE(input_get(&input, &trigger, &ts) == -EIO);
+	}
+
+	SECTION("Writer gone") {
+		close(fds[1]);
+		fds[1] = -1;
+		REQUIRE(input_get(&input, &trigger, &ts) == -EPIPE);
+	}
+
+	input_free(&input);
+	REQUIRE(input_fd(&input, &fd) == -EBADF);
+	close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+}
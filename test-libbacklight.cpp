@@ -3,6 +3,7 @@
 #include <cerrno>
 #include <ctime>
 #include "libbacklight.h"
+#include "debounce.h"
 
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_test_macros.hpp>
@@ -48,6 +49,31 @@ TEST_CASE("create_libbacklight sensor") {
 	destroy_libbacklight(&bctl);
 }
 
+TEST_CASE("create_libbacklight lux range narrower than steps") {
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 95;
+	conf.max_lux = 100;
+	struct timespec ts = {0,0};
+	REQUIRE(create_libbacklight(&ts, &conf) == NULL);
+
+	// One lux per step is enough
+	conf.max_lux = 104;
+	struct libbacklight_ctrl *bctl = create_libbacklight(&ts, &conf);
+	REQUIRE(bctl);
+	libbacklight_operate(bctl, &ts, 0, 100);
+	destroy_libbacklight(&bctl);
+
+	// Single step still needs a range
+	conf.max_brightness_step = 1;
+	conf.initial_brightness_step = 1;
+	conf.max_lux = 95;
+	REQUIRE(create_libbacklight(&ts, &conf) == NULL);
+}
+
 TEST_CASE("Test trigger") {
 	struct libbacklight_conf conf;
 	memset(&conf, 0, sizeof(conf));
@@ -215,3 +241,837 @@ TEST_CASE("Sensor and Trigger")
 
 	destroy_libbacklight(&bctl);
 }
+
+TEST_CASE("Lux and timeout remaining")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+
+	SECTION("Initial lux") {
+		REQUIRE(libbacklight_lux(bctl) == 50);
+	}
+
+	SECTION("Averaged lux") {
+		for (int i = 0; i < 10; ++i)
+			libbacklight_operate(bctl, &start, 0, 80);
+		REQUIRE(libbacklight_lux(bctl) == 80);
+	}
+
+	SECTION("Remaining") {
+		struct timespec ts = {2, 500000000};
+		struct timespec left = libbacklight_timeout_remaining(bctl, &ts);
+		REQUIRE(left.tv_sec == 7);
+		REQUIRE(left.tv_nsec == 500000000);
+
+		ts = {5, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 1, 50) == LIBBACKLIGHT_NONE);
+		ts = {14, 900000000};
+		left = libbacklight_timeout_remaining(bctl, &ts);
+		REQUIRE(left.tv_sec == 0);
+		REQUIRE(left.tv_nsec == 100000000);
+	}
+
+	SECTION("Remaining when off") {
+		struct timespec ts = {10, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 50) == LIBBACKLIGHT_BRIGHTNESS);
+		struct timespec left = libbacklight_timeout_remaining(bctl, &ts);
+		REQUIRE(left.tv_sec == 0);
+		REQUIRE(left.tv_nsec == 0);
+	}
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Trigger with timestamp")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+
+	SECTION("Timeout counted from trigger time") {
+		struct timespec ts {3, 0};
+		REQUIRE(libbacklight_trigger(bctl, &ts) == LIBBACKLIGHT_NONE);
+		ts = {12, 999999999};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 0) == LIBBACKLIGHT_NONE);
+		ts = {13, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+	}
+
+	SECTION("Enable after timeout") {
+		struct timespec ts {10, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+		ts = {11, 0};
+		REQUIRE(libbacklight_trigger(bctl, &ts) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == conf.initial_brightness_step);
+	}
+
+	SECTION("Older trigger ignored") {
+		struct timespec ts {5, 0};
+		REQUIRE(libbacklight_trigger(bctl, &ts) == LIBBACKLIGHT_NONE);
+		ts = {2, 0};
+		REQUIRE(libbacklight_trigger(bctl, &ts) == LIBBACKLIGHT_NONE);
+		ts = {14, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 0) == LIBBACKLIGHT_NONE);
+		ts = {15, 0};
+		REQUIRE(libbacklight_operate(bctl, &ts, 0, 0) == LIBBACKLIGHT_BRIGHTNESS);
+	}
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Update without sensor reading")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 42;
+	conf.max_lux = 600;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+
+	SECTION("Window unchanged") {
+		const uint32_t lux = libbacklight_lux(bctl);
+		for (int i = 0; i < 100; ++i)
+			REQUIRE(libbacklight_update(bctl, &start, 0) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_lux(bctl) == lux);
+		REQUIRE(libbacklight_brightness(bctl) == conf.initial_brightness_step);
+	}
+
+	SECTION("Trigger after timeout uses averaged lux") {
+		struct timespec ts = {10,0};
+		for (int i = 0; i < 10; ++i)
+			libbacklight_operate(bctl, &ts, 0, 600);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+		REQUIRE(libbacklight_update(bctl, &ts, 1) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+	}
+
+	SECTION("Timeout") {
+		struct timespec ts = {10,0};
+		REQUIRE(libbacklight_update(bctl, &ts, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+	}
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Save and restore")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+
+	struct timespec ts = {3,0};
+	for (uint32_t i = 0; i < 10; ++i)
+		libbacklight_operate(bctl, &ts, 1, 100 + i);
+	REQUIRE(libbacklight_brightness(bctl) == 10);
+
+	struct libbacklight_state state;
+	libbacklight_save(bctl, &state);
+	REQUIRE(state.samples == 10);
+	REQUIRE(state.sensor[0] == 100);
+	REQUIRE(state.sensor[9] == 109);
+	REQUIRE(state.last_trigger.tv_sec == 3);
+
+	struct libbacklight_ctrl *restored = create_libbacklight(&start, &conf);
+	REQUIRE(restored);
+
+	SECTION("Restored") {
+		REQUIRE(libbacklight_restore(restored, &state) == 0);
+		REQUIRE(libbacklight_brightness(restored) == 10);
+		REQUIRE(libbacklight_lux(restored) == libbacklight_lux(bctl));
+		ts = {12, 999999999};
+		REQUIRE(libbacklight_operate(restored, &ts, 0, 99) == LIBBACKLIGHT_NONE);
+		ts = {13, 0};
+		REQUIRE(libbacklight_operate(restored, &ts, 0, 99) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(restored) == 0);
+	}
+
+	SECTION("Corrupt sum") {
+		state.sensor_sum++;
+		REQUIRE(libbacklight_restore(restored, &state) == -EINVAL);
+		REQUIRE(libbacklight_brightness(restored) == 5);
+	}
+
+	SECTION("Window mismatch") {
+		state.samples = 9;
+		REQUIRE(libbacklight_restore(restored, &state) == -EINVAL);
+	}
+
+	SECTION("Step out of range") {
+		state.brightness_step = 11;
+		REQUIRE(libbacklight_restore(restored, &state) == -EINVAL);
+	}
+
+	destroy_libbacklight(&restored);
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Sensor window")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	const struct timespec start = {0,0};
+
+	SECTION("Too large") {
+		conf.sensor_window = LIBBACKLIGHT_STATE_MAX_SAMPLES + 1;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(!bctl);
+	}
+
+	SECTION("Reaction time follows window") {
+		conf.sensor_window = 2;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		REQUIRE(libbacklight_operate(bctl, &start, 0, 100) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 5);
+		REQUIRE(libbacklight_operate(bctl, &start, 0, 100) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+
+		struct libbacklight_state state;
+		libbacklight_save(bctl, &state);
+		REQUIRE(state.samples == 2);
+		destroy_libbacklight(&bctl);
+	}
+}
+
+TEST_CASE("Reseed")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 1;
+	const struct timespec start = {0,0};
+	const struct timespec dark = {2,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+
+	REQUIRE(libbacklight_update(bctl, &dark, 0) == LIBBACKLIGHT_BRIGHTNESS);
+	REQUIRE(libbacklight_brightness(bctl) == 0);
+
+	// First decision after wake up uses reseeded window only
+	const uint32_t reseed = 100;
+	libbacklight_reseed(bctl, &reseed);
+	REQUIRE(libbacklight_lux(bctl) == 100);
+	REQUIRE(libbacklight_update(bctl, &dark, 1) == LIBBACKLIGHT_BRIGHTNESS);
+	REQUIRE(libbacklight_brightness(bctl) == 10);
+
+	struct libbacklight_state state;
+	libbacklight_save(bctl, &state);
+	REQUIRE(state.samples == LIBBACKLIGHT_DEFAULT_WINDOW);
+	REQUIRE(state.sensor_sum == 100 * LIBBACKLIGHT_DEFAULT_WINDOW);
+
+	// Sensor lost, back to initial step
+	const uint32_t lost = LIBBACKLIGHT_LUX_INVALID;
+	libbacklight_reseed(bctl, &lost);
+	REQUIRE(libbacklight_lux(bctl) == 10);
+	REQUIRE(libbacklight_update(bctl, &dark, 1) == LIBBACKLIGHT_BRIGHTNESS);
+	REQUIRE(libbacklight_brightness(bctl) == 1);
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Auto range")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 600;
+	conf.enable_auto_range = 1;
+	conf.auto_min_percentile = 5;
+	conf.auto_max_percentile = 95;
+	conf.auto_range_interval = 100;
+	const struct timespec start = {0,0};
+
+	SECTION("Invalid percentiles") {
+		conf.auto_min_percentile = 95;
+		REQUIRE(!create_libbacklight(&start, &conf));
+		conf.auto_min_percentile = 5;
+		conf.auto_max_percentile = 101;
+		REQUIRE(!create_libbacklight(&start, &conf));
+	}
+
+	SECTION("Adapts to observed lux") {
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		uint32_t min_lux = 0;
+		uint32_t max_lux = 0;
+		for (uint32_t i = 0; i < 99; ++i)
+			libbacklight_operate(bctl, &start, 0, 1000 + (i * 37) % 100 * 10);
+		libbacklight_lux_range(bctl, &min_lux, &max_lux);
+		REQUIRE(min_lux == 10);
+		REQUIRE(max_lux == 600);
+
+		libbacklight_operate(bctl, &start, 0, 1500);
+		libbacklight_lux_range(bctl, &min_lux, &max_lux);
+		REQUIRE(min_lux > 1000);
+		REQUIRE(min_lux < 1100);
+		REQUIRE(max_lux > 1900);
+		REQUIRE(max_lux < 2000);
+
+		for (int i = 0; i < LIBBACKLIGHT_DEFAULT_WINDOW; ++i)
+			libbacklight_operate(bctl, &start, 0, 1000);
+		REQUIRE(libbacklight_brightness(bctl) == 1);
+		for (int i = 0; i < LIBBACKLIGHT_DEFAULT_WINDOW; ++i)
+			libbacklight_operate(bctl, &start, 0, 2000);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Narrow range keeps a lux per step") {
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		for (int i = 0; i < 100; ++i)
+			libbacklight_operate(bctl, &start, 0, 50);
+		uint32_t min_lux = 0;
+		uint32_t max_lux = 0;
+		libbacklight_lux_range(bctl, &min_lux, &max_lux);
+		REQUIRE(min_lux == 50);
+		REQUIRE(max_lux == 59);
+		libbacklight_operate(bctl, &start, 0, 80);
+		REQUIRE(libbacklight_brightness(bctl) <= conf.max_brightness_step);
+		destroy_libbacklight(&bctl);
+	}
+}
+
+TEST_CASE("Multiple sensors")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.sensor_window = 1;
+	conf.sensors = 3;
+	const struct timespec start = {0,0};
+
+	SECTION("Too many sensors") {
+		conf.sensors = LIBBACKLIGHT_MAX_SENSORS + 1;
+		REQUIRE(!create_libbacklight(&start, &conf));
+	}
+
+	SECTION("Weighted mean") {
+		conf.sensor_weight[0] = 2;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux[] = {100, 40, 40};
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 70);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Max") {
+		conf.fusion = LIBBACKLIGHT_FUSION_MAX;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux[] = {30, 90, 40};
+		REQUIRE(libbacklight_operate_multi(bctl, &start, 0, lux) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_lux(bctl) == 90);
+		REQUIRE(libbacklight_brightness(bctl) == 9);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Median") {
+		conf.fusion = LIBBACKLIGHT_FUSION_MEDIAN;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux[] = {30, 90, 40};
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 40);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Faulty sensor rejected") {
+		conf.fault_ratio = 4;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t covered[] = {50, 60, 0};
+		libbacklight_operate_multi(bctl, &start, 0, covered);
+		REQUIRE(libbacklight_lux(bctl) == 55);
+		const uint32_t saturated[] = {50, 60, 65535};
+		libbacklight_operate_multi(bctl, &start, 0, saturated);
+		REQUIRE(libbacklight_lux(bctl) == 55);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Fault ratio with even sensor count") {
+		conf.sensors = 4;
+		conf.fault_ratio = 1;
+		REQUIRE(!create_libbacklight(&start, &conf));
+
+		conf.fault_ratio = 2;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux[] = {10, 20, 30, 40};
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 30);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Failed readings") {
+		conf.sensor_window = 2;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux[] = {60, 60, 90};
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 70);
+
+		/* Held until failing a whole window */
+		const uint32_t failed[] = {60, 60, LIBBACKLIGHT_LUX_INVALID};
+		libbacklight_operate_multi(bctl, &start, 0, failed);
+		REQUIRE(libbacklight_lux(bctl) == 70);
+		libbacklight_operate_multi(bctl, &start, 0, failed);
+		REQUIRE(libbacklight_lux(bctl) == 60);
+
+		/* All failed keeps last */
+		const uint32_t none[] = {LIBBACKLIGHT_LUX_INVALID, LIBBACKLIGHT_LUX_INVALID, LIBBACKLIGHT_LUX_INVALID};
+		libbacklight_operate_multi(bctl, &start, 0, none);
+		libbacklight_operate_multi(bctl, &start, 0, none);
+		REQUIRE(libbacklight_lux(bctl) == 60);
+
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 70);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Reseed with failed sensor") {
+		conf.sensor_window = 4;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t seed[] = {90, LIBBACKLIGHT_LUX_INVALID, 90};
+		libbacklight_reseed(bctl, seed);
+		REQUIRE(libbacklight_lux(bctl) == 90);
+
+		// First reading of the failed sensor fills its window, instead of being averaged with zeros
+		const uint32_t lux[] = {90, 60, 90};
+		libbacklight_operate_multi(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_lux(bctl) == 80);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Save and restore") {
+		conf.sensor_window = 2;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t first[] = {10, 20, 30};
+		const uint32_t second[] = {40, 50, 60};
+		libbacklight_operate_multi(bctl, &start, 0, first);
+		libbacklight_operate_multi(bctl, &start, 0, second);
+
+		struct libbacklight_state state;
+		libbacklight_save(bctl, &state);
+		REQUIRE(state.samples == 2);
+		REQUIRE(state.sensors == 3);
+		REQUIRE(state.sensor[0] == 10);
+		REQUIRE(state.sensor[5] == 60);
+		REQUIRE(state.sensor_sum == 210);
+
+		struct libbacklight_ctrl *restored = create_libbacklight(&start, &conf);
+		REQUIRE(restored);
+		REQUIRE(libbacklight_restore(restored, &state) == 0);
+		REQUIRE(libbacklight_lux(restored) == libbacklight_lux(bctl));
+
+		conf.sensors = 2;
+		struct libbacklight_ctrl *fewer = create_libbacklight(&start, &conf);
+		REQUIRE(fewer);
+		REQUIRE(libbacklight_restore(fewer, &state) == -EINVAL);
+
+		destroy_libbacklight(&fewer);
+		destroy_libbacklight(&restored);
+		destroy_libbacklight(&bctl);
+	}
+}
+
+/* Readings until brightness reaches max after dark to bright step */
+static int step_latency(struct libbacklight_ctrl* bctl)
+{
+	const struct timespec ts = {0,0};
+	for (int i = 1; i <= LIBBACKLIGHT_STATE_MAX_SAMPLES; ++i) {
+		libbacklight_operate(bctl, &ts, 0, 1000);
+		if (libbacklight_brightness(bctl) == 10)
+			return i;
+	}
+	return -1;
+}
+
+TEST_CASE("Step response")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.sensor_window = 10;
+	const struct timespec start = {0,0};
+
+	SECTION("Disabled waits for window") {
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		REQUIRE(step_latency(bctl) == 1);
+		destroy_libbacklight(&bctl);
+
+		/* From dark, the average must climb past max_lux */
+		conf.initial_brightness_step = 1;
+		conf.max_lux = 900;
+		bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		REQUIRE(step_latency(bctl) == 9);
+		REQUIRE(libbacklight_steps(bctl) == 0);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Immediate with step ratio") {
+		conf.max_lux = 900;
+		conf.step_ratio = 4;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		REQUIRE(step_latency(bctl) == 1);
+		REQUIRE(libbacklight_lux(bctl) == 1000);
+		REQUIRE(libbacklight_steps(bctl) == 1);
+
+		/* And back down to dark */
+		REQUIRE(libbacklight_operate(bctl, &start, 0, 10) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 1);
+		REQUIRE(libbacklight_steps(bctl) == 2);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Small fluctuations averaged") {
+		conf.step_ratio = 4;
+		conf.initial_brightness_step = 5;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+		const uint32_t lux = libbacklight_lux(bctl);
+		libbacklight_operate(bctl, &start, 0, lux * 3);
+		REQUIRE(libbacklight_lux(bctl) == lux + (lux * 2) / 10);
+		libbacklight_operate(bctl, &start, 0, lux / 3);
+		REQUIRE(libbacklight_steps(bctl) == 0);
+		destroy_libbacklight(&bctl);
+	}
+
+	SECTION("Confirmed by consecutive readings") {
+		conf.max_lux = 900;
+		conf.step_ratio = 4;
+		conf.step_samples = 3;
+		struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+		REQUIRE(bctl);
+
+		/* Single flash is averaged */
+		const uint32_t lux = libbacklight_lux(bctl);
+		libbacklight_operate(bctl, &start, 0, 1000);
+		libbacklight_operate(bctl, &start, 0, lux);
+		REQUIRE(libbacklight_steps(bctl) == 0);
+
+		libbacklight_operate(bctl, &start, 0, 20000);
+		libbacklight_operate(bctl, &start, 0, 20000);
+		REQUIRE(libbacklight_steps(bctl) == 0);
+		libbacklight_operate(bctl, &start, 0, 20000);
+		REQUIRE(libbacklight_steps(bctl) == 1);
+		REQUIRE(libbacklight_lux(bctl) == 20000);
+		destroy_libbacklight(&bctl);
+	}
+}
+
+TEST_CASE("Reconfigure")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.sensor_window = 4;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	const struct timespec later = {5,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+	for (uint32_t lux = 10; lux <= 40; lux += 10)
+		libbacklight_operate(bctl, &later, 1, lux);
+	REQUIRE(libbacklight_lux(bctl) == 25);
+	REQUIRE(libbacklight_brightness(bctl) == 2);
+
+	SECTION("Range and timeout") {
+		struct libbacklight_conf next = conf;
+		next.min_lux = 0;
+		next.max_lux = 45;
+		next.trigger_timeout.tv_sec = 20;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == 0);
+		REQUIRE(libbacklight_get_conf(bctl)->max_lux == 45);
+
+		// Window and step kept until next decision
+		REQUIRE(libbacklight_lux(bctl) == 25);
+		REQUIRE(libbacklight_brightness(bctl) == 2);
+		REQUIRE(libbacklight_update(bctl, &later, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 6);
+
+		// Timeout counted from trigger before reconfigure
+		const struct timespec remaining = libbacklight_timeout_remaining(bctl, &later);
+		REQUIRE(remaining.tv_sec == 20);
+	}
+
+	SECTION("Smaller window keeps newest") {
+		struct libbacklight_conf next = conf;
+		next.sensor_window = 2;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == 0);
+		REQUIRE(libbacklight_lux(bctl) == 35);
+		libbacklight_operate(bctl, &later, 0, 50);
+		REQUIRE(libbacklight_lux(bctl) == 45);
+
+		struct libbacklight_state state;
+		libbacklight_save(bctl, &state);
+		REQUIRE(state.samples == 2);
+		REQUIRE(state.sensor[0] == 40);
+		REQUIRE(state.sensor[1] == 50);
+	}
+
+	SECTION("Larger window pads with oldest") {
+		struct libbacklight_conf next = conf;
+		next.sensor_window = 6;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == 0);
+		REQUIRE(libbacklight_lux(bctl) == 20);
+		struct libbacklight_state state;
+		libbacklight_save(bctl, &state);
+		REQUIRE(state.samples == 6);
+		REQUIRE(state.sensor[0] == 10);
+		REQUIRE(state.sensor[2] == 10);
+		REQUIRE(state.sensor[5] == 40);
+	}
+
+	SECTION("Invalid leaves controller unchanged") {
+		struct libbacklight_conf next = conf;
+		next.min_lux = 200;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+		next = conf;
+		next.max_brightness_step = 20;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+		next = conf;
+		next.enable_trigger = 0;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+		next = conf;
+		next.sensors = 2;
+		next.sensor_window = 8;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+		next = conf;
+		next.step_ratio = 1;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+		// Less than one lux per step
+		next = conf;
+		next.min_lux = 95;
+		next.max_lux = 100;
+		REQUIRE(libbacklight_reconfigure(bctl, &next) == -EINVAL);
+
+		REQUIRE(libbacklight_get_conf(bctl)->min_lux == 10);
+		REQUIRE(libbacklight_get_conf(bctl)->sensor_window == 4);
+		REQUIRE(libbacklight_lux(bctl) == 25);
+	}
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Override and inhibit")
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 1;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 100;
+	conf.sensor_window = 4;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 10;
+	const struct timespec start = {0,0};
+	struct libbacklight_ctrl *bctl = create_libbacklight(&start, &conf);
+	REQUIRE(bctl);
+	const struct timespec t1 = {1,0};
+	for (int i = 0; i < 4; ++i)
+		libbacklight_operate(bctl, &t1, 1, 30);
+	REQUIRE(libbacklight_brightness(bctl) == 3);
+
+	SECTION("Override holds brightness, filter keeps running") {
+		REQUIRE(libbacklight_override(bctl, 11) == -EINVAL);
+		REQUIRE(libbacklight_overridden(bctl) == 0);
+		REQUIRE(libbacklight_override(bctl, 10) == 0);
+		REQUIRE(libbacklight_overridden(bctl) == 1);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+
+		const struct timespec t2 = {2,0};
+		for (int i = 0; i < 4; ++i)
+			REQUIRE(libbacklight_operate(bctl, &t2, 1, 70) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_lux(bctl) == 70);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+
+		// Timeout passes while overridden, backlight stays on
+		const struct timespec t20 = {20,0};
+		REQUIRE(libbacklight_update(bctl, &t20, 0) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_brightness(bctl) == 10);
+
+		// Resume shows what automatic control decided meanwhile
+		REQUIRE(libbacklight_resume(bctl, &t20) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_overridden(bctl) == 0);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+	}
+
+	SECTION("Override to same step as automatic") {
+		REQUIRE(libbacklight_override(bctl, 3) == 0);
+		REQUIRE(libbacklight_resume(bctl, &t1) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_brightness(bctl) == 3);
+	}
+
+	SECTION("Inhibit extends timeout") {
+		const struct timespec t5 = {5,0};
+		const struct timespec duration = {30,0};
+		REQUIRE(libbacklight_inhibit(bctl, &t5, &duration) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_timeout_remaining(bctl, &t5).tv_sec == 30);
+
+		const struct timespec t20 = {20,0};
+		REQUIRE(libbacklight_update(bctl, &t20, 0) == LIBBACKLIGHT_NONE);
+		REQUIRE(libbacklight_brightness(bctl) == 3);
+
+		const struct timespec t35 = {35,0};
+		REQUIRE(libbacklight_update(bctl, &t35, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+	}
+
+	SECTION("Inhibit wakes backlight") {
+		const struct timespec t20 = {20,0};
+		REQUIRE(libbacklight_update(bctl, &t20, 0) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+		const struct timespec duration = {60,0};
+		REQUIRE(libbacklight_inhibit(bctl, &t20, &duration) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 3);
+
+		// Resume ends inhibit, timeout counted from wake up
+		const struct timespec t40 = {40,0};
+		REQUIRE(libbacklight_resume(bctl, &t40) == LIBBACKLIGHT_BRIGHTNESS);
+		REQUIRE(libbacklight_brightness(bctl) == 0);
+	}
+
+	destroy_libbacklight(&bctl);
+}
+
+TEST_CASE("Proximity debounce")
+{
+	struct debounce debounce;
+	REQUIRE(debounce_init(&debounce, 100, 100, 3, 5) == 0);
+
+	SECTION("Near inside debounce window is ignored") {
+		// Two of five near readings aren't enough
+		REQUIRE(debounce_update(&debounce, 150) == 0);
+		REQUIRE(debounce_update(&debounce, 10) == 0);
+		REQUIRE(debounce_update(&debounce, 150) == 0);
+		REQUIRE(debounce_update(&debounce, 10) == 0);
+		REQUIRE(debounce_update(&debounce, 10) == 0);
+		REQUIRE(debounce.transitions == 0);
+		REQUIRE(debounce_spurious(&debounce) == 4);
+
+		// Oldest near reading has left the window
+		REQUIRE(debounce_update(&debounce, 150) == 0);
+		REQUIRE(debounce_update(&debounce, 150) == 1);
+		REQUIRE(debounce.transitions == 1);
+	}
+
+	SECTION("Near for n readings") {
+		REQUIRE(debounce_update(&debounce, 100) == 0);
+		REQUIRE(debounce_update(&debounce, 100) == 0);
+		REQUIRE(debounce_update(&debounce, 100) == 1);
+		REQUIRE(debounce_update(&debounce, 0) == 1);
+		REQUIRE(debounce_update(&debounce, 0) == 1);
+		REQUIRE(debounce_update(&debounce, 0) == 0);
+		REQUIRE(debounce.transitions == 2);
+		REQUIRE(debounce_spurious(&debounce) == 0);
+	}
+
+	SECTION("One change per hand movement") {
+		REQUIRE(debounce_init(&debounce, 100, 50, 2, 5) == 0);
+		// Near readings before the change don't count towards far, and far ones not back towards near
+		const int expected[] = {0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+		for (int i = 0; i < 11; ++i)
+			REQUIRE(debounce_update(&debounce, i < 5 ? 100 : 0) == expected[i]);
+		REQUIRE(debounce.transitions == 2);
+		REQUIRE(debounce_spurious(&debounce) == 0);
+	}
+
+	SECTION("Invalid") {
+		REQUIRE(debounce_init(&debounce, 100, 100, 0, 1) == -EINVAL);
+		REQUIRE(debounce_init(&debounce, 100, 100, 2, 1) == -EINVAL);
+		REQUIRE(debounce_init(&debounce, 100, 100, 1, DEBOUNCE_MAX_SAMPLES + 1) == -EINVAL);
+		REQUIRE(debounce_init(&debounce, 100, 101, 1, 1) == -EINVAL);
+		REQUIRE(debounce_init(&debounce, 100, 100, DEBOUNCE_MAX_SAMPLES, DEBOUNCE_MAX_SAMPLES) == 0);
+	}
+}
+
+TEST_CASE("Proximity hysteresis")
+{
+	struct debounce debounce;
+	REQUIRE(debounce_init(&debounce, 100, 60, 1, 1) == 0);
+
+	// Far until nearlevel is reached
+	for (long long val = 60; val < 100; val += 13)
+		REQUIRE(debounce_update(&debounce, val) == 0);
+	REQUIRE(debounce_update(&debounce, 100) == 1);
+
+	// Oscillating between far and near level keeps state
+	for (int i = 0; i < 20; ++i) {
+		REQUIRE(debounce_update(&debounce, i % 2 ? 99 : 60) == 1);
+		REQUIRE(debounce_update(&debounce, 100) == 1);
+	}
+	REQUIRE(debounce.transitions == 1);
+
+	REQUIRE(debounce_update(&debounce, 59) == 0);
+	REQUIRE(debounce_update(&debounce, 99) == 0);
+	REQUIRE(debounce.transitions == 2);
+}
@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include "libbacklight.h"
+#include "libbacklight_bank.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static struct libbacklight_conf bank_conf()
+{
+	struct libbacklight_conf conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.max_brightness_step = 10;
+	conf.initial_brightness_step = 5;
+	conf.enable_sensor = 1;
+	conf.min_lux = 10;
+	conf.max_lux = 1000;
+	conf.sensor_window = 5;
+	conf.enable_trigger = 1;
+	conf.trigger_timeout.tv_sec = 3;
+	return conf;
+}
+
+/* Run bank and one libbacklight_ctrl per controller on the same random input, they must agree */
+static void compare(const struct libbacklight_conf* conf, enum libbacklight_bank_impl impl)
+{
+	const uint32_t count = 37;
+	struct timespec ts = {100, 0};
+	struct libbacklight_bank *bank = libbacklight_bank_create(&ts, conf, count);
+	REQUIRE(bank);
+	if (libbacklight_bank_set_impl(bank, impl) != 0) {
+		libbacklight_bank_destroy(&bank);
+		WARN("Not supported by CPU: " << libbacklight_bank_impl_name(impl));
+		return;
+	}
+	REQUIRE(libbacklight_bank_count(bank) == count);
+
+	std::vector<struct libbacklight_ctrl*> ctrls;
+	for (uint32_t i = 0; i < count; ++i)
+		ctrls.push_back(create_libbacklight(&ts, conf));
+
+	srand(1);
+	std::vector<uint8_t> triggered(count);
+	std::vector<uint32_t> lux(count);
+	for (int tick = 0; tick < 500; ++tick) {
+		ts.tv_sec++;
+		for (uint32_t i = 0; i < count; ++i) {
+			triggered[i] = rand() % 8 == 0;
+			lux[i] = rand() % 10 == 0 ? LIBBACKLIGHT_LUX_INVALID : rand() % 1500;
+		}
+		const bool with_trigger = tick % 7 != 0;
+		const bool with_lux = tick % 5 != 0;
+
+		const uint32_t changed = libbacklight_bank_operate(bank, &ts, with_trigger ? triggered.data() : NULL,
+															with_lux ? lux.data() : NULL);
+		uint32_t expected = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			const int trig = with_trigger && triggered[i];
+			const enum libbacklight_action ac = with_lux ? libbacklight_operate(ctrls[i], &ts, trig, lux[i])
+													: libbacklight_update(ctrls[i], &ts, trig);
+			expected += ac == LIBBACKLIGHT_BRIGHTNESS;
+			REQUIRE(libbacklight_bank_brightness(bank)[i] == libbacklight_brightness(ctrls[i]));
+			REQUIRE(libbacklight_bank_changed(bank)[i] == (ac == LIBBACKLIGHT_BRIGHTNESS));
+			REQUIRE(libbacklight_bank_lux(bank, i) == libbacklight_lux(ctrls[i]));
+		}
+		REQUIRE(changed == expected);
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+		destroy_libbacklight(&ctrls[i]);
+	libbacklight_bank_destroy(&bank);
+	REQUIRE(bank == NULL);
+}
+
+TEST_CASE("Test bank same as controllers") {
+	struct libbacklight_conf conf = bank_conf();
+	const enum libbacklight_bank_impl impls[] = {LIBBACKLIGHT_BANK_SCALAR, LIBBACKLIGHT_BANK_GENERIC,
+												LIBBACKLIGHT_BANK_SSE4, LIBBACKLIGHT_BANK_AVX2};
+
+	for (enum libbacklight_bank_impl impl : impls) {
+		SECTION(libbacklight_bank_impl_name(impl)) {
+			compare(&conf, impl);
+
+			conf.sensor_window = 1;
+			compare(&conf, impl);
+
+			conf.enable_trigger = 0;
+			compare(&conf, impl);
+
+			conf.enable_trigger = 1;
+			conf.enable_sensor = 0;
+			compare(&conf, impl);
+		}
+	}
+}
+
+TEST_CASE("Test bank implementations") {
+	const struct timespec ts = {0, 0};
+	const struct libbacklight_conf conf = bank_conf();
+	struct libbacklight_bank *bank = libbacklight_bank_create(&ts, &conf, 1);
+	REQUIRE(bank);
+	REQUIRE(libbacklight_bank_get_impl(bank) != LIBBACKLIGHT_BANK_AUTO);
+	REQUIRE(libbacklight_bank_set_impl(bank, LIBBACKLIGHT_BANK_SCALAR) == 0);
+	REQUIRE(libbacklight_bank_get_impl(bank) == LIBBACKLIGHT_BANK_SCALAR);
+	REQUIRE(libbacklight_bank_set_impl(bank, LIBBACKLIGHT_BANK_AUTO) == 0);
+	REQUIRE(libbacklight_bank_get_impl(bank) != LIBBACKLIGHT_BANK_AUTO);
+	REQUIRE(libbacklight_bank_set_impl(bank, (enum libbacklight_bank_impl) 99) == -ENOTSUP);
+	libbacklight_bank_destroy(&bank);
+}
+
+TEST_CASE("Test bank readings clamped") {
+	const struct timespec ts = {0, 0};
+	struct libbacklight_conf conf = bank_conf();
+	conf.sensor_window = LIBBACKLIGHT_STATE_MAX_SAMPLES;
+	struct libbacklight_bank *bank = libbacklight_bank_create(&ts, &conf, 3);
+	REQUIRE(bank);
+	const uint32_t lux[] = {LIBBACKLIGHT_LUX_INVALID - 1, LIBBACKLIGHT_BANK_MAX_LUX, 0};
+	for (int i = 0; i < LIBBACKLIGHT_STATE_MAX_SAMPLES; ++i)
+		libbacklight_bank_operate(bank, &ts, NULL, lux);
+	REQUIRE(libbacklight_bank_lux(bank, 0) == LIBBACKLIGHT_BANK_MAX_LUX);
+	REQUIRE(libbacklight_bank_lux(bank, 1) == LIBBACKLIGHT_BANK_MAX_LUX);
+	REQUIRE(libbacklight_bank_lux(bank, 2) == 0);
+	REQUIRE(libbacklight_bank_brightness(bank)[0] == 10);
+	REQUIRE(libbacklight_bank_brightness(bank)[2] == 1);
+	libbacklight_bank_destroy(&bank);
+}
+
+TEST_CASE("Test bank invalid configuration") {
+	const struct timespec ts = {0, 0};
+	struct libbacklight_conf conf = bank_conf();
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 0) == NULL);
+
+	conf.sensors = 2;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+	conf = bank_conf();
+	conf.step_ratio = 4;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+	conf = bank_conf();
+	conf.enable_auto_range = 1;
+	conf.auto_max_percentile = 95;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+	conf = bank_conf();
+	conf.max_lux = LIBBACKLIGHT_BANK_MAX_LUX + 1;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+	conf = bank_conf();
+	conf.max_lux = conf.min_lux + 5;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+	conf = bank_conf();
+	conf.trigger_timeout.tv_sec = 0;
+	REQUIRE(libbacklight_bank_create(&ts, &conf, 1) == NULL);
+}
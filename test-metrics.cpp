@@ -0,0 +1,88 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include "metrics.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static std::string read_file(const char* path)
+{
+	std::string content;
+	FILE *fp = fopen(path, "r");
+	REQUIRE(fp);
+	char buf[256];
+	size_t n = 0;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		content.append(buf, n);
+	fclose(fp);
+	return content;
+}
+
+TEST_CASE("Test metrics") {
+	char dir[] = "/tmp/test-metrics-XXXXXX";
+	REQUIRE(mkdtemp(dir));
+	const std::string path = std::string(dir) + "/backlightctl.prom";
+
+	struct metrics metrics;
+	REQUIRE(metrics_init(&metrics, path.c_str()) == 0);
+
+	SECTION("Write") {
+		struct metrics_values values;
+		memset(&values, 0, sizeof(values));
+		values.wakeups = 42;
+		values.source_errors = 5;
+		values.brightness_step = 7;
+		values.filtered_lux = 300;
+		values.first_decision_seconds = 0.0125;
+		struct energy_counters energy;
+		memset(&energy, 0, sizeof(energy));
+		energy.lit_seconds = 90.0;
+		energy.joules = 10.0;
+		energy.full_joules = 30.0;
+		energy.bucket_seconds[1] = 2.0;
+		values.energy = &energy;
+		for (int i = 0; i < 100; ++i)
+			metrics_latency(&metrics, 0.001);
+
+		REQUIRE(metrics_write(&metrics, &values) == 0);
+		REQUIRE(access(metrics.tmp_path, F_OK) != 0);
+
+		const std::string content = read_file(path.c_str());
+		REQUIRE(content.find("# TYPE backlightctl_wakeups_total counter\nbacklightctl_wakeups_total 42\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_brightness_step 7\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_filtered_lux 300\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_source_errors_total 5\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_first_decision_seconds 0.012500\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_step_seconds_total{bucket=\"1\"} 2.000\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_loop_latency_seconds{quantile=\"0.99\"} 0.001000000\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_loop_latency_seconds_count 100\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_lit_seconds_total 90.000\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_energy_saved_joules_total 20.000\n") != std::string::npos);
+		REQUIRE(content.find("backlightctl_step_seconds_total{bucket=\"0\"} 0.000\n") != std::string::npos);
+		REQUIRE(content.find("bucket_seconds_total") == std::string::npos);
+
+		/* Replaced, not appended */
+		values.wakeups = 43;
+		REQUIRE(metrics_write(&metrics, &values) == 0);
+		const std::string again = read_file(path.c_str());
+		REQUIRE(again.find("backlightctl_wakeups_total 43\n") != std::string::npos);
+		REQUIRE(again.find("backlightctl_wakeups_total 42\n") == std::string::npos);
+		unlink(path.c_str());
+	}
+
+	SECTION("Missing directory") {
+		metrics_free(&metrics);
+		REQUIRE(metrics_init(&metrics, "/nonexistent/dir/backlightctl.prom") == 0);
+		struct metrics_values values;
+		memset(&values, 0, sizeof(values));
+		REQUIRE(metrics_write(&metrics, &values) == -ENOENT);
+	}
+
+	metrics_free(&metrics);
+	rmdir(dir);
+}
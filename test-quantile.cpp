@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "quantile.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static double exact(std::vector<double> v, double p)
+{
+	std::sort(v.begin(), v.end());
+	return v[(size_t) (p * (v.size() - 1) + 0.5)];
+}
+
+TEST_CASE("Test quantile empty and few") {
+	struct quantile q;
+	quantile_init(&q, 0.5);
+	REQUIRE(quantile_get(&q) == 0.0);
+
+	quantile_add(&q, 30.0);
+	REQUIRE(quantile_get(&q) == 30.0);
+	quantile_add(&q, 10.0);
+	quantile_add(&q, 20.0);
+	REQUIRE(quantile_get(&q) == 20.0);
+}
+
+TEST_CASE("Test quantile uniform") {
+	srand(1);
+	const double ps[] = {0.05, 0.5, 0.95};
+	for (double p : ps) {
+		struct quantile q;
+		quantile_init(&q, p);
+		std::vector<double> v;
+		for (int i = 0; i < 10000; ++i) {
+			const double x = rand() % 1000;
+			v.push_back(x);
+			quantile_add(&q, x);
+		}
+		REQUIRE(q.count == 10000);
+		REQUIRE(std::fabs(quantile_get(&q) - exact(v, p)) < 20.0);
+	}
+}
+
+TEST_CASE("Test quantile skewed") {
+	/* Mostly dim with occasional bright readings, like lux indoors */
+	srand(2);
+	struct quantile low;
+	struct quantile high;
+	quantile_init(&low, 0.05);
+	quantile_init(&high, 0.95);
+	std::vector<double> v;
+	for (int i = 0; i < 20000; ++i) {
+		const double x = (rand() % 10 == 0) ? 5000 + rand() % 5000 : 50 + rand() % 100;
+		v.push_back(x);
+		quantile_add(&low, x);
+		quantile_add(&high, x);
+	}
+	REQUIRE(std::fabs(quantile_get(&low) - exact(v, 0.05)) < 10.0);
+	REQUIRE(std::fabs(quantile_get(&high) - exact(v, 0.95)) < 500.0);
+}
+
+TEST_CASE("Test quantile constant") {
+	struct quantile q;
+	quantile_init(&q, 0.95);
+	for (int i = 0; i < 100; ++i)
+		quantile_add(&q, 42.0);
+	REQUIRE(quantile_get(&q) == 42.0);
+}
@@ -122,3 +122,21 @@ TEST_CASE("Moving average") {
 
 	destroy_ringbuf(&buf);
 }
+
+TEST_CASE("Test peek") {
+	struct ringbuf *buf = create_ringbuf(3);
+	ringbuf_push(buf, 1);
+	ringbuf_push(buf, 2);
+	REQUIRE(ringbuf_peek(buf, 0) == 1);
+	REQUIRE(ringbuf_peek(buf, 1) == 2);
+	check_ringbuf(buf, 2, 3);
+
+	ringbuf_push(buf, 3);
+	ringbuf_push(buf, 4);
+	REQUIRE(ringbuf_peek(buf, 0) == 2);
+	REQUIRE(ringbuf_peek(buf, 1) == 3);
+	REQUIRE(ringbuf_peek(buf, 2) == 4);
+	check_ringbuf(buf, 3, 3);
+
+	destroy_ringbuf(&buf);
+}
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+/* Daemon under test, set by Makefile */
+#ifndef BACKLIGHTCTL
+#define BACKLIGHTCTL "build/backlightctl"
+#endif
+
+static void write_file(const char* path, const char* text)
+{
+	FILE *fp = fopen(path, "w");
+	REQUIRE(fp);
+	fputs(text, fp);
+	fclose(fp);
+}
+
+static std::string read_file(const char* path)
+{
+	std::string text;
+	FILE *fp = fopen(path, "r");
+	REQUIRE(fp);
+	char buf[256];
+	size_t n = 0;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		text.append(buf, n);
+	fclose(fp);
+	return text;
+}
+
+/* Run daemon with args on script under virtual clock.
+ * Returns brightness writes, one "time_ms value" per line. */
+static std::string simulate(const char* script, const char* args)
+{
+	char script_path[] = "/tmp/test-scenario-XXXXXX";
+	char output_path[] = "/tmp/test-scenario-XXXXXX";
+	int fd = mkstemp(script_path);
+	REQUIRE(fd >= 0);
+	close(fd);
+	fd = mkstemp(output_path);
+	REQUIRE(fd >= 0);
+	close(fd);
+	write_file(script_path, script);
+
+	const std::string command = std::string(BACKLIGHTCTL) + " --simulate " + script_path + " --sim-output "
+								+ output_path + " " + args + " > /dev/null 2>&1";
+	const int status = system(command.c_str());
+	const std::string output = read_file(output_path);
+	unlink(script_path);
+	unlink(output_path);
+	REQUIRE(WIFEXITED(status));
+	REQUIRE(WEXITSTATUS(status) == 0);
+	return output;
+}
+
+TEST_CASE("Test scenario") {
+	SECTION("Trigger timeout") {
+		const std::string writes = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 7\n"
+			"1000 trigger\n"
+			"20000 trigger\n"
+			"40000 end\n",
+			"-i /sim -t 5");
+		// Initial brightness is kept without a write, exit restore is not a decision
+		REQUIRE(writes ==
+			"6000 0\n"
+			"20000 7\n"
+			"25000 0\n");
+	}
+
+	SECTION("Sensor while triggered") {
+		const std::string writes = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 10\n"
+			"10000 lux 600\n"
+			"20000 trigger\n"
+			"30000 end\n",
+			"-s sim:illuminance -i /sim -t 5");
+		// Seeded at startup, reseeded on wake up instead of ramping from stale readings
+		REQUIRE(writes ==
+			"0 1\n"
+			"5000 0\n"
+			"20000 10\n"
+			"25000 0\n");
+	}
+
+	SECTION("Resume in buffered mode") {
+		const std::string writes = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 10\n"
+			"1000 trigger\n"
+			"10000 lux 600\n"
+			"20000 trigger\n"
+			"21000 end\n",
+			"-s sim:illuminance -i /sim -t 5 --rate 1000");
+		// No buffer block is complete at wake up, burst reads raw attribute
+		REQUIRE(writes ==
+			"0 1\n"
+			"6000 0\n"
+			"20000 10\n");
+	}
+
+	SECTION("First decision") {
+		const std::string writes = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 600\n"
+			"1000 end\n",
+			"-s sim:illuminance --window 10");
+		// Seeded by a burst, not ramping in over the window
+		REQUIRE(writes == "0 10\n");
+	}
+
+	SECTION("Restored window kept") {
+		char state_path[] = "/tmp/test-scenario-XXXXXX";
+		const int fd = mkstemp(state_path);
+		REQUIRE(fd >= 0);
+		close(fd);
+		unlink(state_path);
+		const std::string args = std::string("-s sim:illuminance --window 10 --state ") + state_path;
+		const std::string first = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 600\n"
+			"5000 end\n",
+			args.c_str());
+		const std::string second = simulate(
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 10\n"
+			"3000 end\n",
+			args.c_str());
+		unlink(state_path);
+		REQUIRE(first == "0 10\n");
+		// Window of the previous run decides first, new readings replace it one per sample
+		REQUIRE(second ==
+			"0 10\n"
+			"100 9\n"
+			"200 8\n"
+			"300 7\n"
+			"400 6\n"
+			"500 5\n"
+			"600 4\n"
+			"700 3\n"
+			"800 2\n"
+			"900 1\n");
+	}
+}
@@ -0,0 +1,128 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "sim.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static void write_script(const char* path, const char* script)
+{
+	FILE *fp = fopen(path, "w");
+	REQUIRE(fp);
+	fputs(script, fp);
+	fclose(fp);
+}
+
+TEST_CASE("Test sim") {
+	char path[] = "/tmp/test-sim-XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	struct sim sim;
+
+	SECTION("Load") {
+		write_script(path,
+			"# comment\n"
+			"0 max_brightness 10\n"
+			"0 brightness 5\n"
+			"0 lux 100\n"
+			"\n"
+			"250 trigger\n"
+			"1000 prox 3\n");
+		REQUIRE(sim_load(&sim, path, NULL) == 0);
+		REQUIRE(sim.count == 3);
+		REQUIRE(sim.max_brightness == 10);
+		REQUIRE(sim.brightness == 5);
+		REQUIRE(sim.lux == 100);
+		REQUIRE(sim.events[1].time_ms == 250);
+		REQUIRE(sim.events[1].command == SIM_TRIGGER);
+		sim_free(&sim);
+	}
+
+	SECTION("Invalid") {
+		write_script(path, "0 max_brightness 10\n100 lux 1\n50 lux 2\n");
+		REQUIRE(sim_load(&sim, path, NULL) == -EINVAL);
+		write_script(path, "0 max_brightness 10\n100 dim 1\n");
+		REQUIRE(sim_load(&sim, path, NULL) == -EINVAL);
+		write_script(path, "100 max_brightness 10\n");
+		REQUIRE(sim_load(&sim, path, NULL) == -EINVAL);
+		write_script(path, "0 lux 10\n");
+		REQUIRE(sim_load(&sim, path, NULL) == -EINVAL);
+		REQUIRE(sim_load(&sim, "/nonexistent/script", NULL) == -ENOENT);
+	}
+
+	SECTION("Advance") {
+		write_script(path,
+			"0 max_brightness 10\n"
+			"0 lux 100\n"
+			"150 lux 200\n"
+			"250 trigger\n"
+			"250 prox 7\n"
+			"400 end\n");
+		REQUIRE(sim_load(&sim, path, NULL) == 0);
+
+		struct timespec ts;
+		REQUIRE(sim_advance(&sim, 100) == 0);
+		REQUIRE(sim.now_ms == 100);
+		REQUIRE(sim.lux == 100);
+
+		REQUIRE(sim_advance(&sim, 100) == 0);
+		REQUIRE(sim.now_ms == 200);
+		REQUIRE(sim.lux == 200);
+
+		// Stops at trigger, events at same time applied
+		REQUIRE(sim_advance(&sim, 1000) == 1);
+		REQUIRE(sim.now_ms == 250);
+		REQUIRE(sim.proximity == 7);
+		sim_now(&sim, &ts);
+		REQUIRE(ts.tv_sec == 0);
+		REQUIRE(ts.tv_nsec == 250000000L);
+
+		REQUIRE(sim_advance(&sim, -1) == -ECANCELED);
+		REQUIRE(sim.now_ms == 400);
+		REQUIRE(sim_advance(&sim, 100) == -ECANCELED);
+		sim_free(&sim);
+	}
+
+	SECTION("Ends after last event") {
+		write_script(path, "0 max_brightness 10\n100 lux 5\n");
+		REQUIRE(sim_load(&sim, path, NULL) == 0);
+		REQUIRE(sim_advance(&sim, 500) == 0);
+		REQUIRE(sim.now_ms == 500);
+		REQUIRE(sim_advance(&sim, 500) == -ECANCELED);
+		sim_free(&sim);
+	}
+
+	SECTION("Write") {
+		char out_path[] = "/tmp/test-sim-out-XXXXXX";
+		const int out_fd = mkstemp(out_path);
+		REQUIRE(out_fd >= 0);
+		close(out_fd);
+
+		write_script(path, "0 max_brightness 10\n1000 end\n");
+		FILE *out = fopen(out_path, "w");
+		REQUIRE(out);
+		REQUIRE(sim_load(&sim, path, out) == 0);
+		REQUIRE(sim_advance(&sim, 300) == 0);
+		sim_write(&sim, 4);
+		REQUIRE(sim.brightness == 4);
+		REQUIRE(sim.writes == 1);
+		fclose(out);
+		sim_free(&sim);
+
+		FILE *in = fopen(out_path, "r");
+		REQUIRE(in);
+		char line[64] = {0};
+		REQUIRE(fgets(line, sizeof(line), in));
+		REQUIRE(strcmp(line, "300 4\n") == 0);
+		fclose(in);
+		unlink(out_path);
+	}
+
+	unlink(path);
+}
@@ -0,0 +1,345 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "source.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+static int pipe_ready(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	(void) events;
+	char c = 0;
+	if (read(source->fd, &c, 1) != 1)
+		return -EIO;
+	sample->trigger = 1;
+	(*static_cast<int*>(source->priv))++;
+	return 0;
+}
+
+static int periodic_sample(struct source* source, struct source_sample* sample)
+{
+	sample->lux[0] = 42;
+	sample->lux_set = 1;
+	(*static_cast<int*>(source->priv))++;
+	return 0;
+}
+
+static int failing_sample(struct source* source, struct source_sample* sample)
+{
+	(void) source;
+	(void) sample;
+	return -EIO;
+}
+
+/* Fails while *priv is set */
+static int flaky_sample(struct source* source, struct source_sample* sample)
+{
+	if (*static_cast<int*>(source->priv))
+		return -EIO;
+	sample->lux_set = 1;
+	return 0;
+}
+
+static int recovers = 0;
+
+static int count_recover(struct source* source)
+{
+	(void) source;
+	recovers++;
+	return 0;
+}
+
+/* New pipe replaces closed one, write end is kept in priv */
+static int pipe_recover(struct source* source)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return -errno;
+	close(source->fd);
+	source->fd = fds[0];
+	*static_cast<int*>(source->priv) = fds[1];
+	recovers++;
+	return 0;
+}
+
+static int pipe_read(struct source* source, uint32_t events, struct source_sample* sample)
+{
+	(void) events;
+	char c = 0;
+	if (read(source->fd, &c, 1) != 1)
+		return -EIO;
+	sample->trigger = 1;
+	return 0;
+}
+
+TEST_CASE("Test source registry") {
+	struct source_registry reg;
+	REQUIRE(source_registry_init(&reg) == 0);
+	const struct timespec start = {0, 0};
+
+	SECTION("Empty") {
+		REQUIRE(source_timeout_ms(&reg, &start) == -1);
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		REQUIRE(source_wait(&reg, 0, &sample) == 0);
+		REQUIRE(source_sample_due(&reg, &start, 1, &sample) == 0);
+	}
+
+	SECTION("Fd source") {
+		int fds[2];
+		REQUIRE(pipe(fds) == 0);
+		int calls = 0;
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = fds[0];
+		source.events = EPOLLIN;
+		source.ready = pipe_ready;
+		source.priv = &calls;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+		REQUIRE(source_add(&reg, &source, &start) == -EEXIST);
+
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		REQUIRE(source_wait(&reg, 0, &sample) == 0);
+		REQUIRE(calls == 0);
+
+		REQUIRE(write(fds[1], "x", 1) == 1);
+		REQUIRE(source_wait(&reg, 1000, &sample) == 1);
+		REQUIRE(calls == 1);
+		REQUIRE(sample.trigger == 1);
+
+		REQUIRE(source.reg == &reg);
+		REQUIRE(source_set_masked(&reg, &source, 1) == 0);
+		REQUIRE(write(fds[1], "x", 1) == 1);
+		REQUIRE(source_wait(&reg, 0, &sample) == 0);
+		REQUIRE(calls == 1);
+		REQUIRE(source_set_masked(&reg, &source, 0) == 0);
+		REQUIRE(source_wait(&reg, 0, &sample) == 1);
+		REQUIRE(calls == 2);
+
+		REQUIRE(source_remove(&reg, &source) == 0);
+		REQUIRE(source_remove(&reg, &source) == -ENOENT);
+		REQUIRE(source.reg == nullptr);
+		REQUIRE(write(fds[1], "x", 1) == 1);
+		REQUIRE(source_wait(&reg, 0, &sample) == 0);
+		REQUIRE(calls == 2);
+		REQUIRE(source_set_masked(&reg, &source, 1) == -EINVAL);
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+
+	SECTION("Periodic source") {
+		int calls = 0;
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = -1;
+		source.interval_ms = 100;
+		source.sample = periodic_sample;
+		source.priv = &calls;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+
+		REQUIRE(source_timeout_ms(&reg, &start) == 100);
+		struct timespec ts = {0, 40000000};
+		REQUIRE(source_timeout_ms(&reg, &ts) == 60);
+		ts = {0, 40000001};
+		REQUIRE(source_timeout_ms(&reg, &ts) == 60);
+
+		REQUIRE(source_due(&source, &ts) == 0);
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(calls == 0);
+		REQUIRE(source_sample_due(&reg, &ts, 1, &sample) == 1);
+		REQUIRE(calls == 1);
+		REQUIRE(sample.lux_set == 1);
+		REQUIRE(sample.lux[0] == 42);
+
+		/* Period kept */
+		ts = {0, 200000000};
+		REQUIRE(source_timeout_ms(&reg, &ts) == 0);
+		REQUIRE(source_due(&source, &ts) == 1);
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 1);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 100);
+
+		/* No catching up */
+		ts = {10, 0};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 1);
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 100);
+		REQUIRE(calls == 3);
+
+		REQUIRE(source_set_interval(&reg, &source, 0, &ts) == 0);
+		REQUIRE(source_timeout_ms(&reg, &ts) == -1);
+		REQUIRE(source_due(&source, &ts) == 0);
+	}
+
+	SECTION("Error propagated") {
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = -1;
+		source.interval_ms = 100;
+		source.sample = failing_sample;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		const struct timespec ts = {1, 0};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == -EIO);
+	}
+
+	SECTION("Retry with backoff") {
+		int failing = 1;
+		recovers = 0;
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = -1;
+		source.interval_ms = 100;
+		source.sample = flaky_sample;
+		source.retry = 1;
+		source.recover = count_recover;
+		source.priv = &failing;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+
+		/* Delay doubles from period */
+		struct timespec ts = {1, 0};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(source.failures == 1);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 100);
+		ts = {1, 100000000};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 200);
+
+		/* Backing off source isn't sampled early even if all are sampled */
+		REQUIRE(source_sample_due(&reg, &ts, 1, &sample) == 0);
+		REQUIRE(source.failures == 2);
+
+		ts = {1, 300000000};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(source.failures == 3);
+		REQUIRE(recovers == 1);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 400);
+
+		/* Capped */
+		for (int i = 0; i < 10; ++i) {
+			ts.tv_sec += 10;
+			source_sample_due(&reg, &ts, 0, &sample);
+		}
+		REQUIRE(source_timeout_ms(&reg, &ts) == SOURCE_MAX_BACKOFF_MS);
+		REQUIRE(source.errors == 13);
+		REQUIRE(source.recoveries == 4);
+
+		/* Healthy again, back to period */
+		failing = 0;
+		ts.tv_sec += 10;
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 1);
+		REQUIRE(sample.lux_set == 1);
+		REQUIRE(source.failures == 0);
+		REQUIRE(source_timeout_ms(&reg, &ts) == 100);
+	}
+
+	SECTION("Faulted fd recovered") {
+		int fds[2];
+		REQUIRE(pipe(fds) == 0);
+		int writer = fds[1];
+		recovers = 0;
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = fds[0];
+		source.events = EPOLLIN;
+		source.ready = pipe_read;
+		source.retry = 1;
+		source.recover = pipe_recover;
+		source.priv = &writer;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+		REQUIRE(source_timeout_ms(&reg, &start) == -1);
+
+		/* Hang up fails read, source is masked instead of spinning on it */
+		close(writer);
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		REQUIRE(source_wait(&reg, 0, &sample) == 1);
+		REQUIRE(source.faulted == 1);
+		REQUIRE(source.masked == 1);
+		REQUIRE(source_wait(&reg, 0, &sample) == 0);
+		REQUIRE(source_timeout_ms(&reg, &start) == 0);
+
+		const struct timespec ts = {1, 0};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(recovers == 1);
+		REQUIRE(source.faulted == 0);
+		REQUIRE(source.recoveries == 1);
+		REQUIRE(source_timeout_ms(&reg, &ts) == -1);
+
+		REQUIRE(write(writer, "x", 1) == 1);
+		REQUIRE(source_wait(&reg, 0, &sample) == 1);
+		REQUIRE(sample.trigger == 1);
+		REQUIRE(source.failures == 0);
+		close(writer);
+		close(source.fd);
+	}
+
+	SECTION("Faulted from callback") {
+		int fds[2];
+		REQUIRE(pipe(fds) == 0);
+		int writer = fds[1];
+		recovers = 0;
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = fds[0];
+		source.events = EPOLLIN;
+		source.ready = pipe_read;
+		source.sample = periodic_sample;
+		source.retry = 1;
+		source.recover = pipe_recover;
+		int samples = 0;
+		source.priv = &samples;
+		source.interval_ms = 100;
+		REQUIRE(source_add(&reg, &source, &start) == 0);
+		REQUIRE(source_set_masked(&reg, &source, 1) == 0);
+
+		/* Callback stops sampling and fails to poll again */
+		REQUIRE(source_set_interval(&reg, &source, 0, &start) == 0);
+		REQUIRE(source_fault(&reg, &source, &start) == 0);
+		REQUIRE(source.faulted == 1);
+		REQUIRE(source.masked == 1);
+		REQUIRE(source.errors == 1);
+		REQUIRE(source_timeout_ms(&reg, &start) == SOURCE_RETRY_MS);
+
+		struct source_sample sample;
+		memset(&sample, 0, sizeof(sample));
+		const struct timespec early = {0, 50000000};
+		REQUIRE(source_sample_due(&reg, &early, 1, &sample) == 0);
+		REQUIRE(recovers == 0);
+
+		source.priv = &writer;
+		const struct timespec ts = {0, SOURCE_RETRY_MS * 1000000L};
+		REQUIRE(source_sample_due(&reg, &ts, 0, &sample) == 0);
+		REQUIRE(recovers == 1);
+		REQUIRE(source.faulted == 0);
+		REQUIRE(source.masked == 0);
+		REQUIRE(source_timeout_ms(&reg, &ts) == -1);
+
+		REQUIRE(write(writer, "x", 1) == 1);
+		REQUIRE(source_wait(&reg, 0, &sample) == 1);
+		REQUIRE(sample.trigger == 1);
+		close(fds[1]);
+		close(writer);
+		close(source.fd);
+	}
+
+	SECTION("Invalid") {
+		struct source source;
+		memset(&source, 0, sizeof(source));
+		source.fd = -1;
+		source.interval_ms = 100;
+		REQUIRE(source_add(&reg, &source, &start) == -EINVAL);
+	}
+
+	source_registry_free(&reg);
+}
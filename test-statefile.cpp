@@ -0,0 +1,126 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "statefile.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Test statefile") {
+	char path[] = "/tmp/test-statefile-XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	struct statefile *file = statefile_open(path);
+	REQUIRE(file);
+
+	struct libbacklight_state state;
+	memset(&state, 0, sizeof(state));
+
+	SECTION("Empty") {
+		REQUIRE(statefile_load(file, &state) == -ENOENT);
+	}
+
+	SECTION("Store and reload") {
+		state.brightness_step = 7;
+		state.samples = 2;
+		state.sensor[0] = 10;
+		state.sensor[1] = 20;
+		state.sensor_sum = 30;
+		state.last_trigger.tv_sec = 42;
+		statefile_store(file, &state);
+		REQUIRE((file->seq & 1) == 0);
+		statefile_close(&file);
+		REQUIRE(!file);
+
+		file = statefile_open(path);
+		REQUIRE(file);
+		struct libbacklight_state loaded;
+		REQUIRE(statefile_load(file, &loaded) == 0);
+		REQUIRE(memcmp(&state, &loaded, sizeof(state)) == 0);
+	}
+
+	SECTION("Unchanged state not rewritten") {
+		statefile_store(file, &state);
+		const uint32_t seq = file->seq;
+		statefile_store(file, &state);
+		REQUIRE(file->seq == seq);
+		state.brightness_step = 1;
+		statefile_store(file, &state);
+		REQUIRE(file->seq == seq + 2);
+	}
+
+	SECTION("Energy") {
+		struct energy_counters energy;
+		memset(&energy, 0, sizeof(energy));
+		REQUIRE(statefile_load_energy(file, &energy) == -ENOENT);
+
+		energy.lit_seconds = 12.5;
+		energy.bucket_seconds[3] = 2.0;
+		statefile_store(file, &state);
+		statefile_store_energy(file, &energy);
+		REQUIRE((file->seq & 1) == 0);
+		statefile_close(&file);
+
+		file = statefile_open(path);
+		REQUIRE(file);
+		struct energy_counters loaded;
+		REQUIRE(statefile_load_energy(file, &loaded) == 0);
+		REQUIRE(memcmp(&energy, &loaded, sizeof(energy)) == 0);
+		REQUIRE(statefile_load(file, &state) == 0);
+	}
+
+	SECTION("Interrupted update") {
+		statefile_store(file, &state);
+		file->seq++;
+		REQUIRE(statefile_load(file, &state) == -EINVAL);
+		// Next store recovers
+		state.brightness_step = 3;
+		statefile_store(file, &state);
+		REQUIRE((file->seq & 1) == 0);
+		struct libbacklight_state loaded;
+		REQUIRE(statefile_load(file, &loaded) == 0);
+		REQUIRE(loaded.brightness_step == 3);
+		struct energy_counters energy;
+		memset(&energy, 0, sizeof(energy));
+		file->seq++;
+		statefile_store_energy(file, &energy);
+		REQUIRE(statefile_load_energy(file, &energy) == 0);
+	}
+
+	SECTION("Wrong magic") {
+		statefile_store(file, &state);
+		file->magic = 0xdead;
+		REQUIRE(statefile_load(file, &state) == -EINVAL);
+	}
+
+	SECTION("Not a state file") {
+		statefile_close(&file);
+		const int fd = open(path, O_WRONLY | O_TRUNC);
+		REQUIRE(fd >= 0);
+		REQUIRE(write(fd, "garbage", 7) == 7);
+		close(fd);
+
+		// Someone else's file is left alone
+		REQUIRE(!statefile_open(path));
+		REQUIRE(errno == EEXIST);
+		struct stat st;
+		REQUIRE(stat(path, &st) == 0);
+		REQUIRE(st.st_size == 7);
+	}
+
+	SECTION("Reopen before first store") {
+		statefile_close(&file);
+		file = statefile_open(path);
+		REQUIRE(file);
+		REQUIRE(statefile_load(file, &state) == -ENOENT);
+	}
+
+	statefile_close(&file);
+	unlink(path);
+}
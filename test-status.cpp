@@ -0,0 +1,68 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include "status.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Test status read/write") {
+	struct status_page page;
+	status_init(&page);
+
+	struct status_values in;
+	memset(&in, 0, sizeof(in));
+	in.brightness_step = 3;
+	in.max_brightness_step = 10;
+	in.filtered_lux = 100;
+	in.raw_lux = 120;
+	in.triggered = 1;
+	in.timeout_ms = 5000;
+	in.updated_ms = 42;
+	status_publish(&page, &in);
+
+	struct status_values out;
+	REQUIRE(status_read(&page, &out) == 0);
+	REQUIRE(memcmp(&in, &out, sizeof(in)) == 0);
+	REQUIRE((page.seq & 1) == 0);
+}
+
+TEST_CASE("Test status invalid page") {
+	struct status_page page;
+	memset(&page, 0, sizeof(page));
+	struct status_values out;
+	REQUIRE(status_read(&page, &out) == -EINVAL);
+}
+
+TEST_CASE("Test status consistent snapshots") {
+	struct status_page page;
+	status_init(&page);
+	std::atomic<bool> done(false);
+
+	std::thread writer([&page, &done]() {
+		struct status_values v;
+		memset(&v, 0, sizeof(v));
+		for (uint32_t i = 1; i <= 200000; ++i) {
+			v.brightness_step = i;
+			v.filtered_lux = i;
+			v.raw_lux = i;
+			v.timeout_ms = i;
+			v.updated_ms = i;
+			status_publish(&page, &v);
+		}
+		done = true;
+	});
+
+	bool consistent = true;
+	while (!done) {
+		struct status_values v;
+		status_read(&page, &v);
+		if (v.filtered_lux != v.brightness_step || v.raw_lux != v.brightness_step
+				|| v.timeout_ms != v.brightness_step || v.updated_ms != v.brightness_step)
+			consistent = false;
+	}
+	writer.join();
+	REQUIRE(consistent);
+}
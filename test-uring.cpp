@@ -0,0 +1,82 @@
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include "uring.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Test uring") {
+	struct uring ring;
+	const int r = uring_init(&ring, 4);
+	if (r == -ENOSYS || r == -EPERM) {
+		WARN("io_uring unavailable");
+		return;
+	}
+	REQUIRE(r == 0);
+
+	char path[] = "/tmp/test-uring-XXXXXX";
+	const int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	REQUIRE(write(fd, "1234\n", 5) == 5);
+	int pipefd[2];
+	REQUIRE(pipe(pipefd) == 0);
+	REQUIRE(write(pipefd[1], "hello", 5) == 5);
+
+	const int fds[] = {fd, -1, pipefd[0]};
+	REQUIRE(uring_register_files(&ring, fds, 3) == 0);
+
+	struct uring_result results[4];
+
+	SECTION("Batched reads") {
+		char file_buf[16] = {0};
+		char pipe_buf[16] = {0};
+		REQUIRE(uring_prep_read(&ring, 0, file_buf, sizeof(file_buf) - 1, 0, 10) == 0);
+		REQUIRE(uring_prep_read(&ring, 2, pipe_buf, sizeof(pipe_buf) - 1, 0, 20) == 0);
+		REQUIRE(uring_submit_and_wait(&ring, results, 4) == 2);
+		REQUIRE(ring.submits == 1);
+		for (int i = 0; i < 2; ++i) {
+			REQUIRE(results[i].res == 5);
+			REQUIRE((results[i].user_data == 10 || results[i].user_data == 20));
+		}
+		REQUIRE(strcmp(file_buf, "1234\n") == 0);
+		REQUIRE(strcmp(pipe_buf, "hello") == 0);
+
+		/* Same offset reads again, like sysfs attributes */
+		memset(file_buf, 0, sizeof(file_buf));
+		REQUIRE(uring_prep_read(&ring, 0, file_buf, sizeof(file_buf) - 1, 0, 11) == 0);
+		REQUIRE(uring_submit_and_wait(&ring, results, 4) == 1);
+		REQUIRE(results[0].user_data == 11);
+		REQUIRE(strcmp(file_buf, "1234\n") == 0);
+	}
+
+	SECTION("Write") {
+		REQUIRE(uring_prep_write(&ring, 0, "42\n", 3, 0, 1) == 0);
+		REQUIRE(uring_submit_and_wait(&ring, results, 4) == 1);
+		REQUIRE(results[0].res == 3);
+		char buf[8] = {0};
+		REQUIRE(pread(fd, buf, sizeof(buf) - 1, 0) == 5);
+		REQUIRE(strcmp(buf, "42\n4\n") == 0);
+	}
+
+	SECTION("Errors") {
+		char buf[8];
+		REQUIRE(uring_prep_read(&ring, 1, buf, sizeof(buf), 0, 1) == 0);
+		REQUIRE(uring_submit_and_wait(&ring, results, 4) == 1);
+		REQUIRE(results[0].res == -EBADF);
+
+		for (int i = 0; i < 4; ++i)
+			REQUIRE(uring_prep_read(&ring, 0, buf, sizeof(buf), 0, i) == 0);
+		REQUIRE(uring_prep_read(&ring, 0, buf, sizeof(buf), 0, 4) == -EBUSY);
+		REQUIRE(uring_submit_and_wait(&ring, results, 2) == -EINVAL);
+	}
+
+	uring_free(&ring);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(fd);
+	unlink(path);
+}
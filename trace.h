@@ -0,0 +1,27 @@
+#ifndef TRACE__H__
+#define TRACE__H__
+
+/* Static tracepoints, enabled when sys/sdt.h is available, build with USDT=0 to leave them out.
+ * Each probe is a single nop until attached by a tracer, for example:
+ *   bpftrace -e 'usdt:./build/backlightctl:libbacklight:operate_exit { @step = lhist(arg1, 0, 32, 1); }'
+ * Without probes arguments are only type checked, never evaluated.
+ */
+
+#if !defined(HAVE_SDT) && !defined(NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SDT
+#endif
+#endif
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define TRACE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define TRACE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define TRACE3(provider, name, a1, a2, a3) DTRACE_PROBE3(provider, name, a1, a2, a3)
+#else
+#define TRACE1(provider, name, a1) do { if (0) { (void) (a1); } } while (0)
+#define TRACE2(provider, name, a1, a2) do { if (0) { (void) (a1); (void) (a2); } } while (0)
+#define TRACE3(provider, name, a1, a2, a3) do { if (0) { (void) (a1); (void) (a2); (void) (a3); } } while (0)
+#endif
+
+#endif /* TRACE__H__ */
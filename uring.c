@@ -0,0 +1,173 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+int uring_init(struct uring* ring, unsigned entries)
+{
+	memset(ring, 0, sizeof(struct uring));
+	ring->fd = -1;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const int fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0)
+		return -errno;
+	ring->fd = fd;
+	ring->entries = params.sq_entries;
+
+	ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	const int single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single) {
+		if (ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+
+	int r = 0;
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		r = -errno;
+		ring->sq_ptr = NULL;
+		goto error_exit;
+	}
+	if (single) {
+		ring->cq_ptr = ring->sq_ptr;
+	}
+	else {
+		ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			r = -errno;
+			ring->cq_ptr = NULL;
+			goto error_exit;
+		}
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		r = -errno;
+		ring->sqes = NULL;
+		goto error_exit;
+	}
+
+	unsigned char *sq = ring->sq_ptr;
+	ring->sq_head = (unsigned*) (sq + params.sq_off.head);
+	ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) (sq + params.sq_off.array);
+	unsigned char *cq = ring->cq_ptr;
+	ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+	ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+	return 0;
+
+error_exit:
+	uring_free(ring);
+	return r;
+}
+
+void uring_free(struct uring* ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_size);
+	if (ring->sq_ptr)
+		munmap(ring->sq_ptr, ring->sq_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	memset(ring, 0, sizeof(struct uring));
+	ring->fd = -1;
+}
+
+int uring_register_files(struct uring* ring, const int* fds, unsigned count)
+{
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, count) < 0)
+		return -errno;
+	return 0;
+}
+
+static struct io_uring_sqe* get_sqe(struct uring* ring)
+{
+	const unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (ring->sq_local_tail - head >= ring->entries)
+		return NULL;
+	const unsigned index = ring->sq_local_tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	return sqe;
+}
+
+static int prep_rw(struct uring* ring, int op, int file, const void* buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe = get_sqe(ring);
+	if (!sqe)
+		return -EBUSY;
+	sqe->opcode = op;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = file;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+	return 0;
+}
+
+int uring_prep_read(struct uring* ring, int file, void* buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+	return prep_rw(ring, IORING_OP_READ, file, buf, len, offset, user_data);
+}
+
+int uring_prep_write(struct uring* ring, int file, const void* buf, unsigned len, uint64_t offset, uint64_t user_data)
+{
+	return prep_rw(ring, IORING_OP_WRITE, file, buf, len, offset, user_data);
+}
+
+static unsigned reap(struct uring* ring, struct uring_result* results, unsigned max)
+{
+	unsigned head = *ring->cq_head;
+	const unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned count = 0;
+	while (head != tail && count < max) {
+		const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		results[count].user_data = cqe->user_data;
+		results[count].res = cqe->res;
+		count++;
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+int uring_submit_and_wait(struct uring* ring, struct uring_result* results, unsigned max)
+{
+	const unsigned pending = ring->sq_local_tail - *ring->sq_tail;
+	if (pending > max)
+		return -EINVAL;
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	unsigned submitted = 0;
+	unsigned done = 0;
+	while (done < pending) {
+		const int r = syscall(__NR_io_uring_enter, ring->fd, pending - submitted, pending - done,
+								IORING_ENTER_GETEVENTS, NULL, 0);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		ring->submits++;
+		submitted += r;
+		done += reap(ring, results + done, max - done);
+	}
+	ring->ops += done;
+	return done;
+}
@@ -0,0 +1,65 @@
+#ifndef URING__H__
+#define URING__H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimal io_uring using raw syscalls, for batching reads and writes on registered files.
+ * Operations are prepared, then submitted and reaped together with one io_uring_enter.
+ */
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct uring {
+	int fd;
+	unsigned entries;				// Submission queue entries
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned sq_local_tail;			// Prepared, not yet submitted up to here
+	unsigned long long submits;		// io_uring_enter calls
+	unsigned long long ops;			// Completed operations
+};
+
+struct uring_result {
+	uint64_t user_data;
+	int res;						// Bytes transferred or negative errno
+};
+
+/* Returns 0 on success or negative errno, -ENOSYS if io_uring is unavailable */
+int uring_init(struct uring* ring, unsigned entries);
+void uring_free(struct uring* ring);
+
+/* Register files, fds may contain -1 for unused slots.
+ * Prepared operations refer to files by index. */
+int uring_register_files(struct uring* ring, const int* fds, unsigned count);
+
+/* Returns 0 on success or -EBUSY if submission queue is full */
+int uring_prep_read(struct uring* ring, int file, void* buf, unsigned len, uint64_t offset, uint64_t user_data);
+int uring_prep_write(struct uring* ring, int file, const void* buf, unsigned len, uint64_t offset, uint64_t user_data);
+
+/* Submit prepared operations and wait for all of them to complete.
+ * Returns number of results or negative errno, max must fit all prepared operations. */
+int uring_submit_and_wait(struct uring* ring, struct uring_result* results, unsigned max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* URING__H__ */